@@ -0,0 +1,59 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Micro-benchmarks of the controllers with fixed inputs. Build with
+// -DBUILD_BENCHMARKS=TRUE and run
+//   rosrun rotors_control rotors_control_benchmark
+
+#include <benchmark/benchmark.h>
+
+#include "rotors_control/lee_position_controller.h"
+
+namespace rotors_control {
+
+static void BM_LeePositionControllerCalculateRotorVelocities(
+    benchmark::State& state) {
+  // Default parameters of the controller and the firefly.
+  LeePositionController lee_position_controller;
+
+  // Tilted MAV, half a meter off its setpoint and moving.
+  EigenOdometry odometry(
+      Eigen::Vector3d(0.5, -0.3, 0.8),
+      Eigen::Quaterniond(Eigen::AngleAxisd(0.1, Eigen::Vector3d::UnitX()) *
+                         Eigen::AngleAxisd(-0.05, Eigen::Vector3d::UnitY())),
+      Eigen::Vector3d(0.2, 0.1, -0.1), Eigen::Vector3d(0.05, -0.02, 0.1));
+  lee_position_controller.SetOdometry(odometry);
+
+  mav_msgs::EigenTrajectoryPoint trajectory_point;
+  trajectory_point.position_W = Eigen::Vector3d(0.0, 0.0, 1.0);
+  trajectory_point.setFromYaw(0.3);
+  lee_position_controller.SetTrajectoryPoint(trajectory_point);
+
+  Eigen::VectorXd rotor_velocities;
+  while (state.KeepRunning()) {
+    lee_position_controller.CalculateRotorVelocities(&rotor_velocities);
+    benchmark::DoNotOptimize(rotor_velocities.data());
+  }
+}
+BENCHMARK(BM_LeePositionControllerCalculateRotorVelocities);
+
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,251 @@
+#!/usr/bin/env python
+# This is needed such that int / int gives a float instead of an int
+from __future__ import division
+
+import csv
+import fnmatch
+import json
+import multiprocessing
+import optparse
+import os
+import time
+import traceback
+
+import roslib
+roslib.load_manifest('rotors_evaluation')
+
+from rosbag_tools import analyze_bag, helpers, waypoints_evaluation
+
+
+__author__ = "Fadri Furrer, Michael Burri, Markus Achtelik"
+__copyright__ = ("Copyright 2015, Fadri Furrer & Michael Burri & "
+                 "Markus Achtelik, ASL, ETH Zurich, Switzerland")
+__credits__ = ["Fadri Furrer", "Michael Burri", "Markus Achtelik"]
+__license__ = "ASL 2.0"
+__version__ = "0.1"
+__maintainer__ = "Fadri Furrer"
+__email__ = "fadri.furrer@mavt.ethz.ch"
+__status__ = "Development"
+
+
+report_fields = [
+    "bag", "status", "waypoints", "average_settling_time",
+    "average_position_rms_error", "average_angular_velocity_rms_error",
+    "collisions", "settling_time_score", "position_rms_error_score",
+    "angular_velocity_rms_error_score", "evaluation_duration", "error"]
+
+
+def find_bags(directory, pattern):
+    """Return all files below directory that match pattern, sorted."""
+    bags = []
+    for root, dirs, files in os.walk(directory):
+        for file_name in fnmatch.filter(files, pattern):
+            bags.append(os.path.join(root, file_name))
+    return sorted(bags)
+
+
+def evaluate_bag(job):
+    """Read a bag once with all topics and evaluate it, runs in a worker."""
+    bag_path, settings = job
+    start = time.time()
+    result = {"bag": bag_path}
+    try:
+        ab = analyze_bag.AnalyzeBag(bag_path_name=bag_path, save_plots=False)
+        try:
+            prefix = settings["mav_name"]
+            ab.add_pose_topic(prefix + settings["pose_topic"])
+            ab.add_twist_topic(prefix + settings["twist_topic"])
+            ab.add_waypoint_topic(prefix + settings["waypoint_topic"])
+            ab.add_wrench_topic(prefix + settings["wrench_topic"])
+            # All topics are read interleaved in a single pass over the bag.
+            ab.extract_messages()
+        finally:
+            ab.bag.close()
+
+        if ab.bag_time_start is None or len(ab.waypoint[0].x) == 0:
+            result["status"] = "skipped"
+            result["error"] = "No waypoints in bag."
+        else:
+            evaluation = waypoints_evaluation.evaluate_waypoints(
+                ab, settings["end_time"], settings["rms_calc_time"],
+                settings["settling_radius"], settings["min_settled_time"],
+                settings["first_waypoint_delay"])
+            # Only the summary of the bag goes into the report.
+            del evaluation["evaluations"]
+            del evaluation["collision_times"]
+            result.update(evaluation)
+            result["status"] = "ok"
+    except Exception:
+        result["status"] = "failed"
+        result["error"] = traceback.format_exc().strip().splitlines()[-1]
+    result["evaluation_duration"] = time.time() - start
+    return result
+
+
+def write_report(results, output_prefix):
+    """Write the results as <output_prefix>.csv and <output_prefix>.json."""
+    with open(output_prefix + ".csv", "w") as csv_file:
+        writer = csv.DictWriter(csv_file, fieldnames=report_fields)
+        writer.writeheader()
+        for result in results:
+            writer.writerow(dict((key, result.get(key, ""))
+                                 for key in report_fields))
+
+    evaluated = [result for result in results if result["status"] == "ok"]
+    summary = {
+        "bags": len(results),
+        "evaluated": len(evaluated),
+        "failed": len([result for result in results
+                       if result["status"] == "failed"]),
+        "with_collisions": len([result for result in evaluated
+                                if result["collisions"] > 0])}
+    for key in ["average_settling_time", "average_position_rms_error",
+                "average_angular_velocity_rms_error"]:
+        summary[key] = helpers.calculate_average(
+            [result[key] for result in evaluated if result[key] is not None])
+    with open(output_prefix + ".json", "w") as json_file:
+        json.dump({"summary": summary, "bags": results}, json_file, indent=2,
+                  sort_keys=True)
+    return summary
+
+
+def main():
+    parser = optparse.OptionParser(
+        """usage: %prog -d bag_directory [-j jobs] [-o report]
+
+        e.g.:
+        %prog -d /home/username/flights --mav_name firefly -j 8
+        """)
+    parser.add_option(
+        "-d", "--directory",
+        dest="directory",
+        type="string",
+        help="The directory that is searched (recursively) for bag files.")
+    parser.add_option(
+        "--pattern",
+        dest="pattern",
+        default="*.bag",
+        type="string",
+        help="File name pattern of the bags to evaluate.")
+    parser.add_option(
+        "-j", "--jobs",
+        dest="jobs",
+        default=multiprocessing.cpu_count(),
+        type="int",
+        help="Number of bags that are evaluated in parallel.")
+    parser.add_option(
+        "-o", "--output",
+        dest="output",
+        default="evaluation_report",
+        type="string",
+        help="Prefix of the written .csv and .json report.")
+    parser.add_option(
+        "-n", "--mav_name",
+        dest="mav_name",
+        default="",
+        type="string",
+        help="The name of your MAV (should correspond to the namespace).")
+    parser.add_option(
+        "-p", "--pose_topic",
+        dest="pose_topic",
+        default="/ground_truth/pose",
+        type="string",
+        help="The pose topic that you want to extract from the bag files.")
+    parser.add_option(
+        "-t", "--twist_topic",
+        dest="twist_topic",
+        default="/ground_truth/twist",
+        type="string",
+        help="The twist topic that you want to extract from the bag files.")
+    parser.add_option(
+        "-w", "--waypoint_topic",
+        dest="waypoint_topic",
+        default="/command/trajectory",
+        type="string",
+        help="The waypoint topic that you want to extract from the bag files.")
+    parser.add_option(
+        "-W", "--wrench_topic",
+        dest="wrench_topic",
+        default="/wrench",
+        type="string",
+        help="The wrench topic that you want to extract from the bag files.")
+    parser.add_option(
+        "-e", "--end_time",
+        dest="end",
+        default=1000.0,
+        type="float",
+        help="End time of the evaluated data.")
+    parser.add_option(
+        "--rms_calc_time",
+        dest="rms_calc_time",
+        default=10.0,
+        type="float",
+        help="The length of the RMS evaluation period.")
+    parser.add_option(
+        "--settling_radius",
+        dest="settling_radius",
+        default=0.1,
+        type="float",
+        help="The radius of the bounding sphere where the system should "
+             "settle.")
+    parser.add_option(
+        "--min_settled_time",
+        dest="min_settled_time",
+        default=3,
+        type="float",
+        help="The minimal time for which the system should stay bounded.")
+    parser.add_option(
+        "-D", "--delay_first_evaluation",
+        dest="first_waypoint_delay",
+        default=5,
+        type="float",
+        help="The time when the evaluation should start after the first "
+             "waypoint got published.")
+
+    (options, args) = parser.parse_args()
+    if not options.directory:
+        parser.error('Bag directory not given.')
+
+    settings = {
+        "mav_name": options.mav_name,
+        "pose_topic": options.pose_topic,
+        "twist_topic": options.twist_topic,
+        "waypoint_topic": options.waypoint_topic,
+        "wrench_topic": options.wrench_topic,
+        "end_time": options.end,
+        "rms_calc_time": options.rms_calc_time,
+        "settling_radius": options.settling_radius,
+        "min_settled_time": options.min_settled_time,
+        "first_waypoint_delay": options.first_waypoint_delay}
+
+    bags = find_bags(options.directory, options.pattern)
+    if not bags:
+        parser.error('No bags matching %s found in %s.'
+                     % (options.pattern, options.directory))
+    print("Evaluating %d bags with %d jobs." % (len(bags), options.jobs))
+
+    start = time.time()
+    results = []
+    pool = multiprocessing.Pool(max(options.jobs, 1))
+    try:
+        for result in pool.imap_unordered(
+                evaluate_bag, [(bag, settings) for bag in bags]):
+            results.append(result)
+            print("[%d/%d] %s: %s" % (len(results), len(bags),
+                                      result["bag"], result["status"]))
+    finally:
+        pool.close()
+        pool.join()
+    results.sort(key=lambda result: result["bag"])
+
+    summary = write_report(results, options.output)
+    print("\nEvaluated %d of %d bags in %.1f s (%d failed, %d with "
+          "collisions)." % (summary["evaluated"], summary["bags"],
+                            time.time() - start, summary["failed"],
+                            summary["with_collisions"]))
+    print("Report written to %s.csv and %s.json" % (options.output,
+                                                    options.output))
+
+
+if __name__ == "__main__":
+    main()
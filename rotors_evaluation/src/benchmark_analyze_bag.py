@@ -0,0 +1,98 @@
+#!/usr/bin/env python
+# This is needed such that int / int gives a float instead of an int
+from __future__ import division
+
+import optparse
+import os
+import tempfile
+import time
+
+import roslib
+roslib.load_manifest('rotors_evaluation')
+import rosbag
+import rospy
+from geometry_msgs.msg import PoseStamped, TwistStamped
+
+from rosbag_tools import analyze_bag
+
+
+__author__ = "Fadri Furrer, Michael Burri, Markus Achtelik"
+__copyright__ = ("Copyright 2015, Fadri Furrer & Michael Burri & "
+                 "Markus Achtelik, ASL, ETH Zurich, Switzerland")
+__credits__ = ["Fadri Furrer", "Michael Burri", "Markus Achtelik"]
+__license__ = "ASL 2.0"
+__version__ = "0.1"
+__maintainer__ = "Fadri Furrer"
+__email__ = "fadri.furrer@mavt.ethz.ch"
+__status__ = "Development"
+
+
+def write_bag(bag_path, messages, rate):
+    """Write a bag with a pose and a twist message per step at rate [Hz]."""
+    pose_msg = PoseStamped()
+    pose_msg.pose.orientation.w = 1.0
+    twist_msg = TwistStamped()
+    bag = rosbag.Bag(bag_path, 'w')
+    try:
+        for index in range(messages // 2):
+            stamp = rospy.Time.from_sec(1.0 + index / rate)
+            pose_msg.header.stamp = stamp
+            pose_msg.pose.position.x = 1.0 / (1.0 + index / rate)
+            pose_msg.pose.position.z = 1.0
+            twist_msg.header.stamp = stamp
+            twist_msg.twist.angular.z = 0.1
+            bag.write("/ground_truth/pose", pose_msg, stamp)
+            bag.write("/ground_truth/twist", twist_msg, stamp)
+    finally:
+        bag.close()
+
+
+def main():
+    parser = optparse.OptionParser(
+        "usage: %prog [--messages 1000000] [--bagfile /tmp/benchmark.bag]")
+    parser.add_option(
+        "-n", "--messages",
+        dest="messages",
+        default=1000000,
+        type="int",
+        help="Number of messages in the generated bag.")
+    parser.add_option(
+        "-b", "--bagfile",
+        dest="bagfile",
+        type="string",
+        help="Keep the generated bag at this path instead of a temporary "
+             "file.")
+    (options, args) = parser.parse_args()
+
+    rate = 1000.0  # [Hz]
+    bag_path = options.bagfile or tempfile.mkstemp(suffix=".bag")[1]
+    try:
+        start = time.time()
+        write_bag(bag_path, options.messages, rate)
+        print("Wrote %d messages in %.2f s" % (options.messages,
+                                                time.time() - start))
+
+        start = time.time()
+        ab = analyze_bag.AnalyzeBag(bag_path, False)
+        ab.add_pose_topic("/ground_truth/pose")
+        ab.add_twist_topic("/ground_truth/twist")
+        ab.extract_messages()
+        extract_duration = time.time() - start
+        print("Extracted %d messages in %.2f s (%.0f messages/s)" % (
+            options.messages, extract_duration,
+            options.messages / extract_duration))
+
+        start = time.time()
+        set_point = analyze_bag.create_set_point(0, 0, 1)
+        positions = ab.pos[0].slice(ab.pos[0].time[0], ab.pos[0].time[-1])
+        rms = analyze_bag.xyz_rms_error(set_point, positions)
+        settled = analyze_bag.settling_time(set_point, positions, 0.1, 3.0)
+        print("RMS error %.3f m, settling time %s s, computed in %.3f s" % (
+            rms, settled, time.time() - start))
+    finally:
+        if not options.bagfile:
+            os.remove(bag_path)
+
+
+if __name__ == "__main__":
+    main()
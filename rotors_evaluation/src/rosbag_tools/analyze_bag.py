@@ -21,38 +21,83 @@ __email__ = "fadri.furrer@mavt.ethz.ch"
 __status__ = "Development"
 
 
+# Initial number of rows allocated for a column.
+MIN_COLUMN_CAPACITY = 1024
+
+
 class BaseWithTime(object):
 
-    """Base Class for all objects with time and bag_time."""
+    """
+    Base Class for all objects with time and bag_time.
+
+    The per sample attributes (columns) are numpy arrays. They are views into
+    buffers that grow geometrically, such that appending a sample is amortized
+    constant time instead of copying the whole array like numpy.append does.
+    """
 
     def __init__(self):
-        self.time = numpy.array([])
-        self.bag_time = numpy.array([])
+        self._buffers = {}
+        self._views = {}
+        self.add_column('time')
+        self.add_column('bag_time', dtype=object)
+
+    def add_column(self, name, dtype=float):
+        """Add an empty column that is sliced and appended to by name."""
+        self.set_column(name, numpy.array([], dtype=dtype))
+
+    def set_column(self, name, values):
+        """Replace the content of the column name by the array values."""
+        self._buffers[name] = values
+        self._views[name] = values
+        self.__dict__[name] = values
+
+    def append_value(self, name, value):
+        """Append a value (or a row for 2D columns) to the column name."""
+        column = self.__dict__[name]
+        buf = self._buffers[name]
+        if column is not self._views[name]:
+            # The attribute was reassigned, e.g. by resample, continue from
+            # the new content.
+            buf = column
+        size = len(column)
+        if size == len(buf):
+            # An empty column takes the shape of its first row.
+            row_shape = numpy.shape(value) if size == 0 else buf.shape[1:]
+            grown = numpy.empty(
+                (max(2 * size, MIN_COLUMN_CAPACITY),) + row_shape,
+                dtype=buf.dtype)
+            if size > 0:
+                grown[:size] = buf
+            buf = grown
+        buf[size] = value
+        view = buf[:size + 1]
+        self._buffers[name] = buf
+        self._views[name] = view
+        self.__dict__[name] = view
 
     def append_times(self, msg_time, bag_time):
         """Append the msg_time and the bag_time."""
-        self.time = numpy.append(self.time, msg_time)
-        self.bag_time = numpy.append(self.bag_time, bag_time)
+        self.append_value('time', msg_time)
+        self.append_value('bag_time', bag_time)
 
     def slice(self, start_time, end_time):
         """Copy the object and slice it between start_time and end_time."""
         start_index = self.get_next_index(start_time)
         end_index = self.get_next_index(end_time)
-        copied_obj = copy.deepcopy(self)
-        for key in self.__dict__:
-            copied_obj.__setattr__(
-                key, copied_obj.__getattribute__(key)[start_index:end_index])
+        copied_obj = copy.copy(self)
+        copied_obj._buffers = {}
+        copied_obj._views = {}
+        for name in self._buffers:
+            copied_obj.set_column(
+                name, numpy.array(self.__dict__[name][start_index:end_index]))
         return copied_obj
 
     def get_next_index(self, time):
         """Get the index of the next value after time."""
-        try:
-            index = next(idx for idx, val in enumerate(self.time) if val > time)
-        except StopIteration:
-            index = len(self.time)
-        except Exception, e:
-            raise e
-        return index
+        later = numpy.flatnonzero(self.time > time)
+        if len(later) == 0:
+            return len(self.time)
+        return int(later[0])
 
 
 class ArrayWithTime(BaseWithTime):
@@ -60,19 +105,12 @@ class ArrayWithTime(BaseWithTime):
     """This class stores arrays or lists and its corresponding times."""
 
     def __init__(self):
-        self.data = numpy.array([])
         BaseWithTime.__init__(self)
+        self.add_column('data')
 
     def append_array(self, array):
         """Append an array or list to the data array."""
-        try:
-            self.data = numpy.append(self.data, [numpy.array(array)], axis=0)
-        except ValueError:
-            # If the array is empty create one with the first array in it.
-            if self.data.size == 0:
-                self.data = numpy.array([numpy.array(array)])
-            else:
-                raise ValueError
+        self.append_value('data', numpy.asarray(array, dtype=float))
 
 
 class QuatWithTime(BaseWithTime):
@@ -80,18 +118,18 @@ class QuatWithTime(BaseWithTime):
     """This class stores quaternions and its corresponding times."""
 
     def __init__(self):
-        self.w = numpy.array([])
-        self.x = numpy.array([])
-        self.y = numpy.array([])
-        self.z = numpy.array([])
         BaseWithTime.__init__(self)
+        self.add_column('w')
+        self.add_column('x')
+        self.add_column('y')
+        self.add_column('z')
 
     def append_quaternion(self, quaternion_msg):
         """Append the w, x, y, z components from a quaternion to its arrays."""
-        self.w = numpy.append(self.w, quaternion_msg.w)
-        self.x = numpy.append(self.x, quaternion_msg.x)
-        self.y = numpy.append(self.y, quaternion_msg.y)
-        self.z = numpy.append(self.z, quaternion_msg.z)
+        self.append_value('w', quaternion_msg.w)
+        self.append_value('x', quaternion_msg.x)
+        self.append_value('y', quaternion_msg.y)
+        self.append_value('z', quaternion_msg.z)
 
 
 class XYZWithTime(BaseWithTime):
@@ -99,16 +137,16 @@ class XYZWithTime(BaseWithTime):
     """This class stores x,y,z and its corresponding times."""
 
     def __init__(self):
-        self.x = numpy.array([])
-        self.y = numpy.array([])
-        self.z = numpy.array([])
         BaseWithTime.__init__(self)
+        self.add_column('x')
+        self.add_column('y')
+        self.add_column('z')
 
     def append_point(self, point_msg):
         """Append the x, y, z components from a point to its arrays."""
-        self.x = numpy.append(self.x, point_msg.x)
-        self.y = numpy.append(self.y, point_msg.y)
-        self.z = numpy.append(self.z, point_msg.z)
+        self.append_value('x', point_msg.x)
+        self.append_value('y', point_msg.y)
+        self.append_value('z', point_msg.z)
 
     def resample(self, sampling_times):
 
@@ -133,24 +171,24 @@ class WrenchWithTime(BaseWithTime):
     """
 
     def __init__(self):
-        self.force_x = numpy.array([])
-        self.force_y = numpy.array([])
-        self.force_z = numpy.array([])
-        self.torque_x = numpy.array([])
-        self.torque_y = numpy.array([])
-        self.torque_z = numpy.array([])
         BaseWithTime.__init__(self)
+        self.add_column('force_x')
+        self.add_column('force_y')
+        self.add_column('force_z')
+        self.add_column('torque_x')
+        self.add_column('torque_y')
+        self.add_column('torque_z')
 
     def append_wrench(self, wrench_msg):
         """
         Append the x, y, z components for force and torque to their arrays.
         """
-        self.force_x = numpy.append(self.force_x, wrench_msg.wrench.force.x)
-        self.force_y = numpy.append(self.force_y, wrench_msg.wrench.force.y)
-        self.force_z = numpy.append(self.force_z, wrench_msg.wrench.force.z)
-        self.torque_x = numpy.append(self.torque_x, wrench_msg.wrench.torque.x)
-        self.torque_y = numpy.append(self.torque_y, wrench_msg.wrench.torque.y)
-        self.torque_z = numpy.append(self.torque_z, wrench_msg.wrench.torque.z)
+        self.append_value('force_x', wrench_msg.wrench.force.x)
+        self.append_value('force_y', wrench_msg.wrench.force.y)
+        self.append_value('force_z', wrench_msg.wrench.force.z)
+        self.append_value('torque_x', wrench_msg.wrench.torque.x)
+        self.append_value('torque_y', wrench_msg.wrench.torque.y)
+        self.append_value('torque_z', wrench_msg.wrench.torque.z)
 
 
 class WaypointWithTime(XYZWithTime):
@@ -158,8 +196,8 @@ class WaypointWithTime(XYZWithTime):
     """This class stores waypoints or and its corresponding times."""
 
     def __init__(self):
-        self.yaw = numpy.array([])
         XYZWithTime.__init__(self)
+        self.add_column('yaw')
         self.empty = True
 
     def append_waypoint(self, waypoint_msg, msg_time, bag_time):
@@ -181,7 +219,7 @@ class WaypointWithTime(XYZWithTime):
         # Append new waypoint.
         if (different_waypoint):
             self.append_point(point_msg)
-            self.yaw = numpy.append(self.yaw, yaw)
+            self.append_value('yaw', yaw)
             self.append_times(msg_time, bag_time)
 
 
@@ -190,10 +228,10 @@ class RPYWithTime(BaseWithTime):
     """This class stores roll, pitch, yaw and its corresponding times."""
 
     def __init__(self):
-        self.roll = numpy.array([])
-        self.pitch = numpy.array([])
-        self.yaw = numpy.array([])
         BaseWithTime.__init__(self)
+        self.add_column('roll')
+        self.add_column('pitch')
+        self.add_column('yaw')
 
     def append_quaternion(self, quaternion_msg):
         """Append a roll, pitch, and yaw to each array from a quaternion."""
@@ -203,9 +241,9 @@ class RPYWithTime(BaseWithTime):
             quaternion_msg.z,
             quaternion_msg.w)
         euler = tf.transformations.euler_from_quaternion(quaternion)
-        self.roll = numpy.append(self.roll, euler[0] * 180 / math.pi)
-        self.pitch = numpy.append(self.pitch, euler[1] * 180 / math.pi)
-        self.yaw = numpy.append(self.yaw, euler[2] * 180 / math.pi)
+        self.append_value('roll', euler[0] * 180 / math.pi)
+        self.append_value('pitch', euler[1] * 180 / math.pi)
+        self.append_value('yaw', euler[2] * 180 / math.pi)
 
 
 class AnalyzeBag(object):
@@ -276,15 +314,25 @@ class AnalyzeBag(object):
 
     def extract_messages(self):
         """Run through the bag file and assign the msgs to its attributes."""
+        # Look up the extract functions once per topic instead of trying all
+        # of them on every message.
+        extractors = {}
+        for topics, extract in [
+                (self.pose_topics, self.extract_pose_topics),
+                (self.imu_topics, self.extract_imu_topics),
+                (self.twist_topics, self.extract_twist_topics),
+                (self.motor_velocity_topics,
+                 self.extract_motor_velocity_topics),
+                (self.waypoint_topics, self.extract_waypoint_topics),
+                (self.wrench_topics, self.extract_wrench_topics)]:
+            for topic in set(topics):
+                extractors.setdefault(topic, []).append(extract)
+
         for topic, msg, bag_time in self.bag.read_messages(topics=self.topics):
             if self.bag_time_start is None:
                 self.bag_time_start = bag_time
-            self.extract_pose_topics(topic, msg, bag_time)
-            self.extract_imu_topics(topic, msg, bag_time)
-            self.extract_twist_topics(topic, msg, bag_time)
-            self.extract_motor_velocity_topics(topic, msg, bag_time)
-            self.extract_waypoint_topics(topic, msg, bag_time)
-            self.extract_wrench_topics(topic, msg, bag_time)
+            for extract in extractors[topic]:
+                extract(topic, msg, bag_time)
             self.bag_time_end = bag_time
 
     def extract_pose_topics(self, topic, msg, bag_time):
@@ -325,10 +373,10 @@ class AnalyzeBag(object):
         msg_time = msg.header.stamp.to_sec()
         for index, imu_topic in enumerate(self.imu_topics):
             if topic == imu_topic:
-                self.acc[index].x.append(msg.linear_acceleration.x)
-                self.acc[index].y.append(msg.linear_acceleration.y)
-                self.acc[index].z.append(msg.linear_acceleration.z)
+                self.acc[index].append_point(msg.linear_acceleration)
                 self.acc[index].append_times(msg_time, bag_time)
+                self.ang_vel[index].append_point(msg.angular_velocity)
+                self.ang_vel[index].append_times(msg_time, bag_time)
 
     def extract_twist_topics(self, topic, msg, bag_time):
         """Append the twist topic msg content to the pqr attributes."""
@@ -623,10 +671,10 @@ class AnalyzeBag(object):
         collision_times = []
 
         for collision in self.wrench:
-            for t in collision.time:
-                if t >= (start_time or 0) and t <= (end_time or
-                                                    max(collision.time)):
-                    collision_times.append(t)
+            in_period = collision.time >= (start_time or 0)
+            if end_time:
+                in_period &= collision.time <= end_time
+            collision_times.extend(collision.time[in_period].tolist())
         return collision_times
 
 
@@ -635,6 +683,23 @@ def compare_two_xyz(xyz_one, xyz_two):
     pass
 
 
+def xyz_error_radius(set_point, input_series):
+    """
+    Calculate the distances between a set_point and the points in input_series.
+
+    Args:
+        set_point: XYZWithTime of the reference point
+        input_series (list): XYZWithTime of the points that should be evaluated
+
+    Returns:
+        error_radius: Array of the distance of every point to the set_point
+    """
+    x_error = input_series.x - set_point.x[0]
+    y_error = input_series.y - set_point.y[0]
+    z_error = input_series.z - set_point.z[0]
+    return numpy.sqrt(x_error ** 2 + y_error ** 2 + z_error ** 2)
+
+
 def xyz_rms_error(set_point, input_series):
     """
     Calculate the RMS error between a set_point and the points in input_series.
@@ -646,16 +711,10 @@ def xyz_rms_error(set_point, input_series):
     Returns:
         rms: Float of the RMS Error of the XYZWithTime input_series
     """
-    sum_of_squares = 0.0
-    elems = len(input_series.x)
-    for index in range(elems):
-        x_error = (input_series.x[index] - set_point.x)
-        y_error = (input_series.y[index] - set_point.y)
-        z_error = (input_series.z[index] - set_point.z)
-        sum_of_squares += (1.0 / elems *
-                           (x_error ** 2 + y_error ** 2 + z_error ** 2))
-    rms = sum_of_squares ** 0.5
-    return rms
+    if len(input_series.x) == 0:
+        return 0.0
+    error_radius = xyz_error_radius(set_point, input_series)
+    return float(numpy.sqrt(numpy.mean(error_radius ** 2)))
 
 
 def settling_time(set_point, input_series, bounding_radius, min_time):
@@ -671,25 +730,22 @@ def settling_time(set_point, input_series, bounding_radius, min_time):
     Returns:
         settling_time: Float of the time for input_series to be settled
     """
-    bounded_time = False
-    elems = len(input_series.x)
-    for index in range(elems):
-        current_time = input_series.time[index]
-        x_error = (input_series.x[index] - set_point.x)
-        y_error = (input_series.y[index] - set_point.y)
-        z_error = (input_series.z[index] - set_point.z)
-        error_radius = (x_error ** 2 + y_error ** 2 + z_error ** 2) ** 0.5
-        if error_radius <= bounding_radius and not bounded_time:
-            bounded_time = current_time
-        elif (error_radius <= bounding_radius and bounded_time and
-              current_time - bounded_time >= min_time):
-            return bounded_time - input_series.time[0]
-        elif (not bounded_time or error_radius <= bounding_radius and
-              bounded_time):
-            continue
-        else:
-            bounded_time = False
-    return None
+    bounded = (xyz_error_radius(set_point, input_series) <= bounding_radius)
+    if not bounded.any():
+        return None
+    # Every sample inside the sphere belongs to a run of consecutive bounded
+    # samples, which starts at the first sample of the run.
+    run_starts = bounded.copy()
+    run_starts[1:] &= ~bounded[:-1]
+    run_start_indices = numpy.flatnonzero(run_starts)
+    run_start_times = input_series.time[
+        run_start_indices[numpy.cumsum(run_starts) - 1]]
+    settled = (bounded & ~run_starts &
+               (input_series.time - run_start_times >= min_time))
+    settled_indices = numpy.flatnonzero(settled)
+    if len(settled_indices) == 0:
+        return None
+    return run_start_times[settled_indices[0]] - input_series.time[0]
 
 
 def work(input_series, work_constant):
@@ -703,16 +759,11 @@ def work(input_series, work_constant):
     Returns:
         total_work: Float of the work done in input_series
     """
-    total_work = 0
-
-    elems = len(input_series.time)
-    for index in range(elems - 1):
-        current_time = input_series.time[index]
-        next_time = input_series.time[index + 1]
-        delta_time = next_time - current_time
-        for value in input_series.data[index]:
-            total_work += abs(value) ** 3 * work_constant * delta_time
-    return total_work
+    if len(input_series.time) < 2:
+        return 0
+    delta_times = numpy.diff(input_series.time)
+    power = numpy.abs(input_series.data[:-1]) ** 3 * work_constant
+    return float(numpy.sum(power * delta_times[:, numpy.newaxis]))
 
 
 def get_errors_pos_only(xyz_one, quat_one, xyz_two, restart_distance,
@@ -314,6 +314,11 @@ def no_collisions_occured(analyze_bag, start_time, end_time):
     except:
         raise
         collisions = []
+    return print_collisions(collisions)
+
+
+def print_collisions(collisions):
+    """Print the collision times, returns True if there are none."""
     print("\n")
     if len(collisions):
         t_last = -1.0
@@ -0,0 +1,168 @@
+"""Waypoint evaluation shared by waypoints_eval.py and batch_eval.py."""
+
+from __future__ import division
+
+from rosbag_tools import analyze_bag, helpers
+
+
+__author__ = "Fadri Furrer, Michael Burri, Markus Achtelik"
+__copyright__ = ("Copyright 2015, Fadri Furrer & Michael Burri & "
+                 "Markus Achtelik, ASL, ETH Zurich, Switzerland")
+__credits__ = ["Fadri Furrer", "Michael Burri", "Markus Achtelik"]
+__license__ = "ASL 2.0"
+__version__ = "0.1"
+__maintainer__ = "Fadri Furrer"
+__email__ = "fadri.furrer@mavt.ethz.ch"
+__status__ = "Development"
+
+
+settling_time_max = 10.0  # [s]
+position_error_max = 0.2  # [m]
+angular_velocity_error_max = 0.2  # [rad/s]
+
+# Key of the average, key of the score, maximum value, scores, printed name
+# and unit of each scored quantity.
+scorings = [
+    ("average_settling_time", "settling_time_score", settling_time_max,
+     [0.0, 1.5, 3.5, 5.0], "settling time", "s"),
+    ("average_position_rms_error", "position_rms_error_score",
+     position_error_max, [0.0, 1.5, 3.5, 5.0], "position RMS error", "m"),
+    ("average_angular_velocity_rms_error", "angular_velocity_rms_error_score",
+     angular_velocity_error_max, [0.0, 1.0, 2.0, 3.0],
+     "angular velocity RMS error", "rad/s")]
+
+
+def evaluate_waypoints(ab, end_time, rms_calc_time, settling_radius,
+                       min_settled_time, first_waypoint_delay,
+                       print_output=False):
+    """
+    Evaluate the settling time and the RMS errors after every waypoint of a
+    bag, and score their averages.
+
+    The first waypoint is not scored, as the MAV is most likely still in
+    collision (with the ground) when it gets published. Its evaluation starts
+    first_waypoint_delay seconds after it. A waypoint where the MAV does not
+    settle within settling_time_max counts with 101 % of the maximum values.
+
+    Args:
+        ab: AnalyzeBag with the pose, twist, waypoint and wrench topics
+            extracted.
+        end_time: Float of the end time of the evaluated data.
+        rms_calc_time: Float of the length of the RMS evaluation period.
+        settling_radius: Float of the radius of the ball around the waypoint
+                         in which the MAV has to stay to be settled.
+        min_settled_time: Float of the time the MAV has to stay in the ball.
+        first_waypoint_delay: Float of the delay of the evaluation of the
+                              first waypoint.
+        print_output: Print the evaluation of every waypoint.
+    Returns:
+        result: Dictionary with the number of waypoints, the averages, the
+                collision times and the scores (None if nothing was
+                evaluated or if the MAV collided), and under "evaluations"
+                the begin time, RMS evaluation end time, settling time and
+                set point of every waypoint, e.g. for plotting.
+    """
+    waypoints = ab.waypoint[0]
+    bag_time_start = ab.bag_time_start.to_sec()
+    bag_time_end = ab.bag_time_end.to_sec()
+    set_point_pqr = analyze_bag.create_set_point(0, 0, 0)
+    list_settling_time = []
+    list_pos_rms = []
+    list_pqr_rms = []
+    evaluations = []
+    rms_evaluation_end_time = None
+
+    for index in range(len(waypoints.x)):
+        [begin_time, waypoint_end_time] = helpers.get_evaluation_period(
+            waypoints, index, bag_time_start, bag_time_end, end_time)
+        if print_output:
+            print("\n")
+            print("[Waypoint %d]: [%.3f, %.3f, %.3f, %.3f] at time %.3f s" % (
+                index, waypoints.x[index], waypoints.y[index],
+                waypoints.z[index], waypoints.yaw[index], begin_time))
+        set_point_pos = analyze_bag.create_set_point(
+            waypoints.x[index], waypoints.y[index], waypoints.z[index])
+
+        if index == 0:
+            begin_time += first_waypoint_delay
+            settling_time = None
+            rms_evaluation_start_time = begin_time
+            if print_output:
+                print("Setting the first evaluation start time %f s after the "
+                      "first waypoint was published.\n" % first_waypoint_delay)
+                print("[Waypoint %d]: Settling time for this waypoint not\n"
+                      "              considered." % index)
+        else:
+            # Get the time at which the MAV stayed for at least
+            # min_settled_time seconds within a ball of settling_radius meters
+            # around set_point_pos.
+            positions = ab.pos[0].slice(begin_time, waypoint_end_time)
+            settling_time = helpers.get_settling_time(
+                positions, set_point_pos, settling_radius, min_settled_time,
+                index, print_output=print_output)
+            if settling_time is None or settling_time >= settling_time_max:
+                if print_output:
+                    print("[Waypoint %d]: System didn't settle  in %f seconds "
+                          "-- inserting 101 %% of defined maximum values."
+                          % (index, settling_time_max))
+                list_settling_time.append(settling_time_max * 1.01)
+                list_pos_rms.append(position_error_max * 1.01)
+                list_pqr_rms.append(angular_velocity_error_max * 1.01)
+                evaluations.append({
+                    "begin_time": begin_time,
+                    "rms_evaluation_end_time": waypoint_end_time,
+                    "settling_time": settling_time,
+                    "set_point_pos": set_point_pos})
+                continue
+            rms_evaluation_start_time = begin_time + settling_time
+
+        rms_evaluation_end_time = min(
+            rms_evaluation_start_time + rms_calc_time, waypoint_end_time)
+        pos_rms_error = helpers.get_rms_position_error(
+            ab.pos[0].slice(rms_evaluation_start_time,
+                            rms_evaluation_end_time),
+            set_point_pos, index, print_output=print_output)
+        pqr_rms_error = helpers.get_rms_angular_velocity_error(
+            ab.pqr[0].slice(rms_evaluation_start_time,
+                            rms_evaluation_end_time),
+            set_point_pqr, index, print_output=print_output)
+        if index > 0:
+            list_settling_time.append(settling_time)
+            list_pos_rms.append(pos_rms_error)
+            list_pqr_rms.append(pqr_rms_error)
+        evaluations.append({
+            "begin_time": begin_time,
+            "rms_evaluation_end_time": rms_evaluation_end_time,
+            "settling_time": settling_time,
+            "set_point_pos": set_point_pos})
+
+    result = {
+        "waypoints": len(waypoints.x),
+        "average_settling_time": helpers.calculate_average(list_settling_time),
+        "average_position_rms_error": helpers.calculate_average(list_pos_rms),
+        "average_angular_velocity_rms_error": helpers.calculate_average(
+            list_pqr_rms),
+        "evaluations": evaluations}
+
+    start_collision_time = (waypoints.bag_time[0].to_sec() +
+                            first_waypoint_delay)
+    result["collision_times"] = ab.get_collisions(start_collision_time,
+                                                  rms_evaluation_end_time)
+    result["collisions"] = len(result["collision_times"])
+    for average_key, score_key, max_value, scores, _, _ in scorings:
+        if result[average_key] is None or result["collisions"] > 0:
+            result[score_key] = None
+        else:
+            result[score_key] = helpers.get_score(result[average_key],
+                                                  max_value, scores)
+    return result
+
+
+def print_result(result):
+    """Print the collisions and the scoring of evaluate_waypoints()."""
+    if not helpers.print_collisions(result["collision_times"]):
+        return
+    print("\n")
+    for average_key, _, max_value, scores, value_type, unit in scorings:
+        helpers.print_scoring(result[average_key], max_value, value_type,
+                              unit, scores)
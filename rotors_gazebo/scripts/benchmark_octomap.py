@@ -0,0 +1,155 @@
+#!/usr/bin/env python
+"""
+Wall time scaling of the octomap generation of the octomap plugin.
+
+Calls the octomap service of a running simulation (a world that loads
+librotors_gazebo_octomap_plugin.so, e.g. powerplant.world) once per thread
+count and reports the wall time, the speedup and the parallel efficiency
+relative to the first thread count (which should be 1). The plugin needs
+<cacheSize>0</cacheSize>, otherwise repeated requests are served from its
+cache, and <occupancyBackend>collision</occupancyBackend>: the rays of the
+default backend are cast from a single thread, only its flood fill scales.
+
+e.g.:
+  rosrun rotors_gazebo benchmark_octomap.py --lengths 100,100,20 \\
+      --leaf_size 0.1 --threads 1,2,4,8 -o octomap_scaling.json
+"""
+
+from __future__ import division, print_function
+
+import json
+import multiprocessing
+import optparse
+import platform
+import sys
+import time
+
+import rospy
+from geometry_msgs.msg import Point
+from rotors_comm.srv import Octomap, OctomapRequest
+
+
+__author__ = "Fadri Furrer, Michael Burri, Markus Achtelik"
+__copyright__ = ("Copyright 2015, Fadri Furrer & Michael Burri & "
+                 "Markus Achtelik, ASL, ETH Zurich, Switzerland")
+__credits__ = ["Fadri Furrer", "Michael Burri", "Markus Achtelik"]
+__license__ = "ASL 2.0"
+__version__ = "0.1"
+__maintainer__ = "Fadri Furrer"
+__email__ = "fadri.furrer@mavt.ethz.ch"
+__status__ = "Development"
+
+
+def parse_point(value):
+    """Parse 'x,y,z' into a geometry_msgs/Point."""
+    x, y, z = [float(element) for element in value.split(",")]
+    return Point(x, y, z)
+
+
+def default_thread_counts():
+    """Powers of two up to the number of cores, and the number of cores."""
+    cores = multiprocessing.cpu_count()
+    counts = []
+    count = 1
+    while count < cores:
+        counts.append(count)
+        count *= 2
+    counts.append(cores)
+    return counts
+
+
+def call_octomap_service(get_octomap, request):
+    """Call the service, returns the wall time [s] and the map size [B]."""
+    start = time.time()
+    response = get_octomap(request)
+    return time.time() - start, len(response.map.data)
+
+
+def main():
+    parser = optparse.OptionParser(__doc__.strip())
+    parser.add_option(
+        "--service",
+        dest="service",
+        default="/world/get_octomap",
+        type="string",
+        help="The octomap service of the plugin.")
+    parser.add_option(
+        "--origin",
+        dest="origin",
+        default="0,0,5",
+        type="string",
+        help="Center of the bounding box, x,y,z [m].")
+    parser.add_option(
+        "--lengths",
+        dest="lengths",
+        default="20,20,10",
+        type="string",
+        help="Side lengths of the bounding box, x,y,z [m].")
+    parser.add_option(
+        "--leaf_size",
+        dest="leaf_size",
+        default=0.1,
+        type="float",
+        help="Leaf size of the octomap [m].")
+    parser.add_option(
+        "--threads",
+        dest="threads",
+        default=",".join(str(count) for count in default_thread_counts()),
+        type="string",
+        help="Comma separated thread counts.")
+    parser.add_option(
+        "-r", "--repetitions",
+        dest="repetitions",
+        default=1,
+        type="int",
+        help="Builds per thread count, the fastest one is reported.")
+    parser.add_option(
+        "-o", "--output",
+        dest="output",
+        type="string",
+        help="Write the results to this JSON file.")
+    (options, args) = parser.parse_args()
+
+    rospy.init_node("benchmark_octomap", anonymous=True)
+    rospy.wait_for_service(options.service)
+    get_octomap = rospy.ServiceProxy(options.service, Octomap)
+
+    request = OctomapRequest()
+    request.bounding_box_origin = parse_point(options.origin)
+    request.bounding_box_lengths = parse_point(options.lengths)
+    request.leaf_size = options.leaf_size
+    request.publish_octomap = False
+
+    results = {"host": platform.node(),
+               "cpu_count": multiprocessing.cpu_count(),
+               "date": time.strftime("%Y-%m-%dT%H:%M:%S"),
+               "origin": options.origin, "lengths": options.lengths,
+               "leaf_size": options.leaf_size, "runs": []}
+    print("%8s %12s %9s %11s" % ("threads", "wall [s]", "speedup",
+                                 "efficiency"))
+    for num_threads in [int(count) for count in options.threads.split(",")]:
+        request.num_threads = num_threads
+        durations = []
+        for repetition in range(options.repetitions):
+            duration, map_size = call_octomap_service(get_octomap, request)
+            durations.append(duration)
+        run = {"threads": num_threads, "wall_time": min(durations),
+               "map_size": map_size}
+        if not results["runs"]:
+            reference = run["wall_time"] * num_threads
+        run["speedup"] = reference / run["wall_time"]
+        run["efficiency"] = run["speedup"] / num_threads
+        results["runs"].append(run)
+        print("%8d %12.2f %9.2f %10.0f%%" % (
+            num_threads, run["wall_time"], run["speedup"],
+            100 * run["efficiency"]))
+
+    if options.output:
+        with open(options.output, "w") as output:
+            json.dump(results, output, indent=2, sort_keys=True)
+        print("Results written to %s" % options.output)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
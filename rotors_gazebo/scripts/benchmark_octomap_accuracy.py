@@ -0,0 +1,548 @@
+#!/usr/bin/env python
+"""
+Build time, memory and accuracy of the octomap plugin on generated worlds.
+
+Generates worlds of static primitives from a seeded random generator:
+  random_boxes  boxes of random size and yaw standing on the ground
+  forest        many thin vertical cylinders
+  building      a floor plan of rooms with doors and walls thinner than a
+                leaf
+Every world is run in its own headless gzserver for every occupancy
+backend. The octomap service is called once for the whole world and the
+wall time of the call and the memory of gzserver are recorded. The returned
+octomap is compared cell by cell to the analytic occupancy of the
+primitives: a cell is occupied if its cube overlaps a primitive or the
+surface of the ground plane, touching counts, which is the rule of the
+collision backend. The plane has no inside for the plugin, the cells below
+it are flooded as free from the bottom of the bounding box.
+Reports precision, recall and intersection over union of the occupied
+cells as JSON.
+
+e.g.:
+  rosrun rotors_gazebo benchmark_octomap_accuracy.py -o accuracy.json
+  rosrun rotors_gazebo benchmark_octomap_accuracy.py --worlds building \\
+      --backends rays,collision --leaf_size 0.05 --keep_files
+"""
+
+from __future__ import division, print_function
+
+import json
+import math
+import optparse
+import os
+import platform
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+import numpy
+import rosgraph
+import rospy
+from geometry_msgs.msg import Point
+from rotors_comm.srv import Octomap, OctomapRequest
+
+from run_benchmarks import (LAUNCH_HEADER, find_gzserver_pid, read_memory,
+                            stop_process)
+
+
+__author__ = "Fadri Furrer, Michael Burri, Markus Achtelik"
+__copyright__ = ("Copyright 2015, Fadri Furrer & Michael Burri & "
+                 "Markus Achtelik, ASL, ETH Zurich, Switzerland")
+__credits__ = ["Fadri Furrer", "Michael Burri", "Markus Achtelik"]
+__license__ = "ASL 2.0"
+__version__ = "0.1"
+__maintainer__ = "Fadri Furrer"
+__email__ = "fadri.furrer@mavt.ethz.ch"
+__status__ = "Development"
+
+
+WORLDS = ["random_boxes", "forest", "building"]
+BACKENDS = ["rays", "collision"]
+
+SERVICE_NAME = "/world/get_octomap"
+
+WORLD_TEMPLATE = """<?xml version="1.0" ?>
+<sdf version="1.4">
+  <world name="default">
+    <plugin name="gazebo_octomap" filename="librotors_gazebo_octomap_plugin.so">
+      <octomapPubTopic>world/octomap</octomapPubTopic>
+      <octomapServiceName>world/get_octomap</octomapServiceName>
+      <occupancyBackend>{backend}</occupancyBackend>
+      <cacheSize>0</cacheSize>
+    </plugin>
+    <physics type="ode">
+      <max_step_size>0.01</max_step_size>
+      <real_time_factor>1</real_time_factor>
+      <real_time_update_rate>100</real_time_update_rate>
+      <gravity>0 0 -9.8</gravity>
+    </physics>
+    <model name="ground_plane">
+      <static>true</static>
+      <link name="link">
+        <collision name="collision">
+          <geometry>
+            <plane><normal>0 0 1</normal><size>200 200</size></plane>
+          </geometry>
+        </collision>
+      </link>
+    </model>
+{models}  </world>
+</sdf>
+"""
+
+MODEL_TEMPLATE = """    <model name="{name}">
+      <static>true</static>
+      <pose>{x} {y} {z} 0 0 {yaw}</pose>
+      <link name="link">
+        <collision name="collision">
+          <geometry>{geometry}</geometry>
+        </collision>
+        <visual name="visual">
+          <geometry>{geometry}</geometry>
+        </visual>
+      </link>
+    </model>
+"""
+
+# Side length of the square area the primitives are placed in [m].
+AREA_SIZE = 30.0
+# Height of the bounding box above the ground [m].
+BOX_HEIGHT = 10.0
+
+
+def box(center, size, yaw=0.0):
+    """A box standing upright, rotated by yaw about z."""
+    return {"type": "box", "center": list(center), "size": list(size),
+            "yaw": yaw}
+
+
+def cylinder(center, radius, length):
+    """A cylinder with its axis along z."""
+    return {"type": "cylinder", "center": list(center), "radius": radius,
+            "length": length}
+
+
+def generate_random_boxes(generator, count=60):
+    """Boxes of 0.3 to 4 m side length on the ground, random yaw."""
+    primitives = []
+    for index in range(count):
+        size = [generator.uniform(0.3, 4.0), generator.uniform(0.3, 4.0),
+                generator.uniform(0.3, 6.0)]
+        center = [generator.uniform(-AREA_SIZE / 2, AREA_SIZE / 2),
+                  generator.uniform(-AREA_SIZE / 2, AREA_SIZE / 2),
+                  size[2] / 2]
+        primitives.append(box(center, size,
+                              generator.uniform(-math.pi, math.pi)))
+    return primitives
+
+
+def generate_forest(generator, count=400):
+    """Trunks of 5 to 30 cm radius, most thinner than a few leaves."""
+    primitives = []
+    for index in range(count):
+        radius = generator.uniform(0.05, 0.3)
+        length = generator.uniform(2.0, 8.0)
+        center = [generator.uniform(-AREA_SIZE / 2, AREA_SIZE / 2),
+                  generator.uniform(-AREA_SIZE / 2, AREA_SIZE / 2),
+                  length / 2]
+        primitives.append(cylinder(center, radius, length))
+    return primitives
+
+
+def generate_building(generator, rooms_x=5, rooms_y=4, room_size=4.0,
+                      wall_thickness=0.04, wall_height=3.0, door_width=1.0):
+    """A grid of rooms without a roof, every wall has a door at a random
+    position. The walls are thinner than the default leaf size."""
+    primitives = []
+    size_x = rooms_x * room_size
+    size_y = rooms_y * room_size
+    z = wall_height / 2
+
+    def wall(start, end, fixed, along_x):
+        """Wall from start to end at fixed, split by a door."""
+        door = generator.uniform(start + 0.2, end - door_width - 0.2)
+        for begin, finish in [(start, door), (door + door_width, end)]:
+            length = finish - begin
+            middle = (begin + finish) / 2
+            if along_x:
+                primitives.append(box([middle, fixed, z],
+                                      [length, wall_thickness, wall_height]))
+            else:
+                primitives.append(box([fixed, middle, z],
+                                      [wall_thickness, length, wall_height]))
+
+    for row in range(rooms_y + 1):
+        y = row * room_size - size_y / 2
+        for column in range(rooms_x):
+            x = column * room_size - size_x / 2
+            wall(x, x + room_size, y, True)
+    for column in range(rooms_x + 1):
+        x = column * room_size - size_x / 2
+        for row in range(rooms_y):
+            y = row * room_size - size_y / 2
+            wall(y, y + room_size, x, False)
+    return primitives
+
+
+GENERATORS = {"random_boxes": generate_random_boxes,
+              "forest": generate_forest,
+              "building": generate_building}
+
+
+def create_world_file(primitives, backend):
+    """Return the SDF world of the primitives."""
+    models = ""
+    for index, primitive in enumerate(primitives):
+        if primitive["type"] == "box":
+            geometry = "<box><size>%f %f %f</size></box>" % tuple(
+                primitive["size"])
+            yaw = primitive["yaw"]
+        else:
+            geometry = ("<cylinder><radius>%f</radius>"
+                        "<length>%f</length></cylinder>" % (
+                            primitive["radius"], primitive["length"]))
+            yaw = 0.0
+        x, y, z = primitive["center"]
+        models += MODEL_TEMPLATE.format(
+            name="%s_%d" % (primitive["type"], index), x=x, y=y, z=z,
+            yaw=yaw, geometry=geometry)
+    return WORLD_TEMPLATE.format(backend=backend, models=models)
+
+
+def create_request(leaf_size):
+    """Request of the octomap of the whole area, from just below the ground.
+
+    The lower corner is a multiple of the leaf size, so cell centers are not
+    on octree key boundaries.
+    """
+    margin = math.ceil(1.0 / leaf_size) * leaf_size
+    half_size = math.ceil(AREA_SIZE / 2 / leaf_size) * leaf_size + margin
+    bottom = -2 * leaf_size
+    top = math.ceil(BOX_HEIGHT / leaf_size) * leaf_size
+    request = OctomapRequest()
+    request.bounding_box_origin = Point(0.0, 0.0, (bottom + top) / 2)
+    request.bounding_box_lengths = Point(2 * half_size, 2 * half_size,
+                                         top - bottom)
+    request.leaf_size = leaf_size
+    request.publish_octomap = False
+    return request
+
+
+def cell_grid(request):
+    """Cell centers along each axis, the same cells the plugin builds."""
+    epsilon = 0.00001
+    leaf_size = request.leaf_size
+    axes = []
+    for origin, length in [
+            (request.bounding_box_origin.x, request.bounding_box_lengths.x),
+            (request.bounding_box_origin.y, request.bounding_box_lengths.y),
+            (request.bounding_box_origin.z, request.bounding_box_lengths.z)]:
+        length += epsilon
+        first = leaf_size / 2 + origin - length / 2
+        count = max(0, int(math.ceil((length - leaf_size / 2) / leaf_size)))
+        axes.append(first + leaf_size * numpy.arange(count))
+    return axes
+
+
+def ground_truth(primitives, axes, leaf_size):
+    """Occupancy of every cell, indexed [x, y, z]."""
+    half = leaf_size / 2
+    xs, ys, zs = axes
+    occupied = numpy.zeros((len(xs), len(ys), len(zs)), dtype=bool)
+    # Only the cells that the ground plane (through the origin, normal along
+    # z) passes through, like both backends of the plugin.
+    occupied[:, :, numpy.abs(zs) <= half] = True
+
+    def cell_range(values, low, high):
+        """Slice of the cells that may overlap [low, high]."""
+        begin = numpy.searchsorted(values, low - half, side="left")
+        end = numpy.searchsorted(values, high + half, side="right")
+        return slice(begin, end)
+
+    for primitive in primitives:
+        cx, cy, cz = primitive["center"]
+        if primitive["type"] == "box":
+            a, b, c = [size / 2 for size in primitive["size"]]
+            cos_yaw = math.cos(primitive["yaw"])
+            sin_yaw = math.sin(primitive["yaw"])
+            extent_x = a * abs(cos_yaw) + b * abs(sin_yaw)
+            extent_y = a * abs(sin_yaw) + b * abs(cos_yaw)
+            extent_z = c
+        else:
+            extent_x = extent_y = primitive["radius"]
+            extent_z = primitive["length"] / 2
+        range_x = cell_range(xs, cx - extent_x, cx + extent_x)
+        range_y = cell_range(ys, cy - extent_y, cy + extent_y)
+        range_z = cell_range(zs, cz - extent_z, cz + extent_z)
+        dx = xs[range_x][:, None] - cx
+        dy = ys[range_y][None, :] - cy
+        if primitive["type"] == "box":
+            # Separating axes of the cell and the box in the xy plane, z is
+            # already covered by the cell range.
+            cell_extent = half * (abs(cos_yaw) + abs(sin_yaw))
+            overlaps = ((numpy.abs(dx) <= extent_x + half) &
+                        (numpy.abs(dy) <= extent_y + half) &
+                        (numpy.abs(dx * cos_yaw + dy * sin_yaw) <=
+                         a + cell_extent) &
+                        (numpy.abs(dy * cos_yaw - dx * sin_yaw) <=
+                         b + cell_extent))
+        else:
+            gap_x = numpy.maximum(numpy.abs(dx) - half, 0.0)
+            gap_y = numpy.maximum(numpy.abs(dy) - half, 0.0)
+            overlaps = gap_x ** 2 + gap_y ** 2 <= primitive["radius"] ** 2
+        occupied[range_x, range_y, range_z] |= overlaps[:, :, None]
+    return occupied
+
+
+# Node states of the binary octomap format, two bits per child.
+UNKNOWN, FREE, OCCUPIED, INNER = 0, 1, 2, 3
+TREE_DEPTH = 16
+TREE_MAX_VAL = 1 << (TREE_DEPTH - 1)
+
+
+def decode_octomap(data, resolution, axes):
+    """Decode a binary octomap into the states of the cells, indexed
+    [x, y, z]. Cells outside of the tree are UNKNOWN."""
+    first_key = [int(math.floor(values[0] / resolution)) + TREE_MAX_VAL
+                 for values in axes]
+    shape = tuple(len(values) for values in axes)
+    states = numpy.full(shape, UNKNOWN, dtype=numpy.int8)
+    data = bytearray(value & 0xff for value in data)
+    if not data:
+        return states
+
+    def set_leaf(key, size, state):
+        block = []
+        for axis in range(3):
+            begin = max(key[axis] - first_key[axis], 0)
+            end = min(key[axis] + size - first_key[axis], shape[axis])
+            if begin >= end:
+                return
+            block.append(slice(begin, end))
+        states[tuple(block)] = state
+
+    position = [0]
+
+    def read_node(key, size):
+        """Reads the children of the node at key, depth first like
+        OcTree::readBinaryNode."""
+        bits = data[position[0]] | (data[position[0] + 1] << 8)
+        position[0] += 2
+        child_size = size // 2
+        for child in range(8):
+            state = (bits >> (2 * child)) & 3
+            if state == UNKNOWN:
+                continue
+            child_key = [key[0] + (child & 1) * child_size,
+                         key[1] + ((child >> 1) & 1) * child_size,
+                         key[2] + ((child >> 2) & 1) * child_size]
+            if state == INNER:
+                read_node(child_key, child_size)
+            else:
+                set_leaf(child_key, child_size, state)
+
+    read_node([0, 0, 0], 1 << TREE_DEPTH)
+    return states
+
+
+def accuracy(states, occupied):
+    """Confusion counts of the occupied cells and the derived metrics."""
+    mapped = states == OCCUPIED
+    true_positives = int(numpy.count_nonzero(mapped & occupied))
+    false_positives = int(numpy.count_nonzero(mapped & ~occupied))
+    false_negatives = int(numpy.count_nonzero(~mapped & occupied))
+    result = {"cells": int(states.size),
+              "occupied_cells": int(numpy.count_nonzero(occupied)),
+              "unknown_cells": int(numpy.count_nonzero(states == UNKNOWN)),
+              "true_positives": true_positives,
+              "false_positives": false_positives,
+              "false_negatives": false_negatives}
+    mapped_count = true_positives + false_positives
+    occupied_count = true_positives + false_negatives
+    union = true_positives + false_positives + false_negatives
+    result["precision"] = (true_positives / mapped_count
+                           if mapped_count else 1.0)
+    result["recall"] = (true_positives / occupied_count
+                        if occupied_count else 1.0)
+    result["iou"] = true_positives / union if union else 1.0
+    return result
+
+
+def ensure_master(timeout):
+    """Start a roscore unless a master is running, returns its process."""
+    if rosgraph.is_master_online():
+        return None
+    roscore = subprocess.Popen(["roscore"], stdout=open(os.devnull, "w"),
+                               stderr=subprocess.STDOUT,
+                               preexec_fn=os.setsid)
+    deadline = time.time() + timeout
+    while not rosgraph.is_master_online():
+        if time.time() > deadline or roscore.poll() is not None:
+            raise RuntimeError("Could not start roscore.")
+        time.sleep(0.5)
+    return roscore
+
+
+def run_world(world, backend, primitives, options, work_dir):
+    """Build the octomap of one world with one backend, return the result
+    dictionary."""
+    name = "%s_%s" % (world, backend)
+    world_file = os.path.join(work_dir, name + ".world")
+    launch_file = os.path.join(work_dir, name + ".launch")
+    with open(world_file, "w") as world_output:
+        world_output.write(create_world_file(primitives, backend))
+    with open(launch_file, "w") as launch:
+        launch.write(LAUNCH_HEADER.format(world_file=world_file) +
+                     "</launch>\n")
+
+    result = {"world": world, "backend": backend,
+              "primitives": len(primitives), "leaf_size": options.leaf_size,
+              "threads": options.threads}
+    log = open(os.path.join(work_dir, name + ".log"), "w")
+    roslaunch = subprocess.Popen(["roslaunch", launch_file], stdout=log,
+                                 stderr=subprocess.STDOUT,
+                                 preexec_fn=os.setsid)
+    try:
+        try:
+            rospy.wait_for_service(SERVICE_NAME, options.timeout)
+        except rospy.ROSException:
+            result["error"] = ("The octomap service did not come up within "
+                               "%.0f s, see %s.log." % (options.timeout, name))
+            return result
+        gzserver_pid = find_gzserver_pid()
+        if gzserver_pid is not None:
+            result["gzserver_rss_before_mb"] = read_memory(gzserver_pid)[0]
+
+        request = create_request(options.leaf_size)
+        request.num_threads = options.threads
+        get_octomap = rospy.ServiceProxy(SERVICE_NAME, Octomap)
+        start = time.time()
+        response = get_octomap(request)
+        result["wall_time"] = time.time() - start
+        result["map_size"] = len(response.map.data)
+
+        if gzserver_pid is not None:
+            rss, peak = read_memory(gzserver_pid)
+            result["gzserver_rss_mb"] = rss
+            result["gzserver_peak_rss_mb"] = peak
+
+        axes = cell_grid(request)
+        states = decode_octomap(response.map.data, response.map.resolution,
+                                axes)
+        result.update(accuracy(states, ground_truth(primitives, axes,
+                                                    options.leaf_size)))
+    finally:
+        stop_process(roslaunch, options.shutdown_timeout)
+        log.close()
+    return result
+
+
+def main():
+    parser = optparse.OptionParser(__doc__.strip())
+    parser.add_option(
+        "-w", "--worlds",
+        dest="worlds",
+        default=",".join(WORLDS),
+        type="string",
+        help="Comma separated worlds, of %s." % ", ".join(WORLDS))
+    parser.add_option(
+        "-b", "--backends",
+        dest="backends",
+        default=",".join(BACKENDS),
+        type="string",
+        help="Comma separated occupancy backends of the plugin.")
+    parser.add_option(
+        "--leaf_size",
+        dest="leaf_size",
+        default=0.1,
+        type="float",
+        help="Leaf size of the octomap [m].")
+    parser.add_option(
+        "--threads",
+        dest="threads",
+        default=0,
+        type="int",
+        help="Threads of the build, 0 uses the plugin default.")
+    parser.add_option(
+        "--seed",
+        dest="seed",
+        default=0,
+        type="int",
+        help="Seed of the world generator.")
+    parser.add_option(
+        "-t", "--timeout",
+        dest="timeout",
+        default=300.0,
+        type="float",
+        help="Wall time to wait for the octomap service [s].")
+    parser.add_option(
+        "--shutdown_timeout",
+        dest="shutdown_timeout",
+        default=30.0,
+        type="float",
+        help="Wall time roslaunch gets to shut down [s].")
+    parser.add_option(
+        "-o", "--output",
+        dest="output",
+        default="octomap_accuracy.json",
+        type="string",
+        help="The JSON file the results are written to.")
+    parser.add_option(
+        "--keep_files",
+        action="store_true",
+        dest="keep_files",
+        default=False,
+        help="Keep the generated launch, world and log files.")
+    (options, args) = parser.parse_args()
+
+    roscore = ensure_master(options.timeout)
+    rospy.init_node("benchmark_octomap_accuracy", anonymous=True,
+                    disable_signals=True)
+    work_dir = tempfile.mkdtemp(prefix="rotors_octomap_benchmark_")
+
+    results = {"host": platform.node(), "machine": platform.machine(),
+               "cpu_count": os.sysconf("SC_NPROCESSORS_ONLN"),
+               "date": time.strftime("%Y-%m-%dT%H:%M:%S"),
+               "seed": options.seed, "runs": []}
+    print("%-14s %-10s %9s %10s %9s %7s %7s" % (
+        "world", "backend", "wall [s]", "peak [MB]", "precision", "recall",
+        "IoU"))
+    try:
+        for world in options.worlds.split(","):
+            if world not in GENERATORS:
+                raise ValueError("Unknown world %s, known are %s."
+                                 % (world, ", ".join(WORLDS)))
+            # The same primitives for every backend.
+            primitives = GENERATORS[world](random.Random(options.seed))
+            for backend in options.backends.split(","):
+                result = run_world(world, backend, primitives, options,
+                                   work_dir)
+                results["runs"].append(result)
+                if "error" in result:
+                    print("%-14s %-10s %s" % (world, backend,
+                                              result["error"]))
+                    continue
+                print("%-14s %-10s %9.2f %10.0f %9.4f %7.4f %7.4f" % (
+                    world, backend, result["wall_time"],
+                    result.get("gzserver_peak_rss_mb") or 0,
+                    result["precision"], result["recall"], result["iou"]))
+    finally:
+        with open(options.output, "w") as output:
+            json.dump(results, output, indent=2, sort_keys=True)
+        print("Results written to %s" % options.output)
+        if options.keep_files:
+            print("Launch, world and log files are in %s" % work_dir)
+        else:
+            shutil.rmtree(work_dir)
+        if roscore is not None:
+            stop_process(roscore, options.shutdown_timeout)
+
+    failed = [result for result in results["runs"] if "error" in result]
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
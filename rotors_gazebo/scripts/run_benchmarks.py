@@ -0,0 +1,371 @@
+#!/usr/bin/env python
+"""
+Headless simulation benchmark of RotorS.
+
+Runs standard scenarios in gzserver (no GUI) for a fixed amount of
+simulated time and reports the real time factor, the OnUpdate() cost of
+every plugin (from GazeboProfilerPlugin) and the memory of gzserver as JSON.
+The profiler plugin is added to the world by this script. The plugins are
+only timed if rotors_gazebo_plugins was built with -DPLUGIN_PROFILING=TRUE,
+otherwise the plugin list of the results is empty.
+The scenarios are generated launch files, so the benchmark only needs a
+sourced workspace; it runs on a CPU-only machine (the vi_sensor scenario
+renders its cameras in software there).
+
+e.g.:
+  rosrun rotors_gazebo run_benchmarks.py --sim_duration 30 -o results.json
+  rosrun rotors_gazebo run_benchmarks.py --scenarios firefly_1,techpod
+  rosrun rotors_gazebo run_benchmarks.py --scenarios firefly_10,firefly_10_bag
+"""
+
+from __future__ import division, print_function
+
+import csv
+import json
+import optparse
+import os
+import platform
+import shutil
+import signal
+import subprocess
+import sys
+import tempfile
+import time
+
+import rospkg
+
+
+__author__ = "Fadri Furrer, Michael Burri, Markus Achtelik"
+__copyright__ = ("Copyright 2015, Fadri Furrer & Michael Burri & "
+                 "Markus Achtelik, ASL, ETH Zurich, Switzerland")
+__credits__ = ["Fadri Furrer", "Michael Burri", "Markus Achtelik"]
+__license__ = "ASL 2.0"
+__version__ = "0.1"
+__maintainer__ = "Fadri Furrer"
+__email__ = "fadri.furrer@mavt.ethz.ch"
+__status__ = "Development"
+
+
+LAUNCH_HEADER = """<launch>
+  <env name="GAZEBO_MODEL_PATH" value="${{GAZEBO_MODEL_PATH}}:$(find rotors_gazebo)/models"/>
+  <env name="GAZEBO_RESOURCE_PATH" value="${{GAZEBO_RESOURCE_PATH}}:$(find rotors_gazebo)/models"/>
+  <include file="$(find gazebo_ros)/launch/empty_world.launch">
+    <arg name="world_name" value="{world_file}"/>
+    <arg name="paused" value="false"/>
+    <arg name="gui" value="false"/>
+    <arg name="headless" value="true"/>
+  </include>
+"""
+
+LAUNCH_MAV = """
+  <group ns="{namespace}">
+    <include file="$(find rotors_gazebo)/launch/spawn_mav.launch">
+      <arg name="mav_name" value="{mav_name}"/>
+      <arg name="namespace" value="{namespace}"/>
+      <arg name="model" value="$(find rotors_description)/urdf/{model}"/>
+      <arg name="enable_logging" value="{enable_logging}"/>
+      <arg name="log_file" value="{log_file}"/>
+      <arg name="x" value="{x}"/>
+      <arg name="y" value="{y}"/>
+    </include>
+    <node name="lee_position_controller_node" pkg="rotors_control" type="lee_position_controller_node">
+      <rosparam command="load" file="$(find rotors_gazebo)/resource/lee_controller_{mav_name}.yaml"/>
+      <rosparam command="load" file="$(find rotors_gazebo)/resource/{mav_name}.yaml"/>
+      <remap from="odometry" to="odometry_sensor1/odometry"/>
+    </node>
+    <node name="waypoint_publisher" pkg="rotors_gazebo" type="waypoint_publisher" args="{x} {y} 1 0 2"/>
+  </group>
+"""
+
+LAUNCH_FIXED_WING = """
+  <group ns="{uav_name}">
+    <include file="$(find rotors_gazebo)/launch/spawn_fixed_wing.launch">
+      <arg name="uav_name" value="{uav_name}"/>
+      <arg name="model" value="$(find rotors_description)/urdf/{uav_name}_base.xacro"/>
+    </include>
+  </group>
+"""
+
+# Distance between the spawned multicopters [m].
+MAV_SPACING = 2.0
+
+# The _bag scenarios are the same as the ones without, with every MAV
+# writing a bag through GazeboBagPlugin, to compare the real time factor with
+# logging on and off.
+SCENARIOS = ["firefly_1", "firefly_1_bag", "firefly_10", "firefly_10_bag",
+             "firefly_50", "techpod", "vi_sensor"]
+
+
+def create_launch_file(scenario, world_file):
+    """Return the launch file content of a scenario."""
+    content = LAUNCH_HEADER.format(world_file=world_file)
+    # The bags are written next to the world file, so that they are removed
+    # with it.
+    work_dir = os.path.dirname(world_file)
+    if scenario.startswith("firefly_"):
+        count = int(scenario.split("_")[1])
+        enable_logging = scenario.endswith("_bag")
+        columns = max(int(count ** 0.5), 1)
+        for index in range(count):
+            namespace = "firefly%d" % (index + 1)
+            content += LAUNCH_MAV.format(
+                namespace=namespace, mav_name="firefly",
+                model="mav_generic_odometry_sensor.gazebo",
+                enable_logging=str(enable_logging).lower(),
+                log_file=os.path.join(work_dir, namespace),
+                x=(index % columns) * MAV_SPACING,
+                y=(index // columns) * MAV_SPACING)
+    elif scenario == "techpod":
+        content += LAUNCH_FIXED_WING.format(uav_name="techpod")
+    elif scenario == "vi_sensor":
+        content += LAUNCH_MAV.format(
+            namespace="firefly", mav_name="firefly",
+            model="mav_with_vi_sensor.gazebo", enable_logging="false",
+            log_file=os.path.join(work_dir, "firefly"), x=0.0, y=0.0)
+    else:
+        raise ValueError("Unknown scenario %s, known are %s."
+                         % (scenario, ", ".join(SCENARIOS)))
+    return content + "</launch>\n"
+
+
+def create_world_file(world_template, summary_file):
+    """Return the world with the profiler plugin added, writing its summary
+    to a file."""
+    with open(world_template) as template:
+        world = template.read()
+    if "</world>" not in world:
+        raise ValueError("%s has no world element." % world_template)
+    plugin = ('<plugin name="profiler_plugin" '
+              'filename="librotors_gazebo_profiler_plugin.so">'
+              '<summaryFile>%s</summaryFile></plugin>\n' % summary_file)
+    return world.replace("</world>", plugin + "</world>", 1)
+
+
+def find_gzserver_pid():
+    """Return the pid of the running gzserver, or None."""
+    for pid in os.listdir("/proc"):
+        if not pid.isdigit():
+            continue
+        try:
+            with open("/proc/%s/cmdline" % pid) as cmdline:
+                executable = cmdline.read().split("\0")[0]
+        except IOError:
+            continue
+        if os.path.basename(executable) == "gzserver":
+            return int(pid)
+    return None
+
+
+def read_memory(pid):
+    """Return the current and peak resident memory of pid in MB."""
+    memory = {}
+    try:
+        with open("/proc/%d/status" % pid) as status:
+            for line in status:
+                key, _, value = line.partition(":")
+                if key in ("VmRSS", "VmHWM"):
+                    memory[key] = int(value.split()[0]) / 1024.0
+    except IOError:
+        pass
+    return memory.get("VmRSS"), memory.get("VmHWM")
+
+
+def read_sim_time(stats_line):
+    """Parse a 'gz stats -p' line, returns (real time factor, sim time)."""
+    fields = stats_line.split(",")
+    if len(fields) < 3 or stats_line.startswith("#"):
+        return None
+    try:
+        return float(fields[0]), float(fields[1])
+    except ValueError:
+        return None
+
+
+def read_profiler_summary(summary_file):
+    """Return the rows of the GazeboProfilerPlugin CSV summary."""
+    if not os.path.exists(summary_file):
+        return []
+    plugins = []
+    with open(summary_file) as summary:
+        for row in csv.DictReader(summary):
+            row["calls"] = int(row["calls"])
+            for key in ["total_ms", "mean_us", "p99_us", "max_us"]:
+                row[key] = float(row[key])
+            plugins.append(row)
+    return plugins
+
+
+def stop_process(process, timeout):
+    """SIGINT the process group like roslaunch on Ctrl-C, kill on timeout."""
+    if process.poll() is not None:
+        return
+    os.killpg(process.pid, signal.SIGINT)
+    deadline = time.time() + timeout
+    while process.poll() is None and time.time() < deadline:
+        time.sleep(0.2)
+    if process.poll() is None:
+        os.killpg(process.pid, signal.SIGKILL)
+        process.wait()
+
+
+def run_scenario(scenario, options, world_template, work_dir):
+    """Run one scenario and return its result dictionary."""
+    summary_file = os.path.join(work_dir, scenario + "_profiler.csv")
+    world_file = os.path.join(work_dir, scenario + ".world")
+    launch_file = os.path.join(work_dir, scenario + ".launch")
+    with open(world_file, "w") as world:
+        world.write(create_world_file(world_template, summary_file))
+    with open(launch_file, "w") as launch:
+        launch.write(create_launch_file(scenario, world_file))
+
+    result = {"scenario": scenario, "sim_duration": options.sim_duration,
+              "warmup": options.warmup}
+    log = open(os.path.join(work_dir, scenario + ".log"), "w")
+    roslaunch = subprocess.Popen(["roslaunch", launch_file], stdout=log,
+                                 stderr=subprocess.STDOUT,
+                                 preexec_fn=os.setsid)
+    stats = None
+    try:
+        deadline = time.time() + options.timeout
+        stats = subprocess.Popen(["gz", "stats", "-p"],
+                                 stdout=subprocess.PIPE,
+                                 universal_newlines=True)
+        start = None
+        gzserver_pid = None
+        rtf_samples = []
+        while time.time() < deadline:
+            line = stats.stdout.readline()
+            if not line:
+                # gz stats exits if it cannot reach the server yet.
+                stats.wait()
+                time.sleep(1.0)
+                stats = subprocess.Popen(["gz", "stats", "-p"],
+                                         stdout=subprocess.PIPE,
+                                         universal_newlines=True)
+                continue
+            sample = read_sim_time(line)
+            if sample is None:
+                continue
+            sim_time = sample[1]
+            if start is None:
+                if sim_time >= options.warmup:
+                    start = (time.time(), sim_time)
+                    gzserver_pid = find_gzserver_pid()
+                continue
+            rtf_samples.append(sample[0] / 100.0)
+            if sim_time - start[1] >= options.sim_duration:
+                wall_duration = time.time() - start[0]
+                result["wall_duration"] = wall_duration
+                result["real_time_factor"] = ((sim_time - start[1]) /
+                                              wall_duration)
+                result["real_time_factor_min"] = min(rtf_samples)
+                break
+
+        if "real_time_factor" not in result:
+            result["error"] = ("Timed out after %.0f s, see %s.log."
+                               % (options.timeout, scenario))
+        if gzserver_pid is not None:
+            rss, peak = read_memory(gzserver_pid)
+            result["gzserver_rss_mb"] = rss
+            result["gzserver_peak_rss_mb"] = peak
+    finally:
+        if stats is not None and stats.poll() is None:
+            stats.terminate()
+            stats.wait()
+        stop_process(roslaunch, options.shutdown_timeout)
+        log.close()
+
+    result["plugins"] = read_profiler_summary(summary_file)
+    return result
+
+
+def main():
+    parser = optparse.OptionParser(__doc__.strip())
+    parser.add_option(
+        "-s", "--scenarios",
+        dest="scenarios",
+        default=",".join(SCENARIOS),
+        type="string",
+        help="Comma separated scenarios, of %s." % ", ".join(SCENARIOS))
+    parser.add_option(
+        "-d", "--sim_duration",
+        dest="sim_duration",
+        default=30.0,
+        type="float",
+        help="Simulated time that is measured per scenario [s].")
+    parser.add_option(
+        "-w", "--warmup",
+        dest="warmup",
+        default=5.0,
+        type="float",
+        help="Simulated time before the measurement starts, to let all "
+             "models spawn [s].")
+    parser.add_option(
+        "-t", "--timeout",
+        dest="timeout",
+        default=600.0,
+        type="float",
+        help="Wall time after which a scenario is aborted [s].")
+    parser.add_option(
+        "--shutdown_timeout",
+        dest="shutdown_timeout",
+        default=30.0,
+        type="float",
+        help="Wall time roslaunch gets to shut down [s].")
+    parser.add_option(
+        "-o", "--output",
+        dest="output",
+        default="rotors_benchmark.json",
+        type="string",
+        help="The JSON file the results are written to.")
+    parser.add_option(
+        "--keep_files",
+        action="store_true",
+        dest="keep_files",
+        default=False,
+        help="Keep the generated launch, world and log files.")
+    (options, args) = parser.parse_args()
+
+    rotors_gazebo_path = rospkg.RosPack().get_path("rotors_gazebo")
+    world_template = os.path.join(rotors_gazebo_path, "worlds", "basic.world")
+    work_dir = tempfile.mkdtemp(prefix="rotors_benchmark_")
+
+    results = {"host": platform.node(), "machine": platform.machine(),
+               "cpu_count": os.sysconf("SC_NPROCESSORS_ONLN"),
+               "date": time.strftime("%Y-%m-%dT%H:%M:%S"),
+               "scenarios": []}
+    try:
+        for scenario in options.scenarios.split(","):
+            print("Running %s..." % scenario)
+            result = run_scenario(scenario, options, world_template,
+                                  work_dir)
+            results["scenarios"].append(result)
+            if "error" in result:
+                print("  %s" % result["error"])
+            else:
+                print("  real time factor %.2f (min %.2f), gzserver %.0f MB "
+                      "(peak %.0f MB)" % (
+                          result["real_time_factor"],
+                          result["real_time_factor_min"],
+                          result.get("gzserver_rss_mb") or 0,
+                          result.get("gzserver_peak_rss_mb") or 0))
+            for plugin in result["plugins"][:5]:
+                print("  %-28s %-12s %8.1f ms total, %7.1f us mean, "
+                      "%7.1f us p99" % (plugin["plugin"], plugin["model"],
+                                        plugin["total_ms"],
+                                        plugin["mean_us"], plugin["p99_us"]))
+    finally:
+        with open(options.output, "w") as output:
+            json.dump(results, output, indent=2, sort_keys=True)
+        print("Results written to %s" % options.output)
+        if options.keep_files:
+            print("Launch, world and log files are in %s" % work_dir)
+        else:
+            shutil.rmtree(work_dir)
+
+    failed = [result for result in results["scenarios"] if "error" in result]
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,344 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Micro-benchmarks of the numerical kernels of the plugins. All inputs are
+// fixed, no world is loaded. Build with -DBUILD_BENCHMARKS=TRUE and run
+//   rosrun rotors_gazebo_plugins rotors_gazebo_plugins_benchmark
+// The per-step logging benchmarks write to files in /tmp, they are only built
+// with ROS (bag) and with the MAVLink headers (MAVLink log).
+
+// SYSTEM
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// 3RD PARTY
+#include <benchmark/benchmark.h>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+// USER
+#include "liftdrag_plugin/liftdrag_plugin.h"
+#include "rotors_gazebo_plugins/common.h"
+#include "rotors_gazebo_plugins/geo_mag_declination.h"
+#include "rotors_gazebo_plugins/imu_noise_model.h"
+#include "rotors_gazebo_plugins/voxel_grid.h"
+#include "rotors_gazebo_plugins/voxelizer.h"
+
+#ifdef ROTORS_BENCHMARK_BAG_LOGGING
+#include <geometry_msgs/PoseStamped.h>
+#include <geometry_msgs/TwistStamped.h>
+#include <mav_msgs/Actuators.h>
+
+#include "rotors_gazebo_plugins/async_bag_writer.h"
+#endif
+
+#ifdef ROTORS_BENCHMARK_MAVLINK_LOGGING
+#include "rotors_gazebo_plugins/mavlink_log.h"
+#endif
+
+namespace gazebo {
+
+// Time constants and sampling time of the motor model of the firefly.
+static constexpr double kBenchmarkTimeConstantUp = 1.0 / 80.0;
+static constexpr double kBenchmarkTimeConstantDown = 1.0 / 40.0;
+static constexpr double kBenchmarkSamplingTime = 0.001;
+
+static void BM_FirstOrderFilterUpdate(benchmark::State& state) {
+  FirstOrderFilter<double> filter(kBenchmarkTimeConstantUp,
+                                  kBenchmarkTimeConstantDown, 0.0);
+  // Alternate between accelerating and decelerating.
+  const double inputs[2] = {838.0, 0.0};
+  unsigned int i = 0;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(
+        filter.updateFilter(inputs[(i++ >> 4) & 1], kBenchmarkSamplingTime));
+  }
+}
+BENCHMARK(BM_FirstOrderFilterUpdate);
+
+static void BM_ImuNoiseModelAddNoise(benchmark::State& state) {
+  ImuNoiseModel imu_noise_model;
+  imu_noise_model.Initialize(ImuParameters());
+  const Eigen::Vector3d linear_acceleration_true(0.1, -0.2, 9.81);
+  const Eigen::Vector3d angular_velocity_true(0.01, 0.02, -0.03);
+  while (state.KeepRunning()) {
+    Eigen::Vector3d linear_acceleration = linear_acceleration_true;
+    Eigen::Vector3d angular_velocity = angular_velocity_true;
+    imu_noise_model.AddNoise(&linear_acceleration, &angular_velocity,
+                             kBenchmarkSamplingTime);
+    benchmark::DoNotOptimize(linear_acceleration.data());
+    benchmark::DoNotOptimize(angular_velocity.data());
+  }
+}
+BENCHMARK(BM_ImuNoiseModelAddNoise);
+
+static void BM_GetMagDeclination(benchmark::State& state) {
+  // Grid over the whole table, including the clamped polar regions.
+  std::vector<float> latitudes_rad;
+  std::vector<float> longitudes_rad;
+  for (int lat_deg = -85; lat_deg <= 85; lat_deg += 17) {
+    for (int lon_deg = -175; lon_deg <= 175; lon_deg += 35) {
+      latitudes_rad.push_back(lat_deg / 180.0 * M_PI);
+      longitudes_rad.push_back(lon_deg / 180.0 * M_PI);
+    }
+  }
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(
+        get_mag_declination(latitudes_rad[i], longitudes_rad[i]));
+    if (++i == latitudes_rad.size()) {
+      i = 0;
+    }
+  }
+}
+BENCHMARK(BM_GetMagDeclination);
+
+/// \brief    LiftDragPlugin with the parameters of the left wing of the
+///           tailsitter model.
+class BenchmarkLiftDragPlugin : public LiftDragPlugin {
+ public:
+  BenchmarkLiftDragPlugin() {
+    this->alpha0 = 0.05984281113;
+    this->cla = 4.752798721;
+    this->cda = 0.6417112299;
+    this->cma = -1.8;
+    this->alphaStall = 0.6391428111;
+    this->claStall = -3.85;
+    this->cdaStall = -0.9233984055;
+    this->cmaStall = 0.0;
+    this->cp = math::Vector3(0.0, 0.3, 0.0);
+    this->area = 0.15;
+    this->forward = math::Vector3(0.0, 0.0, 1.0);
+    this->upward = math::Vector3(-1.0, 0.0, 0.0);
+    this->controlJointRadToCL = -0.5;
+  }
+};
+
+static void BM_LiftDragComputeForces(benchmark::State& state) {
+  BenchmarkLiftDragPlugin plugin;
+  // Inflow at a small angle of attack (argument 0) or beyond the stall
+  // angle (argument 1), with some sideslip.
+  const double angle_of_attack = state.range(0) ? 0.8 : 0.05;
+  const math::Vector3 velocity(15.0 * sin(angle_of_attack), 0.5,
+                               15.0 * cos(angle_of_attack));
+  const math::Quaternion rotation(0.02, -0.01, 0.1);
+  math::Vector3 force;
+  math::Vector3 torque;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(
+        plugin.ComputeForces(velocity, rotation, 0.05, force, torque));
+    benchmark::DoNotOptimize(force);
+    benchmark::DoNotOptimize(torque);
+  }
+}
+BENCHMARK(BM_LiftDragComputeForces)->Arg(0)->Arg(1);
+
+static void BM_VoxelizePrimitive(benchmark::State& state) {
+  // Tilted box (first argument 0) or cylinder (1) of about 2 m in a 4 m cube
+  // of 5 cm voxels, voxelized cell by cell (second argument 0) or coarse to
+  // fine (1).
+  CollisionPrimitive primitive;
+  primitive.type = state.range(0) ? CollisionPrimitive::kCylinder
+                                  : CollisionPrimitive::kBox;
+  primitive.rotation =
+      Eigen::AngleAxisd(0.4, Eigen::Vector3d(1.0, 1.0, 0.0).normalized())
+          .toRotationMatrix();
+  primitive.half_extents = Eigen::Vector3d(1.0, 0.8, 0.6);
+  primitive.radius = 0.7;
+  primitive.half_length = 1.0;
+  VoxelGrid grid(Eigen::Vector3d::Constant(-1.975), 0.05, 80, 80, 80);
+  const Eigen::Vector3i first = Eigen::Vector3i::Zero();
+  const Eigen::Vector3i last = Eigen::Vector3i::Constant(79);
+  while (state.KeepRunning()) {
+    if (state.range(1)) {
+      VoxelizePrimitiveHierarchical(primitive, first, last, &grid);
+    } else {
+      VoxelizePrimitive(primitive, first, last, &grid);
+    }
+    benchmark::DoNotOptimize(grid.Row(0, 0));
+  }
+}
+BENCHMARK(BM_VoxelizePrimitive)
+    ->Args({0, 0})
+    ->Args({0, 1})
+    ->Args({1, 0})
+    ->Args({1, 1});
+
+static void BM_VoxelizePrimitives(benchmark::State& state) {
+  // 200 boxes and cylinders of up to 2 m on a 20 m square, in 5 cm voxels up
+  // to 5 m, coarse to fine with the number of threads given as argument.
+  // The same shapes on every run.
+  std::vector<CollisionPrimitive> primitives(200);
+  for (size_t i = 0; i < primitives.size(); ++i) {
+    CollisionPrimitive& primitive = primitives[i];
+    primitive.type = i % 2 ? CollisionPrimitive::kCylinder
+                           : CollisionPrimitive::kBox;
+    primitive.position = Eigen::Vector3d((i * 37) % 200 / 10.0,
+                                         (i * 91) % 200 / 10.0, 1.0);
+    primitive.rotation =
+        Eigen::AngleAxisd(0.1 * i, Eigen::Vector3d::UnitZ())
+            .toRotationMatrix();
+    primitive.half_extents = Eigen::Vector3d(1.0, 0.3, 1.0);
+    primitive.radius = 0.2 + (i % 7) * 0.1;
+    primitive.half_length = 1.0;
+  }
+  const Eigen::Vector3i first = Eigen::Vector3i::Zero();
+  const Eigen::Vector3i last(399, 399, 99);
+  while (state.KeepRunning()) {
+    VoxelGrid grid(Eigen::Vector3d::Constant(0.025), 0.05, 400, 400, 100);
+    VoxelizePrimitives(primitives, first, last, true, state.range(0), &grid,
+                       [](const Eigen::Vector3i&, const Eigen::Vector3i&) {
+                         return true;
+                       });
+    benchmark::DoNotOptimize(grid.Row(0, 0));
+  }
+}
+BENCHMARK(BM_VoxelizePrimitives)
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+
+static void BM_FloodFill(benchmark::State& state) {
+  // 200^3 voxels with floors of boxes every 8 layers, each with a door, run
+  // with the number of threads given as argument.
+  const int kSize = 200;
+  VoxelGrid occupied(Eigen::Vector3d::Zero(), 0.05, kSize, kSize, kSize);
+  for (int z = 4; z < kSize; z += 8) {
+    for (int y = 0; y < kSize; ++y) {
+      occupied.SetRun(0, kSize, y, z);
+    }
+    occupied.Row(kSize / 2, z)[0] = 0;
+  }
+  const std::vector<Eigen::Vector3i> seeds(1, Eigen::Vector3i::Zero());
+  while (state.KeepRunning()) {
+    VoxelGrid reached(Eigen::Vector3d::Zero(), 0.05, kSize, kSize, kSize);
+    FloodFill(occupied, seeds, state.range(0), &reached, NULL);
+    benchmark::DoNotOptimize(reached.Row(0, 0));
+  }
+}
+BENCHMARK(BM_FloodFill)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+
+static void BM_ComputeDistanceField(benchmark::State& state) {
+  // 100^3 voxels of free space around a box in the middle, with the number
+  // of threads given as argument.
+  const int kSize = 100;
+  VoxelGrid free_space(Eigen::Vector3d::Zero(), 0.05, kSize, kSize, kSize);
+  for (int z = 0; z < kSize; ++z) {
+    for (int y = 0; y < kSize; ++y) {
+      if (z < 40 || z >= 60 || y < 40 || y >= 60) {
+        free_space.SetRun(0, kSize, y, z);
+      } else {
+        free_space.SetRun(0, 40, y, z);
+        free_space.SetRun(60, kSize, y, z);
+      }
+    }
+  }
+  DistanceField field;
+  while (state.KeepRunning()) {
+    ComputeDistanceField(free_space, state.range(0), &field);
+    benchmark::DoNotOptimize(field.distances.data());
+  }
+}
+BENCHMARK(BM_ComputeDistanceField)
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+
+/// \brief    Name of a file in /tmp that is unique to this process.
+static std::string BenchmarkTempFile(const std::string& name) {
+  return std::string(P_tmpdir) + "/rotors_gazebo_plugins_benchmark_" +
+      std::to_string(getpid()) + "_" + name;
+}
+
+#ifdef ROTORS_BENCHMARK_BAG_LOGGING
+static void BM_BagPluginLogStep(benchmark::State& state) {
+  // What GazeboBagPlugin logs on every physics step of a firefly: the ground
+  // truth pose and twist and the six motor velocities, from reused messages.
+  // The messages go straight to the bag (argument 0) or are held in memory
+  // for a trigger (1). The writer thread writes the bag during the run, the
+  // messages it could not keep up with are reported as dropped.
+  const std::string filename = BenchmarkTempFile("log_step.bag");
+  AsyncBagWriterOptions options;
+  options.pre_trigger_duration = state.range(0) ? 10.0 : 0.0;
+  AsyncBagWriter writer;
+  writer.Open(filename, options);
+
+  geometry_msgs::PoseStamped pose_msg;
+  geometry_msgs::TwistStamped twist_msg;
+  mav_msgs::Actuators rot_velocities_msg;
+  rot_velocities_msg.angular_velocities.resize(6);
+  const std::string pose_topic = "firefly/ground_truth/pose";
+  const std::string twist_topic = "firefly/ground_truth/twist";
+  const std::string motor_topic = "firefly/motor_speed";
+
+  uint64_t step = 0;
+  while (state.KeepRunning()) {
+    const ros::Time now(1.0 + step * kBenchmarkSamplingTime);
+    pose_msg.header.stamp = now;
+    pose_msg.pose.position.x = 0.001 * step;
+    pose_msg.pose.orientation.w = 1.0;
+    twist_msg.header.stamp = now;
+    twist_msg.twist.linear.x = 1.0;
+    rot_velocities_msg.header.stamp = now;
+    for (size_t i = 0; i < rot_velocities_msg.angular_velocities.size(); ++i) {
+      rot_velocities_msg.angular_velocities[i] = 545.0 + i;
+    }
+    writer.Write(pose_topic, now, pose_msg);
+    writer.Write(twist_topic, now, twist_msg);
+    writer.Write(motor_topic, now, rot_velocities_msg);
+    ++step;
+  }
+
+  writer.Close();
+  state.counters["dropped"] = writer.GetDroppedCount();
+  std::remove(filename.c_str());
+}
+BENCHMARK(BM_BagPluginLogStep)->Arg(0)->Arg(1);
+#endif
+
+#ifdef ROTORS_BENCHMARK_MAVLINK_LOGGING
+static void BM_MavlinkLogWrite(benchmark::State& state) {
+  // What GazeboMavlinkInterface logs for every HIL_SENSOR message it sends.
+  const std::string filename = BenchmarkTempFile("log_write.mavlog");
+  MavlinkLogWriter writer;
+  writer.Open(filename);
+
+  mavlink_hil_sensor_t sensor_msg = {};
+  sensor_msg.zacc = -9.81f;
+  sensor_msg.abs_pressure = 1013.25f;
+  sensor_msg.fields_updated = 0x1fff;
+
+  uint64_t step = 0;
+  while (state.KeepRunning()) {
+    sensor_msg.time_usec = step * 1000;
+    writer.Write(sensor_msg.time_usec, MavlinkLogDirection::kOutbound,
+                 MAVLINK_MSG_ID_HIL_SENSOR, &sensor_msg,
+                 MAVLINK_MSG_ID_HIL_SENSOR_LEN);
+    ++step;
+  }
+
+  writer.Close();
+  std::remove(filename.c_str());
+}
+BENCHMARK(BM_MavlinkLogWrite);
+#endif
+
+}
+
+BENCHMARK_MAIN();
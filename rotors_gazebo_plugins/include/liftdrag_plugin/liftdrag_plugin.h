@@ -38,6 +38,21 @@ namespace gazebo
     // Documentation Inherited.
     public: virtual void Load(physics::ModelPtr _model, sdf::ElementPtr _sdf);
 
+    /// \brief Computes lift, drag and moment of the airfoil. Needs neither
+    /// a link nor a world, so it can be called (and benchmarked) on its own.
+    /// \param[in] _vel Linear velocity at cp in the inertial frame.
+    /// \param[in] _rot Orientation of the link in the inertial frame.
+    /// \param[in] _controlAngle Angle of the control joint [rad].
+    /// \param[out] _force Force at cp in the inertial frame.
+    /// \param[out] _torque Torque in the inertial frame.
+    /// \return False if the velocity is too small to generate forces, in
+    /// which case _force and _torque are left untouched.
+    public: bool ComputeForces(const math::Vector3 &_vel,
+                               const math::Quaternion &_rot,
+                               double _controlAngle,
+                               math::Vector3 &_force,
+                               math::Vector3 &_torque);
+
     /// \brief Callback for World Update events.
     protected: virtual void OnUpdate();
 
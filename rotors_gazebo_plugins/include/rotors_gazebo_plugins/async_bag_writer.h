@@ -0,0 +1,279 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROTORS_GAZEBO_PLUGINS_ASYNC_BAG_WRITER_H
+#define ROTORS_GAZEBO_PLUGINS_ASYNC_BAG_WRITER_H
+
+// SYSTEM
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 3RD PARTY
+#include <ros/message_traits.h>
+#include <ros/serialization.h>
+#include <ros/time.h>
+#include <rosbag/bag.h>
+
+namespace gazebo {
+
+// Default values
+static constexpr unsigned int kDefaultAsyncBagWriterQueueSize = 4096;
+static constexpr uint32_t kDefaultBagChunkThreshold = 768 * 1024;
+static constexpr uint64_t kDefaultPreTriggerMemoryLimit = 256 * 1024 * 1024;
+
+/// \brief    What to do if a message is logged while all slots are in use.
+enum class BagOverflowPolicy {
+  kDropNewest,  ///< Discard the new message and count the drop.
+  kBlock        ///< Wait for the writer thread, never drops but may stall.
+};
+
+struct AsyncBagWriterOptions {
+  AsyncBagWriterOptions()
+      : queue_size(kDefaultAsyncBagWriterQueueSize),
+        overflow_policy(BagOverflowPolicy::kDropNewest),
+        compression(rosbag::compression::Uncompressed),
+        chunk_threshold(kDefaultBagChunkThreshold),
+        pre_trigger_duration(0.0),
+        pre_trigger_memory_limit(kDefaultPreTriggerMemoryLimit) {}
+
+  /// \brief    Number of slots, rounded up to a power of two.
+  unsigned int queue_size;
+  BagOverflowPolicy overflow_policy;
+  rosbag::compression::CompressionType compression;
+  /// \brief    Uncompressed size of a bag chunk [bytes].
+  uint32_t chunk_threshold;
+  /// \brief    If positive, messages are kept in memory for this long [s]
+  ///           (in message time) and the bag is only created by Trigger().
+  double pre_trigger_duration;
+  /// \brief    Upper bound of the serialized messages held before the
+  ///           trigger [bytes], the oldest are discarded beyond it.
+  uint64_t pre_trigger_memory_limit;
+};
+
+/// \brief    Number of messages and serialized bytes written on a topic.
+struct BagTopicStatistics {
+  BagTopicStatistics() : messages(0), bytes(0) {}
+  uint64_t messages;
+  uint64_t bytes;
+};
+
+/// \brief    Writes messages to a rosbag on a dedicated thread.
+/// \details  Producers (the physics thread and the ROS callbacks) serialize
+///           the message into one of a fixed number of preallocated slots of
+///           a lock-free bounded ring and return immediately. The writer
+///           thread drains the ring into the bag, so disk stalls never reach
+///           the physics thread. Slot buffers keep their capacity, so after
+///           warm-up logging does not allocate and the memory is bounded by
+///           the number of slots times the largest message.
+class AsyncBagWriter {
+ public:
+  AsyncBagWriter();
+  ~AsyncBagWriter();
+
+  /// \brief    Opens the bag and starts the writer thread.
+  void Open(const std::string& filename, const AsyncBagWriterOptions& options);
+
+  /// \brief    Writes all queued messages, stops the thread and closes the bag.
+  ///           Messages still held for a trigger that never came are
+  ///           discarded.
+  void Close();
+
+  bool IsOpen() const { return running_; }
+
+  /// \brief    Creates the bag, writes the messages held in memory and then
+  ///           passes all messages through. Without a pre-trigger duration
+  ///           the writer is triggered from the start.
+  void Trigger();
+
+  bool IsTriggered() const { return triggered_; }
+
+  /// \brief    Closes the bag after the messages written so far and
+  ///           continues in a new bag, armed like after Open().
+  /// \details  Returns at once, the writer thread closes and opens the bags
+  ///           in order with the messages, so the caller never waits for
+  ///           the disk. The written count and statistics start over and
+  ///           the writer thread logs those of the closed bag.
+  void Rotate(const std::string& filename);
+
+  template<class T>
+  void Write(const std::string& topic, const ros::Time& time, const T& msg);
+
+  template<class T>
+  void Write(const std::string& topic, const ros::Time& time,
+             boost::shared_ptr<T const> const& msg) {
+    Write(topic, time, *msg);
+  }
+
+  uint64_t GetWrittenCount() const { return written_count_; }
+  uint64_t GetDroppedCount() const { return dropped_count_; }
+  uint64_t GetErrorCount() const { return error_count_; }
+
+  /// \brief    Size of the bag file after Close() [bytes].
+  uint64_t GetFileSize() const { return file_size_; }
+
+  /// \brief    Per topic statistics, only valid after Close().
+  const std::map<std::string, BagTopicStatistics>& GetTopicStatistics() const {
+    return topic_statistics_;
+  }
+
+ private:
+  struct Slot {
+    /// Trigger and rotation requests are queued with the messages, so that
+    /// they apply exactly between the messages before and after them.
+    enum Kind { kMessage, kTrigger, kRotate };
+
+    Kind kind;
+    /// The topic of a message, the new filename of a rotation.
+    std::string topic;
+    ros::Time time;
+    const char* md5sum;
+    const char* datatype;
+    const char* definition;
+    std::vector<uint8_t> buffer;
+    uint32_t length;
+  };
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    Slot slot;
+  };
+
+  /// \brief    A message held in memory until the trigger.
+  struct PreTriggerRecord {
+    std::string topic;
+    ros::Time time;
+    const char* md5sum;
+    const char* datatype;
+    const char* definition;
+    std::vector<uint8_t> buffer;
+  };
+
+  /// \brief    Claims a free cell, returns nullptr if the ring is full and
+  ///           may_drop is set and the policy is to drop.
+  Cell* AcquireCell(size_t* position, bool may_drop);
+
+  /// \brief    Hands a filled cell over to the writer thread.
+  void CommitCell(Cell* cell, size_t position);
+
+  /// \brief    Queues a trigger or rotation request.
+  void Request(Slot::Kind kind, const std::string& filename);
+
+  void Run();
+
+  /// \brief    Writes the next queued message, returns false if none.
+  bool WriteNext();
+
+  /// \brief    Keeps a message in the pre-trigger buffer and drops what
+  ///           falls out of the time window or the memory limit.
+  void HoldForTrigger(const Slot& slot);
+
+  /// \brief    Opens the bag and writes the pre-trigger buffer to it.
+  void FlushPreTrigger();
+
+  /// \brief    Closes the bag and reads its file size.
+  void CloseBag();
+
+  /// \brief    Closes the bag and arms the next one, on the writer thread.
+  void RotateBag(const std::string& filename);
+
+  void WriteToBag(const std::string& topic, const ros::Time& time,
+                  const char* md5sum, const char* datatype,
+                  const char* definition, const uint8_t* buffer,
+                  uint32_t length);
+
+  rosbag::Bag bag_;
+  std::string filename_;
+  AsyncBagWriterOptions options_;
+  bool bag_open_;
+  /// \brief    Whether the writer thread passes messages to the bag, it
+  ///           follows triggered_ in the order of the queue.
+  bool writer_triggered_;
+  std::thread thread_;
+  std::atomic<bool> running_;
+  std::atomic<bool> triggered_;
+  std::atomic<int> active_producers_;
+
+  BagOverflowPolicy overflow_policy_;
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_;
+  std::atomic<size_t> enqueue_position_;
+  size_t dequeue_position_;
+
+  std::atomic<uint64_t> written_count_;
+  std::atomic<uint64_t> dropped_count_;
+  std::atomic<uint64_t> error_count_;
+
+  /// \brief    Only touched by the writer thread while it runs.
+  std::map<std::string, BagTopicStatistics> topic_statistics_;
+  uint64_t file_size_;
+
+  /// \brief    Only touched by the writer thread. Buffers of discarded
+  ///           records are kept for reuse.
+  std::deque<PreTriggerRecord> pre_trigger_records_;
+  std::vector<std::vector<uint8_t> > spare_buffers_;
+  uint64_t pre_trigger_bytes_;
+};
+
+template<class T>
+void AsyncBagWriter::Write(const std::string& topic, const ros::Time& time,
+                           const T& msg) {
+  // Close() waits for all producers that got past the check below.
+  ++active_producers_;
+  if (!running_) {
+    --active_producers_;
+    return;
+  }
+
+  size_t position;
+  Cell* cell = AcquireCell(&position, true);
+  if (!cell) {
+    ++dropped_count_;
+    --active_producers_;
+    return;
+  }
+
+  Slot& slot = cell->slot;
+  slot.kind = Slot::kMessage;
+  slot.topic.assign(topic);
+  slot.time = time;
+  slot.md5sum = ros::message_traits::md5sum<T>(msg);
+  slot.datatype = ros::message_traits::datatype<T>(msg);
+  slot.definition = ros::message_traits::definition<T>(msg);
+  slot.length = ros::serialization::serializationLength(msg);
+  if (slot.buffer.size() < slot.length) {
+    slot.buffer.resize(slot.length);
+  }
+  ros::serialization::OStream stream(slot.buffer.data(), slot.length);
+  ros::serialization::serialize(stream, msg);
+
+  CommitCell(cell, position);
+  --active_producers_;
+}
+
+}
+
+#endif // ROTORS_GAZEBO_PLUGINS_ASYNC_BAG_WRITER_H
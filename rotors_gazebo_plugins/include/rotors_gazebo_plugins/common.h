@@ -22,9 +22,13 @@
 #ifndef ROTORS_GAZEBO_PLUGINS_COMMON_H_
 #define ROTORS_GAZEBO_PLUGINS_COMMON_H_
 
+#include <chrono>
+
 #include <Eigen/Dense>
 #include <gazebo/gazebo.hh>
 
+#include "rotors_gazebo_plugins/plugin_profiler.h"
+
 namespace gazebo {
 
 //===============================================================================================//
@@ -81,6 +85,41 @@ bool getSdfParam(sdf::ElementPtr sdf, const std::string& name, T& param, const T
   return false;
 }
 
+//===============================================================================================//
+//========================================= PROFILING ===========================================//
+//===============================================================================================//
+
+/// \brief    Adds the wall time between construction and destruction to a
+///           PluginProfilerEntry. Use it through ROTORS_PROFILE_SCOPE.
+class ScopedProfilerTimer {
+ public:
+  explicit ScopedProfilerTimer(PluginProfilerEntry* entry)
+      : entry_(entry), start_(std::chrono::steady_clock::now()) {}
+
+  ~ScopedProfilerTimer() {
+    if (entry_) {
+      entry_->AddSample(std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start_).count());
+    }
+  }
+
+ private:
+  PluginProfilerEntry* entry_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+/// \brief    Times the enclosing scope into the given PluginProfilerEntry*.
+///           Compiled out unless ROTORS_PLUGIN_PROFILING is defined (CMake
+///           option PLUGIN_PROFILING).
+#ifdef ROTORS_PLUGIN_PROFILING
+static constexpr bool kPluginProfilingEnabled = true;
+#define ROTORS_PROFILE_SCOPE(entry) \
+  gazebo::ScopedProfilerTimer rotors_profile_scope_timer(entry)
+#else
+static constexpr bool kPluginProfilingEnabled = false;
+#define ROTORS_PROFILE_SCOPE(entry) do {} while (false)
+#endif
+
 }
 
 /// \brief    This class can be used to apply a first order filter on a signal.
@@ -0,0 +1,205 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROTORS_GAZEBO_PLUGINS_FLIGHT_RECORDER_H
+#define ROTORS_GAZEBO_PLUGINS_FLIGHT_RECORDER_H
+
+// SYSTEM
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gazebo {
+
+// Default values
+static constexpr uint64_t kDefaultFlightRecorderSegmentSamples = 100000;
+static constexpr unsigned int kDefaultFlightRecorderSegments = 10;
+
+static constexpr unsigned int kFlightRecorderMaxRotors = 8;
+static constexpr size_t kFlightRecorderNameLength = 256;
+
+/// \brief    The double columns of a flight recorder segment. The position
+///           in the world frame is kept in double, in float it would lose
+///           millimeters a few kilometers away from the origin.
+enum FlightRecorderDoubleColumn {
+  kFrPositionX = 0,
+  kFrPositionY,
+  kFrPositionZ,
+  kFrDoubleColumnCount
+};
+
+/// \brief    The float columns of a flight recorder segment. The orientation
+///           is in the world frame, the velocities as logged by
+///           GazeboBagPlugin. Force and torque are the sum of the contact
+///           wrenches acting on the base link, in its frame.
+enum FlightRecorderColumn {
+  kFrOrientationW = 0,
+  kFrOrientationX,
+  kFrOrientationY,
+  kFrOrientationZ,
+  kFrLinearVelocityX,
+  kFrLinearVelocityY,
+  kFrLinearVelocityZ,
+  kFrAngularVelocityX,
+  kFrAngularVelocityY,
+  kFrAngularVelocityZ,
+  kFrForceX,
+  kFrForceY,
+  kFrForceZ,
+  kFrTorqueX,
+  kFrTorqueY,
+  kFrTorqueZ,
+  kFrRotorSpeed0,
+  kFrColumnCount = kFrRotorSpeed0 + kFlightRecorderMaxRotors
+};
+
+/// \brief    One row of the flight recorder.
+struct FlightRecorderSample {
+  uint64_t time_ns;
+  double double_values[kFrDoubleColumnCount];
+  float values[kFrColumnCount];
+};
+
+/// \brief    Names stored with the recording, so that it converts back to
+///           the topics and frame ids GazeboBagPlugin writes. Longer names
+///           are truncated to kFlightRecorderNameLength - 1 characters.
+struct FlightRecorderNames {
+  std::string robot_namespace;
+  /// \brief    Frame id of the pose and twist.
+  std::string frame_id;
+  /// \brief    Frame id of the force and torque, the base link.
+  std::string wrench_frame_id;
+};
+
+/// \brief    On-disk header of a segment, padded to one page so that the
+///           columns are page aligned.
+struct FlightRecorderHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_rotors;
+  uint32_t num_segments;
+  uint32_t double_column_count;
+  uint32_t column_count;
+  uint64_t sequence;
+  uint64_t capacity;
+  /// \brief    Updated after every sample, so a segment of a killed
+  ///           simulation is readable up to the last complete sample.
+  uint64_t sample_count;
+  /// \brief    Null terminated FlightRecorderNames.
+  char robot_namespace[kFlightRecorderNameLength];
+  char frame_id[kFlightRecorderNameLength];
+  char wrench_frame_id[kFlightRecorderNameLength];
+};
+
+static constexpr size_t kFlightRecorderHeaderSize = 4096;
+
+/// \brief    Writes samples to a ring of memory mapped segment files.
+/// \details  A segment holds a fixed number of samples stored column by
+///           column (time in ns as uint64, then kFrDoubleColumnCount double
+///           and kFrColumnCount float columns), so a reader can load single signals without touching
+///           the rest. Segments are named <base_path>.<slot>.frec. Once
+///           num_segments files are written the oldest one is overwritten,
+///           which bounds the disk usage of endless runs. Writing a sample
+///           is a handful of stores into the mapping; the kernel writes the
+///           pages back in the background. Not thread safe.
+class FlightRecorderWriter {
+ public:
+  FlightRecorderWriter();
+  ~FlightRecorderWriter();
+
+  bool Open(const std::string& base_path, uint64_t segment_samples,
+            unsigned int num_segments, unsigned int num_rotors,
+            const FlightRecorderNames& names);
+  void Close();
+  bool IsOpen() const { return data_ != nullptr; }
+
+  /// \brief    Appends a sample, returns false if no segment could be mapped.
+  bool Write(const FlightRecorderSample& sample);
+
+  uint64_t GetSampleCount() const { return total_samples_; }
+
+ private:
+  bool OpenSegment();
+  void CloseSegment();
+
+  std::string base_path_;
+  uint64_t segment_samples_;
+  unsigned int num_segments_;
+  unsigned int num_rotors_;
+  FlightRecorderNames names_;
+
+  uint64_t sequence_;
+  uint64_t total_samples_;
+
+  int fd_;
+  uint8_t* data_;
+  size_t size_;
+  FlightRecorderHeader* header_;
+  uint64_t* time_column_;
+  double* double_columns_[kFrDoubleColumnCount];
+  float* columns_[kFrColumnCount];
+};
+
+/// \brief    Random access to one segment written by FlightRecorderWriter.
+class FlightRecorderReader {
+ public:
+  FlightRecorderReader();
+  ~FlightRecorderReader();
+
+  bool Open(const std::string& path);
+  void Close();
+
+  uint64_t GetSequence() const { return header_->sequence; }
+  uint64_t GetSampleCount() const { return sample_count_; }
+  unsigned int GetNumRotors() const { return header_->num_rotors; }
+  unsigned int GetNumSegments() const { return header_->num_segments; }
+  FlightRecorderNames GetNames() const;
+
+  const uint64_t* GetTimes() const { return time_column_; }
+  const double* GetDoubleColumn(FlightRecorderDoubleColumn column) const {
+    return double_columns_[column];
+  }
+  const float* GetColumn(FlightRecorderColumn column) const {
+    return columns_[column];
+  }
+
+  void GetSample(uint64_t index, FlightRecorderSample* sample) const;
+
+  /// \brief    Returns the segment files of a recording, oldest first.
+  static std::vector<std::string> ListSegments(const std::string& base_path);
+
+  /// \brief    Name of the segment file in the given ring slot.
+  static std::string SegmentPath(const std::string& base_path, unsigned int slot);
+
+ private:
+  int fd_;
+  const uint8_t* data_;
+  size_t size_;
+  const FlightRecorderHeader* header_;
+  uint64_t sample_count_;
+  const uint64_t* time_column_;
+  const double* double_columns_[kFrDoubleColumnCount];
+  const float* columns_[kFrColumnCount];
+};
+
+}
+
+#endif // ROTORS_GAZEBO_PLUGINS_FLIGHT_RECORDER_H
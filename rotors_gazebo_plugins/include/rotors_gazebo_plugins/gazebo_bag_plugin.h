@@ -23,7 +23,10 @@
 #ifndef ROTORS_GAZEBO_PLUGINS_GAZEBO_BAG_PLUGIN_H
 #define ROTORS_GAZEBO_PLUGINS_GAZEBO_BAG_PLUGIN_H
 
+#include <atomic>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <gazebo/common/common.hh>
 #include <gazebo/common/Plugin.hh>
@@ -45,7 +48,9 @@
 
 #include "rotors_comm/RecordRosbag.h"
 #include "rotors_comm/WindSpeed.h"
+#include "rotors_gazebo_plugins/async_bag_writer.h"
 #include "rotors_gazebo_plugins/common.h"
+#include "rotors_gazebo_plugins/flight_recorder.h"
 
 
 namespace gazebo {
@@ -57,6 +62,15 @@ static const std::string kDefaultBagFilename_ = "simulator.bag";
 static const std::string kDefaultRecordingServiceName = "record_rosbag";
 static constexpr bool kDefaultWaitToRecord = false;
 static constexpr bool kDefaultIsRecording = false;
+static const std::string kDefaultWriterOverflowPolicy = "drop";
+static const std::string kDefaultBagCompression = "none";
+static constexpr int kDefaultLogDecimation = 1;
+static constexpr bool kDefaultMotorLogOnChange = false;
+static constexpr double kDefaultMotorChangeThreshold = 0.0;
+static constexpr double kDefaultPreTriggerDuration = 0.0;
+static constexpr double kDefaultPostTriggerDuration = 5.0;
+static constexpr double kDefaultTriggerCollisionForce = 0.0;
+static constexpr double kDefaultTriggerAttitudeLimit = 0.0;
 
 /// \brief    This plugin is used to create rosbag files from within gazebo.
 /// \details  This plugin is ROS dependent, and is not built if NO_ROS=TRUE is provided to
@@ -87,10 +101,24 @@ class GazeboBagPlugin : public ModelPlugin {
         bag_filename_(kDefaultBagFilename_),
         recording_service_name_(kDefaultRecordingServiceName),
         rotor_velocity_slowdown_sim_(kDefaultRotorVelocitySlowdownSim),
+        ground_truth_decimation_(kDefaultLogDecimation),
+        motor_decimation_(kDefaultLogDecimation),
+        wrench_decimation_(kDefaultLogDecimation),
+        motor_log_on_change_(kDefaultMotorLogOnChange),
+        motor_change_threshold_(kDefaultMotorChangeThreshold),
+        flight_recorder_segment_samples_(kDefaultFlightRecorderSegmentSamples),
+        flight_recorder_segments_(kDefaultFlightRecorderSegments),
+        update_counter_(0),
+        post_trigger_duration_(kDefaultPostTriggerDuration),
+        trigger_collision_force_(kDefaultTriggerCollisionForce),
+        trigger_attitude_limit_(kDefaultTriggerAttitudeLimit),
+        trigger_requested_(false),
+        rearmed_bag_count_(0),
         wait_to_record_(kDefaultWaitToRecord),
         is_recording_(kDefaultIsRecording),
         node_handle_(nullptr),
-        contact_mgr_(nullptr) {}
+        contact_mgr_(nullptr),
+        profiler_entry_(nullptr) {}
 
   virtual ~GazeboBagPlugin();
 
@@ -154,6 +182,25 @@ class GazeboBagPlugin : public ModelPlugin {
   /// \param[in] now The current gazebo common::Time
   void LogWrenches(const common::Time now);
 
+  /// \brief Log pose, twist, motor velocities and the contact wrench on the
+  ///        base link as one flight recorder sample.
+  /// \param[in] now The current gazebo common::Time
+  void LogFlightRecorderSample(const common::Time now);
+
+  /// \brief Fire the trigger if a trigger condition holds, and start a new
+  ///        pre-trigger recording once the post-trigger window has passed.
+  /// \param[in] now The current gazebo common::Time
+  void CheckTriggers(const common::Time now);
+
+  /// \brief Calls callback(own_link, other_link, force, torque) for every
+  ///        contact of one of this model's links, with the wrench acting on
+  ///        the own link.
+  template<class F>
+  void ForEachOwnContact(F callback);
+
+  /// \brief Print the size of the bag and the bytes written per topic.
+  void PrintBagStatistics();
+
   /// \brief Called when a request to start or stop recording is received.
   /// \param[in] req The request to start or stop recording.
   /// \param[out] res The response to be sent back to the client.
@@ -164,6 +211,8 @@ class GazeboBagPlugin : public ModelPlugin {
   /// \brief Pointer to the update event connection.
   event::ConnectionPtr update_connection_;
 
+  PluginProfilerEntry* profiler_entry_;
+
   physics::WorldPtr world_;
   physics::ModelPtr model_;
   physics::LinkPtr link_;
@@ -176,6 +225,14 @@ class GazeboBagPlugin : public ModelPlugin {
   ///           link and its children.
   physics::ContactManager *contact_mgr_;
 
+  /// \brief    Ids of this link and its children, to pick this model's
+  ///           contacts out of all contacts of the world.
+  std::unordered_set<uint32_t> link_ids_;
+
+  /// \brief    Frame ids of the wrench messages, keyed by the ids of the
+  ///           two links in contact.
+  std::unordered_map<uint64_t, std::string> contact_frame_ids_;
+
   std::string namespace_;
   std::string ground_truth_pose_topic_;
   std::string ground_truth_twist_topic_;
@@ -195,8 +252,69 @@ class GazeboBagPlugin : public ModelPlugin {
   std::string recording_service_name_;
   double rotor_velocity_slowdown_sim_;
 
-  /// \brief Mutex lock for thread safety of writing bag files
-  boost::mutex mtx_;
+  /// \brief Topic names in the bag, i.e. prefixed with the namespace. Built
+  ///        once in Load() rather than on every logged message.
+  struct {
+    std::string ground_truth_pose;
+    std::string ground_truth_twist;
+    std::string imu;
+    std::string external_force;
+    std::string waypoint;
+    std::string command_pose;
+    std::string control_attitude_thrust;
+    std::string control_motor_speed;
+    std::string control_rate_thrust;
+    std::string wind_speed;
+    std::string wrench;
+    std::string motor;
+  } bag_topics_;
+
+  /// \brief Messages of the physics rate streams, reused on every update.
+  geometry_msgs::PoseStamped pose_msg_;
+  geometry_msgs::TwistStamped twist_msg_;
+  geometry_msgs::WrenchStamped wrench_msg_;
+  mav_msgs::Actuators rot_velocities_msg_;
+
+  /// \brief Queue, overflow, compression and chunk settings of the bag.
+  AsyncBagWriterOptions writer_options_;
+
+  /// \brief Log the ground truth, motor velocities and wrenches only every
+  ///        n-th physics update.
+  int ground_truth_decimation_;
+  int motor_decimation_;
+  int wrench_decimation_;
+
+  /// \brief Only log the motor velocities if one of them changed by more
+  ///        than motor_change_threshold_ [rad/s] since it was last logged.
+  bool motor_log_on_change_;
+  double motor_change_threshold_;
+  std::vector<double> last_motor_velocities_;
+
+  /// \brief If set, the ground truth, motor velocities and wrenches are
+  ///        written to a flight recorder at <path>_<date>.<slot>.frec instead
+  ///        of the bag, on every physics update.
+  std::string flight_recorder_path_;
+  int flight_recorder_segment_samples_;
+  int flight_recorder_segments_;
+  FlightRecorderWriter flight_recorder_;
+
+  /// \brief Number of physics updates since recording started.
+  uint64_t update_counter_;
+
+  /// \brief With a pre-trigger duration (writer_options_), messages are held
+  ///        in memory and only written once a trigger fires: a contact force
+  ///        above trigger_collision_force_ [N], a tilt above
+  ///        trigger_attitude_limit_ [rad] or a RecordRosbag call with trigger
+  ///        set. Recording continues for post_trigger_duration_ [s], then a
+  ///        new bag is armed. Zero disables a trigger condition.
+  double post_trigger_duration_;
+  double trigger_collision_force_;
+  double trigger_attitude_limit_;
+  common::Time trigger_time_;
+  std::atomic<bool> trigger_requested_;
+  /// \brief Number of bags armed after a post-trigger window, appended to
+  ///        their filenames.
+  int rearmed_bag_count_;
 
   /// \brief Whether the plugin should wait for user command to start recording
   bool wait_to_record_;
@@ -204,7 +322,9 @@ class GazeboBagPlugin : public ModelPlugin {
   /// \brief Whether the plugin is currenly recording a rosbag
   bool is_recording_;
 
-  rosbag::Bag bag_;
+  /// \brief Writes the bag on its own thread, so that disk I/O does not
+  ///        block the simulation.
+  AsyncBagWriter bag_writer_;
   ros::NodeHandle *node_handle_;
 
   // Ros subscribers
@@ -224,40 +344,7 @@ class GazeboBagPlugin : public ModelPlugin {
 
   template<class T>
   void writeBag(const std::string& topic, const ros::Time& time, const T& msg) {
-    boost::mutex::scoped_lock lock(mtx_);
-    try {
-      bag_.write(topic, time, msg);
-    }
-    catch (rosbag::BagIOException& e) {
-      gzerr << "Error while writing to bag " << e.what() << std::endl;
-    }
-    catch (rosbag::BagException& e) {
-      if (time < ros::TIME_MIN) {
-        gzerr<<"Header stamp not set for msg published on topic: "<< topic << ". " << e.what() << std::endl;
-      }
-      else {
-        gzerr << "Error while writing to bag " << e.what() << std::endl;
-      }
-    }
-  }
-
-  template<class T>
-  void writeBag(const std::string& topic, const ros::Time& time, boost::shared_ptr<T const> const& msg) {
-    boost::mutex::scoped_lock lock(mtx_);
-    try {
-      bag_.write(topic, time, msg);
-    }
-    catch (rosbag::BagIOException& e) {
-      gzerr << "Error while writing to bag " << e.what() << std::endl;
-    }
-    catch (rosbag::BagException& e) {
-      if (time < ros::TIME_MIN) {
-        gzerr<<"Header stamp not set for msg published on topic: "<< topic << ". " << e.what() << std::endl;
-      }
-      else {
-        gzerr << "Error while writing to bag " << e.what() << std::endl;
-      }
-    }
+    bag_writer_.Write(topic, time, msg);
   }
 
 };
@@ -57,7 +57,8 @@ class GazeboControllerInterface : public ModelPlugin {
         motor_velocity_reference_pub_topic_(kDefaultMotorVelocityReferenceTopic),
         command_motor_speed_sub_topic_(mav_msgs::default_topics::COMMAND_ACTUATORS),
         //---------------
-        node_handle_(NULL){}
+        node_handle_(NULL),
+        profiler_entry_(nullptr) {}
   ~GazeboControllerInterface();
 
   void InitializeParams();
@@ -103,6 +104,8 @@ class GazeboControllerInterface : public ModelPlugin {
   /// \brief Pointer to the update event connection.
   event::ConnectionPtr updateConnection_;
 
+  PluginProfilerEntry* profiler_entry_;
+
   boost::thread callback_queue_thread_;
 
   void QueueThread();
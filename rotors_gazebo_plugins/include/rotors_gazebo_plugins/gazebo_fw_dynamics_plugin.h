@@ -117,6 +117,8 @@ class GazeboFwDynamicsPlugin : public ModelPlugin {
   /// \brief    Pointer to the update event connection.
   event::ConnectionPtr updateConnection_;
 
+  PluginProfilerEntry* profiler_entry_;
+
   /// \brief    Most current wind speed reading [m/s].
   math::Vector3 W_wind_speed_W_B_;
 
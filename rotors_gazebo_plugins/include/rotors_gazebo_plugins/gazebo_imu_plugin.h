@@ -22,8 +22,6 @@
 #ifndef ROTORS_GAZEBO_PLUGINS_IMU_PLUGIN_H
 #define ROTORS_GAZEBO_PLUGINS_IMU_PLUGIN_H
 
-#include <random>
-
 #include <Eigen/Core>
 #include <gazebo/common/common.hh>
 #include <gazebo/common/Plugin.hh>
@@ -33,67 +31,10 @@
 #include "Imu.pb.h"
 
 #include "rotors_gazebo_plugins/common.h"
+#include "rotors_gazebo_plugins/imu_noise_model.h"
 
 namespace gazebo {
 
-// Default values for use with ADIS16448 IMU
-static constexpr double kDefaultAdisGyroscopeNoiseDensity =
-    2.0 * 35.0 / 3600.0 / 180.0 * M_PI;
-static constexpr double kDefaultAdisGyroscopeRandomWalk =
-    2.0 * 4.0 / 3600.0 / 180.0 * M_PI;
-static constexpr double kDefaultAdisGyroscopeBiasCorrelationTime =
-    1.0e+3;
-static constexpr double kDefaultAdisGyroscopeTurnOnBiasSigma =
-    0.5 / 180.0 * M_PI;
-static constexpr double kDefaultAdisAccelerometerNoiseDensity =
-    2.0 * 2.0e-3;
-static constexpr double kDefaultAdisAccelerometerRandomWalk =
-    2.0 * 3.0e-3;
-static constexpr double kDefaultAdisAccelerometerBiasCorrelationTime =
-    300.0;
-static constexpr double kDefaultAdisAccelerometerTurnOnBiasSigma =
-    20.0e-3 * 9.8;
-// Earth's gravity in Zurich (lat=+47.3667degN, lon=+8.5500degE, h=+500m, WGS84)
-static constexpr double kDefaultGravityMagnitude = 9.8068;
-
-// A description of the parameters:
-// https://github.com/ethz-asl/kalibr/wiki/IMU-Noise-Model-and-Intrinsics
-// TODO(burrimi): Should I have a minimalistic description of the params here?
-struct ImuParameters {
-  /// Gyroscope noise density (two-sided spectrum) [rad/s/sqrt(Hz)]
-  double gyroscope_noise_density;
-  /// Gyroscope bias random walk [rad/s/s/sqrt(Hz)]
-  double gyroscope_random_walk;
-  /// Gyroscope bias correlation time constant [s]
-  double gyroscope_bias_correlation_time;
-  /// Gyroscope turn on bias standard deviation [rad/s]
-  double gyroscope_turn_on_bias_sigma;
-  /// Accelerometer noise density (two-sided spectrum) [m/s^2/sqrt(Hz)]
-  double accelerometer_noise_density;
-  /// Accelerometer bias random walk. [m/s^2/s/sqrt(Hz)]
-  double accelerometer_random_walk;
-  /// Accelerometer bias correlation time constant [s]
-  double accelerometer_bias_correlation_time;
-  /// Accelerometer turn on bias standard deviation [m/s^2]
-  double accelerometer_turn_on_bias_sigma;
-  /// Norm of the gravitational acceleration [m/s^2]
-  double gravity_magnitude;
-
-  ImuParameters()
-      : gyroscope_noise_density(kDefaultAdisGyroscopeNoiseDensity),
-        gyroscope_random_walk(kDefaultAdisGyroscopeRandomWalk),
-        gyroscope_bias_correlation_time(
-            kDefaultAdisGyroscopeBiasCorrelationTime),
-        gyroscope_turn_on_bias_sigma(kDefaultAdisGyroscopeTurnOnBiasSigma),
-        accelerometer_noise_density(kDefaultAdisAccelerometerNoiseDensity),
-        accelerometer_random_walk(kDefaultAdisAccelerometerRandomWalk),
-        accelerometer_bias_correlation_time(
-            kDefaultAdisAccelerometerBiasCorrelationTime),
-        accelerometer_turn_on_bias_sigma(
-            kDefaultAdisAccelerometerTurnOnBiasSigma),
-        gravity_magnitude(kDefaultGravityMagnitude) {}
-};
-
 class GazeboImuPlugin : public ModelPlugin {
  public:
 
@@ -141,9 +82,6 @@ class GazeboImuPlugin : public ModelPlugin {
   std::string frame_id_;
   std::string link_name_;
 
-  std::default_random_engine random_generator_;
-  std::normal_distribution<double> standard_normal_distribution_;
-
   /// \brief    Pointer to the world.
   physics::WorldPtr world_;
 
@@ -156,6 +94,8 @@ class GazeboImuPlugin : public ModelPlugin {
   /// \brief    Pointer to the update event connection.
   event::ConnectionPtr updateConnection_;
 
+  PluginProfilerEntry* profiler_entry_;
+
   common::Time last_time_;
 
   /// \brief    IMU message.
@@ -166,13 +106,10 @@ class GazeboImuPlugin : public ModelPlugin {
   math::Vector3 gravity_W_;
   math::Vector3 velocity_prev_W_;
 
-  Eigen::Vector3d gyroscope_bias_;
-  Eigen::Vector3d accelerometer_bias_;
-
-  Eigen::Vector3d gyroscope_turn_on_bias_;
-  Eigen::Vector3d accelerometer_turn_on_bias_;
-
   ImuParameters imu_parameters_;
+
+  /// \brief    Noise of the measurements, see ImuNoiseModel.
+  ImuNoiseModel imu_noise_model_;
 };
 
 }  // namespace gazebo
@@ -81,6 +81,8 @@ class GazeboMagnetometerPlugin : public ModelPlugin {
   //// \brief    Pointer to the update event connection.
   event::ConnectionPtr updateConnection_;
 
+  PluginProfilerEntry* profiler_entry_;
+
   math::Vector3 mag_W_;
 
   /// \brief    Magnetic field message.
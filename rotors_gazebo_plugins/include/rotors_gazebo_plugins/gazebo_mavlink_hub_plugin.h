@@ -0,0 +1,89 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROTORS_GAZEBO_PLUGINS_GAZEBO_MAVLINK_HUB_PLUGIN_H
+#define ROTORS_GAZEBO_PLUGINS_GAZEBO_MAVLINK_HUB_PLUGIN_H
+
+#include <map>
+#include <string>
+
+#include <gazebo/common/common.hh>
+#include <gazebo/common/Plugin.hh>
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+
+#include "rotors_gazebo_plugins/common.h"
+#include "rotors_gazebo_plugins/mavlink_hub.h"
+
+#include "MavlinkHubStats.pb.h"
+
+namespace gazebo {
+
+// Default values
+static const std::string kDefaultMavlinkHubStatsPubTopic = "mavlink_hub/stats";
+static constexpr double kDefaultMavlinkHubStatsInterval = 1.0;
+
+/// \brief    World plugin which services the MAVLink sockets of all vehicles.
+/// \details  Starts the MavlinkHub, so that every GazeboMavlinkInterface loaded
+///           afterwards talks to the autopilot on port
+///           base_port + vehicle_index through one shared epoll thread instead
+///           of its own hardcoded mavlink_udp_port. Per-vehicle link
+///           statistics are published on a Gazebo topic once per
+///           statsInterval (wall time) and summarized at shutdown.
+class GazeboMavlinkHubPlugin : public WorldPlugin {
+ public:
+  GazeboMavlinkHubPlugin()
+      : WorldPlugin(),
+        stats_pub_topic_(kDefaultMavlinkHubStatsPubTopic),
+        stats_interval_(kDefaultMavlinkHubStatsInterval) {}
+  virtual ~GazeboMavlinkHubPlugin();
+
+ protected:
+  void Load(physics::WorldPtr _world, sdf::ElementPtr _sdf);
+  void OnUpdate(const common::UpdateInfo& /*_info*/);
+
+ private:
+  /// \brief    Fills and publishes the statistics message and starts a new
+  ///           round-trip measurement.
+  void PublishStats(const common::Time& now);
+
+  std::string stats_pub_topic_;
+  double stats_interval_;
+
+  physics::WorldPtr world_;
+
+  transport::NodePtr node_handle_;
+  transport::PublisherPtr stats_pub_;
+
+  /// \brief    Pointer to the update event connection.
+  event::ConnectionPtr update_connection_;
+
+  common::Time last_stats_time_;
+
+  /// \brief    Counters at the last publication, by vehicle index, used to
+  ///           compute rates.
+  std::map<unsigned, MavlinkLinkCounters> last_counters_;
+
+  gz_mav_msgs::MavlinkHubStats stats_msg_;
+};
+
+} // namespace gazebo
+
+#endif // ROTORS_GAZEBO_PLUGINS_GAZEBO_MAVLINK_HUB_PLUGIN_H
@@ -18,6 +18,8 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <math.h>
 #include <deque>
@@ -39,6 +41,10 @@
 #include "common/mavlink.h"     // Either provided by ROS or as CMake argument MAVLINK_HEADER_DIR
 
 #include "common.h"
+#include "geodetic_converter.h"
+#include "mavlink_hub.h"
+#include "mavlink_log.h"
+#include "sensor_stream_scheduler.h"
 //#include "mavlink/v1.0/common/mavlink.h"
 
 #include "CommandMotorSpeed.pb.h"
@@ -51,6 +57,30 @@ static const uint8_t mavlink_message_crcs[256] = MAVLINK_MESSAGE_CRCS;
 
 static const uint32_t kDefaultMavlinkUdpPort = 14560;
 
+/// \brief    Distance (in meters) the vehicle has to travel before the
+///           magnetic declination is looked up again.
+static constexpr double kDefaultMagDeclinationUpdateDistance = 1000.0;
+
+// Default stream rates [Hz], zero means every IMU message.
+static constexpr double kDefaultImuStreamRate = 0.0;
+static constexpr double kDefaultMagStreamRate = 0.0;
+static constexpr double kDefaultBaroStreamRate = 0.0;
+static constexpr double kDefaultAirspeedStreamRate = 0.0;
+static constexpr double kDefaultHilStateStreamRate = 0.0;
+static constexpr double kDefaultGpsStreamRate = 5.0;
+
+// HIL_SENSOR fields_updated bits.
+static constexpr uint32_t kHilSensorAccel = 0x7;
+static constexpr uint32_t kHilSensorGyro = 0x7 << 3;
+static constexpr uint32_t kHilSensorMag = 0x7 << 6;
+static constexpr uint32_t kHilSensorAbsPressure = 1 << 9;
+static constexpr uint32_t kHilSensorDiffPressure = 1 << 10;
+static constexpr uint32_t kHilSensorPressureAlt = 1 << 11;
+static constexpr uint32_t kHilSensorTemperature = 1 << 12;
+
+static constexpr float kDefaultMagNoiseStdDev = 0.01f;
+static constexpr float kDefaultBaroAltNoiseStdDev = 0.0774597f;  // sqrt(0.006)
+
 namespace gazebo {
 
 typedef const boost::shared_ptr<const gz_mav_msgs::CommandMotorSpeed> CommandMotorSpeedPtr;
@@ -96,7 +126,16 @@ class GazeboMavlinkInterface : public ModelPlugin {
         input_index_{},
         lat_rad_(0.0),
         lon_rad_(0.0),
-        mavlink_udp_port_(kDefaultMavlinkUdpPort)
+        alt_m_(0.0),
+        mag_declination_valid_(false),
+        mag_declination_update_distance_(kDefaultMagDeclinationUpdateDistance),
+        mag_noise_distribution_(0.0f, kDefaultMagNoiseStdDev),
+        baro_alt_noise_distribution_(0.0f, kDefaultBaroAltNoiseStdDev),
+        mavlink_udp_port_(kDefaultMavlinkUdpPort),
+        mavlink_vehicle_index_(-1),
+        replay_mode_(false),
+        replay_index_(0),
+        profiler_entry_(nullptr)
         {}
   ~GazeboMavlinkInterface();
 
@@ -144,6 +183,8 @@ class GazeboMavlinkInterface : public ModelPlugin {
   /// \brief Pointer to the update event connection.
   event::ConnectionPtr updateConnection_;
 
+  PluginProfilerEntry* profiler_entry_;
+
   boost::thread callback_queue_thread_;
   void QueueThread();
   void ImuCallback(ImuPtr& imu_msg);
@@ -153,6 +194,10 @@ class GazeboMavlinkInterface : public ModelPlugin {
   void handle_message(mavlink_message_t *msg);
   void pollForMAVLinkMessages(double _dt, uint32_t _timeoutMs);
 
+  /// \brief    Feeds all recorded actuator messages up to current_time to
+  ///           handle_message(), replacing the autopilot in replay mode.
+  void replayMAVLinkMessages(const common::Time& current_time);
+
   static const unsigned kNOutMax = 16;
 
   unsigned rotor_count_;
@@ -175,19 +220,49 @@ class GazeboMavlinkInterface : public ModelPlugin {
   std::string opticalFlow_sub_topic_;
   
   common::Time last_time_;
-  common::Time last_gps_time_;
   common::Time last_actuator_time_;
-  double gps_update_interval_;
+
+  /// \brief    Sim-time schedules of the emitted sensor streams, configured
+  ///           by <stream>_rate, <stream>_phase and <stream>_jitter. The IMU,
+  ///           mag, baro and airspeed streams set their bits in the
+  ///           fields_updated mask of HIL_SENSOR, which is only sent if at
+  ///           least one of them is due.
+  SensorStreamScheduler imu_scheduler_;
+  SensorStreamScheduler mag_scheduler_;
+  SensorStreamScheduler baro_scheduler_;
+  SensorStreamScheduler airspeed_scheduler_;
+  SensorStreamScheduler hil_state_scheduler_;
+  SensorStreamScheduler gps_scheduler_;
   double lat_rad_;
   double lon_rad_;
+  double alt_m_;
   void handle_control(double _dt);
 
+  /// \brief    Projects the Gazebo world frame (ENU) onto WGS84 coordinates
+  ///           around the home position.
+  GeodeticConverter geodetic_converter_;
+
+  /// \brief    Returns the magnetic field in the NED frame, re-evaluating the
+  ///           declination lookup only once the vehicle has moved further than
+  ///           mag_declination_update_distance_ since the last lookup.
+  const math::Vector3& GetMagFieldNed(const math::Vector3& pos_W);
+
   math::Vector3 gravity_W_;
   math::Vector3 velocity_prev_W_;
   math::Vector3 mag_d_;
 
-  std::default_random_engine random_generator_;
-  std::normal_distribution<float> standard_normal_distribution_;
+  /// \brief    Cached magnetic field in the NED frame, rotated by the
+  ///           declination at last_declination_pos_W_.
+  math::Vector3 mag_n_;
+  math::Vector3 last_declination_pos_W_;
+  bool mag_declination_valid_;
+  double mag_declination_update_distance_;
+
+  /// \brief    Per-plugin random number generator. Seeded from the <seed> SDF
+  ///           element so that the HIL sensor noise is reproducible.
+  std::mt19937 random_generator_;
+  std::normal_distribution<float> mag_noise_distribution_;
+  std::normal_distribution<float> baro_alt_noise_distribution_;
 
   int fd_;
   struct sockaddr_in myaddr_;  ///< The locally bound address
@@ -207,5 +282,24 @@ class GazeboMavlinkInterface : public ModelPlugin {
   in_addr_t mavlink_addr_;
   int mavlink_udp_port_;
 
+  /// \brief    Index of this vehicle at the MAVLink hub, -1 lets the hub
+  ///           pick the lowest free one. Only used if a hub is running.
+  int mavlink_vehicle_index_;
+
+  /// \brief    Link to the autopilot provided by GazeboMavlinkHubPlugin. If
+  ///           null, the plugin uses its own socket (fd_).
+  std::shared_ptr<MavlinkHubLink> mavlink_hub_link_;
+  std::vector<mavlink_message_t> received_messages_;
+
+  /// \brief    Records inbound and outbound MAVLink traffic if
+  ///           <mavlink_log_file> is given.
+  MavlinkLogWriter mavlink_log_writer_;
+
+  /// \brief    If true (<mavlink_replay_file> is given), no socket is opened
+  ///           and the actuator commands come from replay_records_.
+  bool replay_mode_;
+  std::vector<MavlinkLogRecord> replay_records_;
+  size_t replay_index_;
+
   };
 }
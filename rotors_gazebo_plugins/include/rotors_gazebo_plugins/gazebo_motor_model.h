@@ -88,7 +88,8 @@ class GazeboMotorModel : public MotorModel, public ModelPlugin {
         time_constant_up_(kDefaultTimeConstantUp),
         node_handle_(nullptr),
         wind_speed_W_(0, 0, 0),
-        pubs_and_subs_created_(false) {}
+        pubs_and_subs_created_(false),
+        profiler_entry_(nullptr) {}
 
   virtual ~GazeboMotorModel();
 
@@ -148,6 +149,8 @@ class GazeboMotorModel : public MotorModel, public ModelPlugin {
   /// \brief Pointer to the update event connection.
   event::ConnectionPtr updateConnection_;
 
+  PluginProfilerEntry* profiler_entry_;
+
   boost::thread callback_queue_thread_;
 
   void QueueThread();
@@ -58,7 +58,8 @@ class GazeboMultirotorBasePlugin : public ModelPlugin {
         frame_id_(kDefaultFrameId),
         rotor_velocity_slowdown_sim_(kDefaultRotorVelocitySlowdownSim),
         node_handle_(NULL),
-        pubs_and_subs_created_(false) {}
+        pubs_and_subs_created_(false),
+        profiler_entry_(nullptr) {}
 
   virtual ~GazeboMultirotorBasePlugin();
 
@@ -88,6 +89,8 @@ class GazeboMultirotorBasePlugin : public ModelPlugin {
   /// \brief Pointer to the update event connection.
   event::ConnectionPtr update_connection_;
 
+  PluginProfilerEntry* profiler_entry_;
+
   physics::WorldPtr world_;
   physics::ModelPtr model_;
   physics::LinkPtr link_;
@@ -22,19 +22,34 @@
 #ifndef ROTORS_GAZEBO_PLUGINS_GAZEBO_OCTOMAP_PLUGIN_H
 #define ROTORS_GAZEBO_PLUGINS_GAZEBO_OCTOMAP_PLUGIN_H
 
+#include <atomic>
 #include <iostream>
 #include <math.h>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include <rotors_gazebo_plugins/common.h>
 #include <gazebo/common/common.hh>
 #include <gazebo/gazebo.hh>
 #include <gazebo/physics/physics.hh>
 #include <octomap/octomap.h>
+#include <octomap_msgs/Octomap.h>
 #include <ros/ros.h>
 #include <rotors_comm/Octomap.h>
+#include <rotors_comm/OctomapProgress.h>
 #include <sdf/sdf.hh>
+#include <sensor_msgs/PointCloud2.h>
 #include <std_srvs/Empty.h>
 
+#include "rotors_gazebo_plugins/voxel_grid.h"
+#include "rotors_gazebo_plugins/voxelizer.h"
+
 namespace gazebo {
 
 /// \brief    Octomap plugin for Gazebo.
@@ -43,7 +58,21 @@ namespace gazebo {
 class OctomapFromGazeboWorld : public WorldPlugin {
  public:
   OctomapFromGazeboWorld()
-      : WorldPlugin(), node_handle_(kDefaultNamespace), octomap_(NULL) {}
+      : WorldPlugin(),
+        node_handle_(kDefaultNamespace),
+        occupancy_backend_("rays"),
+        coarse_to_fine_(true),
+        num_threads_(0),
+        incremental_updates_(false),
+        can_update_(false),
+        cache_size_(4),
+        octomap_hash_(0),
+        cache_hits_(0),
+        cache_misses_(0),
+        distance_field_enabled_(false),
+        async_running_(false),
+        cancel_requested_(false),
+        publish_updates_(false) {}
   virtual ~OctomapFromGazeboWorld();
 
  protected:
@@ -57,37 +86,286 @@ class OctomapFromGazeboWorld : public WorldPlugin {
                        gazebo::physics::RayShapePtr ray,
                        const double leaf_size);
 
-  void FloodFill(const math::Vector3& seed_point,
-                 const math::Vector3& bounding_box_origin,
-                 const math::Vector3& bounding_box_lengths,
-                 const double leaf_size);
-  
+  /// \brief    Marks the cells first <= (x, y, z) <= last of the grid hit
+  ///           by the rays of CheckIfInterest, slab by slab along X.
+  /// \details  Physics is held while the rays are cast, which the ray shapes
+  ///           of ODE require anyway, so the rays are cast from the calling
+  ///           thread only.
+  void RasterizeWithRays(const Eigen::Vector3i& first,
+                         const Eigen::Vector3i& last, VoxelGrid* occupied);
+
+  /// \brief    Marks the cells first <= (x, y, z) <= last of the grid that
+  ///           overlap a collision shape of the world, split into slabs
+  ///           along Z, see VoxelizePrimitives.
+  /// \return   The number of threads used.
+  int RasterizeCollisionGeometry(int num_threads, const Eigen::Vector3i& first,
+                                 const Eigen::Vector3i& last,
+                                 VoxelGrid* occupied);
+
+  /// \brief    Replaces the octree by one in which the free cells of the
+  ///           grid are free and the rest is occupied. Uniform blocks that
+  ///           fill an octree node are stored as one leaf.
+  void BuildOctomapFromGrid(const VoxelGrid& free_space);
+
+  /// \brief    Appends the collision shapes of an entity and its children
+  ///           in the world frame.
+  void GetCollisionPrimitives(const physics::BasePtr& entity,
+                              std::vector<CollisionPrimitive>* primitives);
+
+  /// \brief    Converts a box, sphere, cylinder, mesh or plane collision.
+  /// \return   False for any other shape.
+  bool GetCollisionPrimitive(const physics::CollisionPtr& collision,
+                             CollisionPrimitive* primitive);
+
+  /// \brief    Pose and bounding box of a model, to detect the models that
+  ///           changed between two requests.
+  struct ModelState {
+    math::Pose pose;
+    math::Box bounding_box;
+  };
+
+  void GetModelStates(std::map<std::string, ModelState>* model_states);
+
+  /// \brief    Appends the bounding boxes of the models that appeared, moved
+  ///           or disappeared between before_states and model_states. A
+  ///           moved model gets one box over its old and new bounding box.
+  static void GetChangedModelBoxes(
+      const std::map<std::string, ModelState>& before_states,
+      const std::map<std::string, ModelState>& model_states,
+      std::vector<math::Box>* changed_boxes);
+
+  /// \brief    Updates the octree of the last request in the bounding boxes
+  ///           of the models that appeared, moved or disappeared since.
+  /// \return   False if too much changed, then a new octree is faster.
+  bool UpdateOctomap(int num_threads);
+
+  /// \brief    Rebuilds the cells first <= (x, y, z) <= last of the octree
+  ///           from the rasterized cells, flood filling them from the free
+  ///           space around them.
+  void UpdateRegion(const Eigen::Vector3i& first, const Eigen::Vector3i& last,
+                    int num_threads);
+
+  /// \brief    Appends the name and a hash of the shape and pose of the
+  ///           collisions of an entity and its children.
+  void HashCollisions(const physics::BasePtr& entity,
+                      std::vector<std::pair<std::string, uint64_t> >* hashes);
+
+  /// \brief    Hash of the collisions of the static models of the world,
+  ///           the occupancy backend and the bounding box and leaf size of
+  ///           the request, which together determine the octomap of the
+  ///           static world.
+  uint64_t HashWorldGeometry(const rotors_comm::Octomap::Request& msg);
+
+  /// \brief    File of an octomap in cacheDirectory.
+  std::string CachePath(uint64_t hash) const;
+
+  /// \brief    Makes the octomap with the hash the current one, if it is the
+  ///           current one already, in the memory cache or in
+  ///           cacheDirectory. Octomaps in memory only match if the models
+  ///           are also where they were when it was built, the files do not
+  ///           know the models.
+  /// \return   False if it has to be built or updated.
+  bool GetCachedOctomap(uint64_t hash,
+                        const std::map<std::string, ModelState>& model_states);
+
+  /// \brief    Stores the current octomap in the memory cache and, if
+  ///           write_file is set, in cacheDirectory.
+  void CacheOctomap(uint64_t hash, bool write_file);
+
+  /// \brief    Builds a new octree, see CreateOctomap.
+  void BuildOctomap(const rotors_comm::Octomap::Request& msg, int num_threads);
+
+  /// \brief    Publishes the progress of the build, and with
+  ///           publish_updates_ the occupied cells of a slab that was just
+  ///           rasterized. Called from the rasterizing threads.
+  void PublishSlab(double progress, const Eigen::Vector3i* cells,
+                   size_t num_cells, const VoxelGrid& grid);
+
+  void PublishProgress(double progress, bool done, bool cancelled);
+
+  /// \brief    Saves and serializes the current octomap as requested, and
+  ///           publishes it if req.publish_octomap is set.
+  void PublishOctomap(const rotors_comm::Octomap::Request& req,
+                      octomap_msgs::Octomap* map);
+
+  /// \brief    Indices of the cells of side length cell_size that contain an
+  ///           occupied leaf of the current octree, cell i is centered at
+  ///           (i + 0.5) * cell_size. cell_size is the resolution rounded up
+  ///           to the leaf size times a power of two, the leaf size if the
+  ///           resolution is 0. Larger leaves are split into cells.
+  void GetOccupiedCells(double resolution, double* cell_size,
+                        std::vector<Eigen::Vector3i>* cells);
+
+  /// \brief    Saves and publishes the occupied cells of the current octree
+  ///           as a point cloud and a voxel mesh, as requested.
+  void ExportOccupiedCells(const rotors_comm::Octomap::Request& req);
+
+  /// \brief    Runs an async request on async_thread_.
+  void BuildOctomapAsync(rotors_comm::Octomap::Request req);
+
   /*! \brief Creates octomap by floodfilling freespace.
   *
   * Creates an octomap of the environment in 3 steps:
-  *   -# Casts rays along the central X,Y and Z axis of each cell. Marks any 
-  *     cell where a ray intersects a mesh as occupied
+  *   -# Marks the occupied cells with the occupancy backend (occupancyBackend):
+  *     - "rays" casts rays along the central X,Y and Z axis of each cell. Marks
+  *       any cell where a ray intersects a mesh as occupied. The rays are
+  *       cast slab by slab along X from a single thread while physics is
+  *       held, since ODE collides rays with one shared collision space.
+  *     - "collision" reads the box, sphere, cylinder, mesh and plane collision
+  *       shapes of the world and marks every cell that overlaps one, using
+  *       separating axis tests. Boxes, spheres and cylinders are filled solid,
+  *       walls thinner than a cell are kept. The volume is split into slabs
+  *       along Z, processed in parallel by msg.num_threads (or numThreads)
+  *       threads from a copy of the shapes. With coarseToFine
+  *       (default), whole blocks of cells outside or inside a shape are
+  *       handled at once and only blocks on its surface are subdivided.
   *   -# Floodfills the area from the top and bottom marking all connected
-  *     space that has not been set to occupied as free.
-  *   -# Labels all remaining unknown space as occupied.
+  *     space that has not been set to occupied as free. The flood runs on a
+  *     grid of bits, whole rows at a time and in parallel, see FloodFill.
+  *   -# Labels all remaining space as occupied.
+  *     The tree is then built from the free cells in one pass, blocks of free
+  *     or occupied cells that fill an octree node become a single node.
+  *
+  * With incrementalUpdates, a request for the same bounding box and leaf size
+  * as the last one only rebuilds the bounding boxes of the models that
+  * appeared, moved or disappeared since, and keeps the rest of the tree.
+  * Space that a change encloses outside of these boxes stays free until the
+  * next full build.
+  *
+  * The octomap is cached under a hash of the collision shapes and poses of
+  * the static models of the world and the request. A request that matches a
+  * cached octomap is served at once, from the last cacheSize (default 4)
+  * octomaps in memory or from the .bt files in cacheDirectory, if set.
+  * Dynamic models such as vehicles are not part of the hash (their spinning
+  * rotors would change it on every request). An octomap in memory is only
+  * served if every model is where it was when the octomap was built,
+  * otherwise it is updated or built again. The files in cacheDirectory do
+  * not know the dynamic models and show them where they were when the file
+  * was written, so worlds in which dynamic models move between runs should
+  * not set cacheDirectory. Changes to the mesh files themselves are not
+  * detected.
+  *
+  * The progress of a build is published on progressPubTopic. Requests with
+  * msg.async set return at once and build on a thread of their own. Such a
+  * build also publishes the occupied cells of every rasterized slab on
+  * updatesPubTopic and the final octomap on octomapPubTopic. The service
+  * cancelServiceName cancels a running build. Physics is only held for short
+  * rounds while rays are cast, so the simulation keeps stepping.
+  *
+  * With distanceField, the signed distance of every cell center to the
+  * nearest cell of the other kind is computed from the free cells, positive
+  * in free space and negative in occupied space, see ComputeDistanceField.
+  * It is saved as msg.filename + ".df" next to the octree. Octomaps read
+  * from cacheDirectory have none.
+  *
+  * The occupied cells of the finished tree can be exported as the centers of
+  * the cells, saved as msg.point_cloud_filename (.pcd or .ply) and published
+  * on pointCloudPubTopic, and as a voxel mesh of the faces between occupied
+  * and other cells, saved as msg.mesh_filename (.ply). The tree is read
+  * at the depth of msg.point_cloud_resolution, so both are subsampled to
+  * that cell size without building anything again.
   *
   * Can give incorrect results in the following situations:
   *   -# The top central cell or bottom central cell are either occupied or
   *     completely enclosed by occupied cells.
   *   -# A completely enclosed hollow space will be marked as occupied.
-  *   -# Cells containing a mesh that does not intersect its central axes will
-  *     be marked as unoccupied
+  *   -# With the "rays" backend, cells containing a mesh that does not
+  *     intersect their central axes will be marked as unoccupied.
+  *   -# With the "collision" backend, heightmaps and polylines are ignored.
   */
-  void CreateOctomap(const rotors_comm::Octomap::Request& msg);
+  /// \return   False if the build was cancelled.
+  bool CreateOctomap(const rotors_comm::Octomap::Request& msg);
 
  private:
   physics::WorldPtr world_;
   ros::NodeHandle node_handle_;
   ros::ServiceServer srv_;
-  octomap::OcTree* octomap_;
+  /// \brief    Shared with octomap_cache_, see CachedOctomap.
+  std::shared_ptr<octomap::OcTree> octomap_;
   ros::Publisher octomap_publisher_;
+
+  /// \brief    How occupied cells are found, "rays" or "collision".
+  std::string occupancy_backend_;
+
+  /// \brief    Voxelize the collision shapes coarse to fine, see
+  ///           VoxelizePrimitiveHierarchical.
+  bool coarse_to_fine_;
+
+  /// \brief    Default number of threads that voxelize the collision shapes
+  ///           and flood fill, 0 uses all cores.
+  int num_threads_;
+
+  /// \brief    Update the last octree instead of building a new one, see
+  ///           CreateOctomap.
+  bool incremental_updates_;
+
+  /// \brief    Request, occupied and free cells of the last full build or
+  ///           update.
+  rotors_comm::Octomap::Request last_request_;
+  VoxelGrid occupied_;
+  VoxelGrid free_;
+  /// \brief    The models as they are in octomap_.
+  std::map<std::string, ModelState> model_states_;
+
+  /// \brief    Whether the members above belong to octomap_, which is not
+  ///           the case after it was read from the cache.
+  bool can_update_;
+
+  /// \brief    Number of octomaps kept in memory, 0 disables the cache in
+  ///           memory, including the current octomap.
+  int cache_size_;
+
+  /// \brief    Directory of the cached octomap files, empty disables them.
+  ///           Only for worlds whose dynamic models start where they were
+  ///           when the files were written, see CreateOctomap.
+  std::string cache_directory_;
+
+  /// \brief    The trees are shared with octomap_ instead of copied and
+  ///           not modified while they are cached, UpdateOctomap removes the
+  ///           tree it updates in place.
+  struct CachedOctomap {
+    uint64_t hash;
+    std::shared_ptr<octomap::OcTree> octomap;
+    std::shared_ptr<const DistanceField> distance_field;
+    std::map<std::string, ModelState> model_states;
+  };
+
+  /// \brief    Cached octomaps by hash, the most recently used first.
+  std::list<CachedOctomap> octomap_cache_;
+
+  /// \brief    Hash of octomap_, see HashWorldGeometry.
+  uint64_t octomap_hash_;
+
+  int cache_hits_;
+  int cache_misses_;
+
+  /// \brief    Compute a distance field with every octomap, see
+  ///           CreateOctomap.
+  bool distance_field_enabled_;
+
+  /// \brief    Distance field of octomap_, NULL if there is none.
+  std::shared_ptr<const DistanceField> distance_field_;
+
+  ros::ServiceServer cancel_srv_;
+  ros::Publisher progress_publisher_;
+  ros::Publisher updates_publisher_;
+  ros::Publisher point_cloud_publisher_;
+
+  /// \brief    Held while an octomap is built, by the service or by
+  ///           async_thread_.
+  std::mutex octomap_mutex_;
+  std::thread async_thread_;
+  std::atomic<bool> async_running_;
+  std::atomic<bool> cancel_requested_;
+
+  /// \brief    Publish the occupied cells of every slab, see PublishSlab.
+  bool publish_updates_;
+
   bool ServiceCallback(rotors_comm::Octomap::Request& req,
                        rotors_comm::Octomap::Response& res);
+
+  bool CancelCallback(std_srvs::Empty::Request& req,
+                      std_srvs::Empty::Response& res);
 };
 
 } // namespace gazebo
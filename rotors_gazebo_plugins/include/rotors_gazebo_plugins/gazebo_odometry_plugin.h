@@ -83,7 +83,8 @@ class GazeboOdometryPlugin : public ModelPlugin {
         gazebo_sequence_(kDefaultGazeboSequence),
         odometry_sequence_(kDefaultOdometrySequence),
         covariance_image_scale_(kDefaultCovarianceImageScale),
-        pubs_and_subs_created_(false) {}
+        pubs_and_subs_created_(false),
+        profiler_entry_(nullptr) {}
 
   ~GazeboOdometryPlugin();
 
@@ -163,6 +164,8 @@ class GazeboOdometryPlugin : public ModelPlugin {
   /// \brief    Pointer to the update event connection.
   event::ConnectionPtr updateConnection_;
 
+  PluginProfilerEntry* profiler_entry_;
+
   boost::thread callback_queue_thread_;
   void QueueThread();
 };
@@ -98,6 +98,8 @@ class GazeboPressurePlugin : public ModelPlugin {
   /// \brief    Pointer to the update event connection.
   event::ConnectionPtr updateConnection_;
 
+  PluginProfilerEntry* profiler_entry_;
+
   /// \brief    Reference altitude (meters).
   double ref_alt_;
 
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROTORS_GAZEBO_PLUGINS_GAZEBO_PROFILER_PLUGIN_H
+#define ROTORS_GAZEBO_PLUGINS_GAZEBO_PROFILER_PLUGIN_H
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gazebo/common/common.hh>
+#include <gazebo/common/Plugin.hh>
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+
+#include "rotors_gazebo_plugins/common.h"
+#include "rotors_gazebo_plugins/plugin_profiler.h"
+
+#include "PluginProfilerStats.pb.h"
+
+namespace gazebo {
+
+// Default values
+static const std::string kDefaultProfilerStatsPubTopic = "plugin_profiler/stats";
+static constexpr double kDefaultProfilerStatsInterval = 1.0;
+
+/// \brief    World plugin which reports the OnUpdate timing of the RotorS
+///           plugins collected by the PluginProfiler.
+/// \details  Publishes the call count, mean, p99 and max duration and the
+///           load of every plugin on every model on a Gazebo topic once per
+///           statsInterval (wall time), and prints a summary sorted by total
+///           time at shutdown. If summaryFile is set, the same summary is
+///           written there as CSV after every publication and at shutdown,
+///           for benchmark scripts. The plugins are only timed if built with
+///           PLUGIN_PROFILING.
+class GazeboProfilerPlugin : public WorldPlugin {
+ public:
+  GazeboProfilerPlugin()
+      : WorldPlugin(),
+        stats_pub_topic_(kDefaultProfilerStatsPubTopic),
+        stats_interval_(kDefaultProfilerStatsInterval) {}
+  virtual ~GazeboProfilerPlugin();
+
+ protected:
+  void Load(physics::WorldPtr _world, sdf::ElementPtr _sdf);
+  void OnUpdate(const common::UpdateInfo& /*_info*/);
+
+ private:
+  void PublishStats(const common::Time& now);
+
+  /// \brief    Writes the statistics of all plugins, most expensive first, to
+  ///           summary_file_.
+  void WriteSummary(const std::vector<PluginProfilerStatistics>& statistics) const;
+
+  std::string stats_pub_topic_;
+  double stats_interval_;
+  std::string summary_file_;
+
+  physics::WorldPtr world_;
+
+  transport::NodePtr node_handle_;
+  transport::PublisherPtr stats_pub_;
+
+  /// \brief    Pointer to the update event connection.
+  event::ConnectionPtr update_connection_;
+
+  common::Time last_stats_time_;
+
+  /// \brief    Total time at the last publication, by plugin and model name,
+  ///           used to compute the load.
+  std::map<std::pair<std::string, std::string>, uint64_t> last_total_ns_;
+
+  gz_mav_msgs::PluginProfilerStats stats_msg_;
+};
+
+} // namespace gazebo
+
+#endif // ROTORS_GAZEBO_PLUGINS_GAZEBO_PROFILER_PLUGIN_H
@@ -167,6 +167,8 @@ class GazeboRosInterfacePlugin : public WorldPlugin {
   /// \brief  Pointer to the update event connection.
   event::ConnectionPtr updateConnection_;
 
+  PluginProfilerEntry* profiler_entry_;
+
   // ============================================ //
   // ====== CONNECT GAZEBO TO ROS MESSAGES ====== //
   // ============================================ //
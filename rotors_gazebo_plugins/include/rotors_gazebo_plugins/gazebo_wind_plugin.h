@@ -80,7 +80,8 @@ class GazeboWindPlugin : public ModelPlugin {
         frame_id_(kDefaultFrameId),
         link_name_(kDefaultLinkName),
         node_handle_(nullptr),
-        pubs_and_subs_created_(false) {}
+        pubs_and_subs_created_(false),
+        profiler_entry_(nullptr) {}
 
   virtual ~GazeboWindPlugin();
 
@@ -110,6 +111,8 @@ class GazeboWindPlugin : public ModelPlugin {
   /// \brief    Pointer to the update event connection.
   event::ConnectionPtr update_connection_;
 
+  PluginProfilerEntry* profiler_entry_;
+
   physics::WorldPtr world_;
   physics::ModelPtr model_;
   physics::LinkPtr link_;
@@ -0,0 +1,146 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROTORS_GAZEBO_PLUGINS_GEODETIC_CONVERTER_H
+#define ROTORS_GAZEBO_PLUGINS_GEODETIC_CONVERTER_H
+
+#include <cmath>
+
+#include <Eigen/Dense>
+
+namespace gazebo {
+
+// WGS84 ellipsoid constants.
+static constexpr double kWgs84SemiMajorAxis_m = 6378137.0;
+static constexpr double kWgs84Flattening = 1.0 / 298.257223563;
+static constexpr double kWgs84SemiMinorAxis_m =
+    kWgs84SemiMajorAxis_m * (1.0 - kWgs84Flattening);
+static constexpr double kWgs84FirstEccentricitySquared =
+    kWgs84Flattening * (2.0 - kWgs84Flattening);
+static constexpr double kWgs84SecondEccentricitySquared =
+    kWgs84FirstEccentricitySquared / (1.0 - kWgs84FirstEccentricitySquared);
+
+/// \brief    Converts between a local ENU frame (the Gazebo world frame),
+///           ECEF and WGS84 geodetic coordinates.
+/// \details  All trigonometric terms of the origin are computed once in
+///           SetOrigin(), so ENU <-> ECEF is a single rotation plus offset.
+///           ECEF -> geodetic uses Bowring's closed-form approximation, which
+///           is accurate to well below a millimeter for terrestrial altitudes.
+///           Angles are in radians, distances in meters.
+class GeodeticConverter {
+ public:
+  GeodeticConverter() { SetOrigin(0.0, 0.0, 0.0); }
+
+  GeodeticConverter(double latitude_rad, double longitude_rad,
+                    double altitude_m) {
+    SetOrigin(latitude_rad, longitude_rad, altitude_m);
+  }
+
+  void SetOrigin(double latitude_rad, double longitude_rad, double altitude_m) {
+    origin_latitude_rad_ = latitude_rad;
+    origin_longitude_rad_ = longitude_rad;
+    origin_altitude_m_ = altitude_m;
+
+    ecef_origin_ = GeodeticToEcef(latitude_rad, longitude_rad, altitude_m);
+
+    const double sin_lat = sin(latitude_rad);
+    const double cos_lat = cos(latitude_rad);
+    const double sin_lon = sin(longitude_rad);
+    const double cos_lon = cos(longitude_rad);
+
+    // Columns are the east, north and up axes expressed in ECEF.
+    R_ecef_enu_ << -sin_lon, -sin_lat * cos_lon, cos_lat * cos_lon,
+                    cos_lon, -sin_lat * sin_lon, cos_lat * sin_lon,
+                    0.0,      cos_lat,           sin_lat;
+  }
+
+  double GetOriginLatitude() const { return origin_latitude_rad_; }
+  double GetOriginLongitude() const { return origin_longitude_rad_; }
+  double GetOriginAltitude() const { return origin_altitude_m_; }
+
+  Eigen::Vector3d EnuToEcef(const Eigen::Vector3d& enu) const {
+    return ecef_origin_ + R_ecef_enu_ * enu;
+  }
+
+  Eigen::Vector3d EcefToEnu(const Eigen::Vector3d& ecef) const {
+    return R_ecef_enu_.transpose() * (ecef - ecef_origin_);
+  }
+
+  void EnuToGeodetic(const Eigen::Vector3d& enu, double* latitude_rad,
+                     double* longitude_rad, double* altitude_m) const {
+    EcefToGeodetic(EnuToEcef(enu), latitude_rad, longitude_rad, altitude_m);
+  }
+
+  Eigen::Vector3d GeodeticToEnu(double latitude_rad, double longitude_rad,
+                                double altitude_m) const {
+    return EcefToEnu(GeodeticToEcef(latitude_rad, longitude_rad, altitude_m));
+  }
+
+  static Eigen::Vector3d GeodeticToEcef(double latitude_rad,
+                                        double longitude_rad,
+                                        double altitude_m) {
+    const double sin_lat = sin(latitude_rad);
+    const double cos_lat = cos(latitude_rad);
+    const double n = kWgs84SemiMajorAxis_m /
+        sqrt(1.0 - kWgs84FirstEccentricitySquared * sin_lat * sin_lat);
+    return Eigen::Vector3d(
+        (n + altitude_m) * cos_lat * cos(longitude_rad),
+        (n + altitude_m) * cos_lat * sin(longitude_rad),
+        (n * (1.0 - kWgs84FirstEccentricitySquared) + altitude_m) * sin_lat);
+  }
+
+  static void EcefToGeodetic(const Eigen::Vector3d& ecef, double* latitude_rad,
+                             double* longitude_rad, double* altitude_m) {
+    const double p = sqrt(ecef.x() * ecef.x() + ecef.y() * ecef.y());
+    const double theta = atan2(ecef.z() * kWgs84SemiMajorAxis_m,
+                               p * kWgs84SemiMinorAxis_m);
+    const double sin_theta = sin(theta);
+    const double cos_theta = cos(theta);
+
+    const double latitude = atan2(
+        ecef.z() + kWgs84SecondEccentricitySquared * kWgs84SemiMinorAxis_m *
+                       sin_theta * sin_theta * sin_theta,
+        p - kWgs84FirstEccentricitySquared * kWgs84SemiMajorAxis_m *
+                cos_theta * cos_theta * cos_theta);
+    const double sin_lat = sin(latitude);
+    const double n = kWgs84SemiMajorAxis_m /
+        sqrt(1.0 - kWgs84FirstEccentricitySquared * sin_lat * sin_lat);
+
+    *latitude_rad = latitude;
+    *longitude_rad = atan2(ecef.y(), ecef.x());
+    // This form stays well conditioned close to the poles.
+    *altitude_m = p * cos(latitude) +
+        (ecef.z() + kWgs84FirstEccentricitySquared * n * sin_lat) * sin_lat - n;
+  }
+
+ private:
+  double origin_latitude_rad_;
+  double origin_longitude_rad_;
+  double origin_altitude_m_;
+
+  Eigen::Vector3d ecef_origin_;
+
+  /// \brief    Rotation from the local ENU frame at the origin to ECEF.
+  Eigen::Matrix3d R_ecef_enu_;
+};
+
+}
+
+#endif // ROTORS_GAZEBO_PLUGINS_GEODETIC_CONVERTER_H
@@ -0,0 +1,195 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROTORS_GAZEBO_PLUGINS_IMU_NOISE_MODEL_H
+#define ROTORS_GAZEBO_PLUGINS_IMU_NOISE_MODEL_H
+
+#include <cassert>
+#include <cmath>
+#include <random>
+
+#include <Eigen/Core>
+
+namespace gazebo {
+
+// Default values for use with ADIS16448 IMU
+static constexpr double kDefaultAdisGyroscopeNoiseDensity =
+    2.0 * 35.0 / 3600.0 / 180.0 * M_PI;
+static constexpr double kDefaultAdisGyroscopeRandomWalk =
+    2.0 * 4.0 / 3600.0 / 180.0 * M_PI;
+static constexpr double kDefaultAdisGyroscopeBiasCorrelationTime =
+    1.0e+3;
+static constexpr double kDefaultAdisGyroscopeTurnOnBiasSigma =
+    0.5 / 180.0 * M_PI;
+static constexpr double kDefaultAdisAccelerometerNoiseDensity =
+    2.0 * 2.0e-3;
+static constexpr double kDefaultAdisAccelerometerRandomWalk =
+    2.0 * 3.0e-3;
+static constexpr double kDefaultAdisAccelerometerBiasCorrelationTime =
+    300.0;
+static constexpr double kDefaultAdisAccelerometerTurnOnBiasSigma =
+    20.0e-3 * 9.8;
+// Earth's gravity in Zurich (lat=+47.3667degN, lon=+8.5500degE, h=+500m, WGS84)
+static constexpr double kDefaultGravityMagnitude = 9.8068;
+
+// A description of the parameters:
+// https://github.com/ethz-asl/kalibr/wiki/IMU-Noise-Model-and-Intrinsics
+// TODO(burrimi): Should I have a minimalistic description of the params here?
+struct ImuParameters {
+  /// Gyroscope noise density (two-sided spectrum) [rad/s/sqrt(Hz)]
+  double gyroscope_noise_density;
+  /// Gyroscope bias random walk [rad/s/s/sqrt(Hz)]
+  double gyroscope_random_walk;
+  /// Gyroscope bias correlation time constant [s]
+  double gyroscope_bias_correlation_time;
+  /// Gyroscope turn on bias standard deviation [rad/s]
+  double gyroscope_turn_on_bias_sigma;
+  /// Accelerometer noise density (two-sided spectrum) [m/s^2/sqrt(Hz)]
+  double accelerometer_noise_density;
+  /// Accelerometer bias random walk. [m/s^2/s/sqrt(Hz)]
+  double accelerometer_random_walk;
+  /// Accelerometer bias correlation time constant [s]
+  double accelerometer_bias_correlation_time;
+  /// Accelerometer turn on bias standard deviation [m/s^2]
+  double accelerometer_turn_on_bias_sigma;
+  /// Norm of the gravitational acceleration [m/s^2]
+  double gravity_magnitude;
+
+  ImuParameters()
+      : gyroscope_noise_density(kDefaultAdisGyroscopeNoiseDensity),
+        gyroscope_random_walk(kDefaultAdisGyroscopeRandomWalk),
+        gyroscope_bias_correlation_time(
+            kDefaultAdisGyroscopeBiasCorrelationTime),
+        gyroscope_turn_on_bias_sigma(kDefaultAdisGyroscopeTurnOnBiasSigma),
+        accelerometer_noise_density(kDefaultAdisAccelerometerNoiseDensity),
+        accelerometer_random_walk(kDefaultAdisAccelerometerRandomWalk),
+        accelerometer_bias_correlation_time(
+            kDefaultAdisAccelerometerBiasCorrelationTime),
+        accelerometer_turn_on_bias_sigma(
+            kDefaultAdisAccelerometerTurnOnBiasSigma),
+        gravity_magnitude(kDefaultGravityMagnitude) {}
+};
+
+/// \brief    Gyroscope and accelerometer noise of GazeboImuPlugin: white
+///           noise, a first order Gauss-Markov bias and a constant turn on
+///           bias per axis.
+/// \details  Holds no Gazebo state, so it can be used (and benchmarked)
+///           without a running world.
+class ImuNoiseModel {
+ public:
+  ImuNoiseModel()
+      : standard_normal_distribution_(0.0, 1.0),
+        gyroscope_bias_(Eigen::Vector3d::Zero()),
+        accelerometer_bias_(Eigen::Vector3d::Zero()),
+        gyroscope_turn_on_bias_(Eigen::Vector3d::Zero()),
+        accelerometer_turn_on_bias_(Eigen::Vector3d::Zero()) {}
+
+  /// \brief    Sets the parameters, draws new turn on biases and resets the
+  ///           bias processes to zero.
+  void Initialize(const ImuParameters& parameters) {
+    parameters_ = parameters;
+    double sigma_bon_g = parameters_.gyroscope_turn_on_bias_sigma;
+    double sigma_bon_a = parameters_.accelerometer_turn_on_bias_sigma;
+    for (int i = 0; i < 3; ++i) {
+      gyroscope_turn_on_bias_[i] =
+          sigma_bon_g * standard_normal_distribution_(random_generator_);
+      accelerometer_turn_on_bias_[i] =
+          sigma_bon_a * standard_normal_distribution_(random_generator_);
+    }
+
+    // TODO(nikolicj) incorporate steady-state covariance of bias process
+    gyroscope_bias_.setZero();
+    accelerometer_bias_.setZero();
+  }
+
+  /// \brief  This method adds noise to acceleration and angular rates for
+  ///         accelerometer and gyroscope measurement simulation.
+  void AddNoise(Eigen::Vector3d* linear_acceleration,
+                Eigen::Vector3d* angular_velocity,
+                const double dt) {
+    assert(linear_acceleration != nullptr);
+    assert(angular_velocity != nullptr);
+    assert(dt > 0.0);
+
+    // Gyrosocpe
+    double tau_g = parameters_.gyroscope_bias_correlation_time;
+    // Discrete-time standard deviation equivalent to an "integrating" sampler
+    // with integration time dt.
+    double sigma_g_d = 1 / sqrt(dt) * parameters_.gyroscope_noise_density;
+    double sigma_b_g = parameters_.gyroscope_random_walk;
+    // Compute exact covariance of the process after dt [Maybeck 4-114].
+    double sigma_b_g_d = sqrt(-sigma_b_g * sigma_b_g * tau_g / 2.0 *
+                              (exp(-2.0 * dt / tau_g) - 1.0));
+    // Compute state-transition.
+    double phi_g_d = exp(-1.0 / tau_g * dt);
+    // Simulate gyroscope noise processes and add them to the true angular
+    // rate.
+    for (int i = 0; i < 3; ++i) {
+      gyroscope_bias_[i] =
+          phi_g_d * gyroscope_bias_[i] +
+          sigma_b_g_d * standard_normal_distribution_(random_generator_);
+      (*angular_velocity)[i] =
+          (*angular_velocity)[i] + gyroscope_bias_[i] +
+          sigma_g_d * standard_normal_distribution_(random_generator_) +
+          gyroscope_turn_on_bias_[i];
+    }
+
+    // Accelerometer
+    double tau_a = parameters_.accelerometer_bias_correlation_time;
+    // Discrete-time standard deviation equivalent to an "integrating" sampler
+    // with integration time dt.
+    double sigma_a_d = 1 / sqrt(dt) * parameters_.accelerometer_noise_density;
+    double sigma_b_a = parameters_.accelerometer_random_walk;
+    // Compute exact covariance of the process after dt [Maybeck 4-114].
+    double sigma_b_a_d = sqrt(-sigma_b_a * sigma_b_a * tau_a / 2.0 *
+                              (exp(-2.0 * dt / tau_a) - 1.0));
+    // Compute state-transition.
+    double phi_a_d = exp(-1.0 / tau_a * dt);
+    // Simulate accelerometer noise processes and add them to the true linear
+    // acceleration.
+    for (int i = 0; i < 3; ++i) {
+      accelerometer_bias_[i] =
+          phi_a_d * accelerometer_bias_[i] +
+          sigma_b_a_d * standard_normal_distribution_(random_generator_);
+      (*linear_acceleration)[i] =
+          (*linear_acceleration)[i] + accelerometer_bias_[i] +
+          sigma_a_d * standard_normal_distribution_(random_generator_) +
+          accelerometer_turn_on_bias_[i];
+    }
+  }
+
+  const ImuParameters& parameters() const { return parameters_; }
+
+ private:
+  ImuParameters parameters_;
+
+  std::default_random_engine random_generator_;
+  std::normal_distribution<double> standard_normal_distribution_;
+
+  Eigen::Vector3d gyroscope_bias_;
+  Eigen::Vector3d accelerometer_bias_;
+
+  Eigen::Vector3d gyroscope_turn_on_bias_;
+  Eigen::Vector3d accelerometer_turn_on_bias_;
+};
+
+}
+
+#endif // ROTORS_GAZEBO_PLUGINS_IMU_NOISE_MODEL_H
@@ -0,0 +1,182 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROTORS_GAZEBO_PLUGINS_MAVLINK_HUB_H
+#define ROTORS_GAZEBO_PLUGINS_MAVLINK_HUB_H
+
+// SYSTEM
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+
+// 3RD PARTY
+#include "common/mavlink.h"     // Either provided by ROS or as CMake argument MAVLINK_HEADER_DIR
+
+namespace gazebo {
+
+// Default values
+static constexpr int kDefaultMavlinkHubBasePort = 14560;
+
+/// \brief    Totals of a single vehicle link since it was registered.
+struct MavlinkLinkCounters {
+  MavlinkLinkCounters()
+      : rx_messages(0),
+        rx_bytes(0),
+        tx_messages(0),
+        tx_bytes(0),
+        tx_errors(0),
+        parse_errors(0),
+        sequence_gaps(0),
+        sequence_reordered(0),
+        rtt_samples(0),
+        rtt_sum_ms(0.0),
+        rtt_max_ms(0.0) {}
+
+  uint64_t rx_messages;
+  uint64_t rx_bytes;
+  uint64_t tx_messages;
+  uint64_t tx_bytes;
+  uint64_t tx_errors;
+  uint64_t parse_errors;
+  /// \brief    Frames missing in the sequence of each sender (sysid/compid).
+  uint64_t sequence_gaps;
+  /// \brief    Frames that repeat or go back in the sequence of their sender,
+  ///           i.e. duplicates, reordered frames or a restart of the sender.
+  uint64_t sequence_reordered;
+  uint64_t rtt_samples;
+  double rtt_sum_ms;
+  double rtt_max_ms;
+};
+
+class MavlinkHub;
+
+/// \brief    The UDP endpoint of one vehicle. Created and serviced by the
+///           MavlinkHub, used by GazeboMavlinkInterface to exchange messages
+///           with its autopilot.
+/// \details  Incoming datagrams are parsed on the hub thread and queued until
+///           the owning plugin calls Receive() from its update.
+class MavlinkHubLink {
+ public:
+  ~MavlinkHubLink();
+
+  unsigned GetVehicleIndex() const { return vehicle_index_; }
+  int GetRemotePort() const { return remote_port_; }
+  const std::string& GetName() const { return name_; }
+
+  /// \brief    Encodes msg as a MAVLink v1 frame and sends it to the autopilot.
+  bool Send(uint8_t msgid, const void* msg, uint8_t component_id);
+
+  /// \brief    Appends all messages received since the last call to messages.
+  void Receive(std::vector<mavlink_message_t>* messages);
+
+  MavlinkLinkCounters GetCounters() const;
+
+ private:
+  friend class MavlinkHub;
+
+  MavlinkHubLink(const std::string& name, unsigned vehicle_index, int fd,
+                 const sockaddr_in& remote_addr);
+
+  /// \brief    Drains the socket. Called by the hub thread only.
+  void OnReadable();
+
+  /// \brief    Splits a datagram into MAVLink frames, validating length and
+  ///           CRC, and updates the sequence statistics.
+  void ParseDatagram(const uint8_t* data, size_t len);
+
+  /// \brief    Consumes a TIMESYNC response to one of our requests.
+  void HandleTimesync(const mavlink_message_t& msg);
+
+  const std::string name_;
+  const unsigned vehicle_index_;
+  const int remote_port_;
+  const int fd_;
+
+  /// \brief    Guards all members below.
+  mutable std::mutex mutex_;
+
+  /// \brief    Address of the autopilot. Updated to the sender of the most
+  ///           recent datagram, as the autopilot may reply from another port.
+  sockaddr_in remote_addr_;
+  uint8_t tx_sequence_;
+  /// \brief    Last received sequence number, by (sysid << 8) | compid.
+  std::map<uint16_t, uint8_t> last_rx_sequences_;
+  std::vector<mavlink_message_t> rx_queue_;
+  MavlinkLinkCounters counters_;
+
+  uint8_t rx_buffer_[65535];
+};
+
+/// \brief    Process-wide MAVLink multiplexer for multi-vehicle simulations.
+/// \details  Started by GazeboMavlinkHubPlugin. Every GazeboMavlinkInterface
+///           registers a link, gets the port base_port + vehicle_index
+///           assigned, and all sockets are serviced by one epoll thread.
+///           If the hub is not running, Register() returns nullptr and the
+///           interface falls back to its own socket.
+class MavlinkHub {
+ public:
+  static MavlinkHub& Instance();
+
+  bool Start(int base_port, in_addr_t remote_addr);
+  void Stop();
+  bool IsRunning() const { return running_; }
+
+  /// \brief    Creates the link of a vehicle.
+  /// \param[in]  vehicle_index   Requested index, or -1 to take the lowest
+  ///                             free one.
+  std::shared_ptr<MavlinkHubLink> Register(const std::string& name,
+                                           int vehicle_index);
+  void Unregister(const std::shared_ptr<MavlinkHubLink>& link);
+
+  std::vector<std::shared_ptr<MavlinkHubLink> > GetLinks() const;
+
+  /// \brief    Sends a TIMESYNC request on every link. The responses are used
+  ///           to measure the round-trip time to each autopilot.
+  void SendTimesyncRequests();
+
+ private:
+  MavlinkHub();
+  ~MavlinkHub();
+  MavlinkHub(const MavlinkHub&) = delete;
+  MavlinkHub& operator=(const MavlinkHub&) = delete;
+
+  void Run();
+
+  std::atomic<bool> running_;
+  std::thread thread_;
+  int epoll_fd_;
+  int base_port_;
+  in_addr_t remote_addr_;
+
+  /// \brief    Guards links_.
+  mutable std::mutex mutex_;
+
+  /// \brief    Links by vehicle index, the index is also the epoll user data.
+  std::map<unsigned, std::shared_ptr<MavlinkHubLink> > links_;
+};
+
+}
+
+#endif // ROTORS_GAZEBO_PLUGINS_MAVLINK_HUB_H
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROTORS_GAZEBO_PLUGINS_MAVLINK_LOG_H
+#define ROTORS_GAZEBO_PLUGINS_MAVLINK_LOG_H
+
+// SYSTEM
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 3RD PARTY
+#include "common/mavlink.h"     // Either provided by ROS or as CMake argument MAVLINK_HEADER_DIR
+
+namespace gazebo {
+
+/// \brief    Direction of a logged MAVLink message, seen from the simulator.
+enum class MavlinkLogDirection : uint8_t {
+  kInbound = 0,   ///< Autopilot -> simulator.
+  kOutbound = 1   ///< Simulator -> autopilot.
+};
+
+/// \brief    One logged MAVLink message.
+struct MavlinkLogRecord {
+  uint64_t sim_time_usec;
+  MavlinkLogDirection direction;
+  uint8_t msgid;
+  std::vector<uint8_t> payload;
+};
+
+/// \brief    Writes MAVLink traffic to a compact binary file.
+/// \details  File layout (host byte order):
+///             header:  "RMAVLOG" '\0', uint32 version
+///             records: uint64 sim_time_usec, uint8 direction, uint8 msgid,
+///                      uint8 payload_len, payload_len bytes of payload
+///           Only the payload is stored, framing and checksums are rebuilt
+///           on replay. Thread safe, as messages are sent both from the
+///           update thread and from transport callbacks.
+class MavlinkLogWriter {
+ public:
+  MavlinkLogWriter() : file_(NULL) {}
+  ~MavlinkLogWriter() { Close(); }
+
+  bool Open(const std::string& path);
+  void Close();
+  bool IsOpen() const { return file_ != NULL; }
+
+  void Write(uint64_t sim_time_usec, MavlinkLogDirection direction,
+             uint8_t msgid, const void* payload, uint8_t payload_len);
+
+ private:
+  std::mutex mutex_;
+  FILE* file_;
+};
+
+/// \brief    Reads a file written by MavlinkLogWriter.
+class MavlinkLogReader {
+ public:
+  /// \brief    Reads all records of the file at path, in file order.
+  static bool ReadAll(const std::string& path, std::vector<MavlinkLogRecord>* records);
+
+  /// \brief    Rebuilds a MAVLink message from a record.
+  static void ToMessage(const MavlinkLogRecord& record, mavlink_message_t* msg);
+};
+
+}
+
+#endif // ROTORS_GAZEBO_PLUGINS_MAVLINK_LOG_H
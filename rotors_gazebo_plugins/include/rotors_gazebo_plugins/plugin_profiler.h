@@ -0,0 +1,105 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROTORS_GAZEBO_PLUGINS_PLUGIN_PROFILER_H
+#define ROTORS_GAZEBO_PLUGINS_PLUGIN_PROFILER_H
+
+// SYSTEM
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace gazebo {
+
+/// \brief    Durations are binned with four bins per power of two, so the
+///           reported p99 is accurate to 25 %.
+static constexpr unsigned int kProfilerHistogramBins = 256;
+
+/// \brief    Summary of one profiled scope, durations in nanoseconds.
+struct PluginProfilerStatistics {
+  std::string plugin_name;
+  std::string model_name;
+  uint64_t calls;
+  uint64_t total_ns;
+  double mean_ns;
+  uint64_t p99_ns;
+  uint64_t max_ns;
+};
+
+/// \brief    Accumulates the durations of the calls of one plugin on one
+///           model. Thread safe.
+/// \details  AddSample() runs in every timed OnUpdate(), so it only does
+///           relaxed atomic increments and takes no lock. GetStatistics() may
+///           therefore miss a sample that is being added concurrently.
+class PluginProfilerEntry {
+ public:
+  PluginProfilerEntry(const std::string& plugin_name,
+                      const std::string& model_name);
+
+  void AddSample(uint64_t duration_ns);
+
+  PluginProfilerStatistics GetStatistics() const;
+
+ private:
+  const std::string plugin_name_;
+  const std::string model_name_;
+
+  std::atomic<uint64_t> total_ns_;
+  std::atomic<uint64_t> max_ns_;
+  /// \brief    The call count is the sum of the bins.
+  std::atomic<uint64_t> histogram_[kProfilerHistogramBins];
+};
+
+/// \brief    Process wide registry of the profiled plugin scopes.
+/// \details  Lives in its own library, so that every plugin shares one
+///           instance (see ScopedProfilerTimer in common.h).
+///           GazeboProfilerPlugin publishes the statistics.
+class PluginProfiler {
+ public:
+  static PluginProfiler& Instance();
+
+  /// \brief    Returns the entry of the plugin on the model, created on first
+  ///           use. Several instances of a plugin on the same model (e.g.
+  ///           the motors) share one entry. The pointer stays valid for the
+  ///           lifetime of the process.
+  PluginProfilerEntry* GetEntry(const std::string& plugin_name,
+                                const std::string& model_name);
+
+  /// \brief    Statistics of all entries, ordered by plugin and model name.
+  std::vector<PluginProfilerStatistics> GetStatistics() const;
+
+ private:
+  PluginProfiler() {}
+  PluginProfiler(const PluginProfiler&) = delete;
+  PluginProfiler& operator=(const PluginProfiler&) = delete;
+
+  mutable std::mutex mutex_;
+  std::map<std::pair<std::string, std::string>,
+           std::unique_ptr<PluginProfilerEntry> > entries_;
+};
+
+}
+
+#endif // ROTORS_GAZEBO_PLUGINS_PLUGIN_PROFILER_H
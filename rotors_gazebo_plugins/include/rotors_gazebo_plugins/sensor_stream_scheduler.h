@@ -0,0 +1,117 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROTORS_GAZEBO_PLUGINS_SENSOR_STREAM_SCHEDULER_H
+#define ROTORS_GAZEBO_PLUGINS_SENSOR_STREAM_SCHEDULER_H
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+
+#include "rotors_gazebo_plugins/common.h"
+
+namespace gazebo {
+
+/// \brief    Decides in sim time when a periodic sensor stream is due.
+/// \details  The stream is due at phase + k / rate, each instant shifted by a
+///           uniformly distributed jitter in [-jitter, jitter]. The jitter
+///           does not accumulate. A rate of zero means the stream is emitted
+///           on every call, i.e. at the rate of its source. Each scheduler
+///           owns its random generator, so schedulers can be queried from
+///           different threads and stay reproducible for a fixed seed.
+class SensorStreamScheduler {
+ public:
+  SensorStreamScheduler()
+      : rate_(0.0),
+        phase_(0.0),
+        jitter_(0.0),
+        next_nominal_time_(0.0),
+        next_time_(0.0),
+        jitter_distribution_(-1.0, 1.0) {}
+
+  void Configure(double rate, double phase, double jitter, unsigned int seed) {
+    rate_ = rate;
+    phase_ = phase;
+    jitter_ = jitter;
+    random_generator_.seed(seed);
+    next_nominal_time_ = phase_;
+    next_time_ = phase_;
+  }
+
+  /// \brief    Reads <prefix>_rate [Hz], <prefix>_phase [s] and
+  ///           <prefix>_jitter [s] from the SDF, e.g. gps_rate.
+  void Load(sdf::ElementPtr sdf, const std::string& prefix, double default_rate,
+            unsigned int seed) {
+    double rate, phase, jitter;
+    getSdfParam<double>(sdf, prefix + "_rate", rate, default_rate);
+    getSdfParam<double>(sdf, prefix + "_phase", phase, 0.0);
+    getSdfParam<double>(sdf, prefix + "_jitter", jitter, 0.0);
+    Configure(rate, phase, jitter, seed);
+  }
+
+  double GetRate() const { return rate_; }
+
+  /// \brief    Returns true if the stream is due at sim time t (in seconds),
+  ///           and if so schedules the next sample.
+  bool IsDue(double t) {
+    if (rate_ <= 0.0) {
+      return true;
+    }
+    const double period = 1.0 / rate_;
+    // The sim time went back (reset of the world or the sim time), start
+    // over at the first instant of the schedule at or after t.
+    if (t < next_nominal_time_ - 2.0 * period) {
+      next_nominal_time_ =
+          phase_ + std::max(std::ceil((t - phase_) / period), 0.0) * period;
+      next_time_ = next_nominal_time_;
+    }
+    if (t < next_time_) {
+      return false;
+    }
+
+    next_nominal_time_ += period;
+    // Resynchronize instead of bursting if the source fell behind (e.g. after
+    // a pause).
+    if (next_nominal_time_ <= t) {
+      next_nominal_time_ =
+          phase_ + (std::floor((t - phase_) / period) + 1.0) * period;
+    }
+    next_time_ = next_nominal_time_;
+    if (jitter_ > 0.0) {
+      next_time_ += jitter_ * jitter_distribution_(random_generator_);
+    }
+    return true;
+  }
+
+ private:
+  double rate_;
+  double phase_;
+  double jitter_;
+  double next_nominal_time_;
+  double next_time_;
+
+  std::minstd_rand random_generator_;
+  std::uniform_real_distribution<double> jitter_distribution_;
+};
+
+}
+
+#endif // ROTORS_GAZEBO_PLUGINS_SENSOR_STREAM_SCHEDULER_H
@@ -0,0 +1,243 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROTORS_GAZEBO_PLUGINS_VOXEL_GRID_H
+#define ROTORS_GAZEBO_PLUGINS_VOXEL_GRID_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+namespace gazebo {
+
+/// \brief    Dense grid of one bit per voxel over an axis aligned box.
+/// \details  Every row along x is stored in its own 64 bit words, so whole
+///           runs of a row can be set or combined with word operations.
+///           Rows are ordered by y, then z. Cell (0, 0, 0) is centered at
+///           first_cell_center.
+class VoxelGrid {
+ public:
+  VoxelGrid()
+      : first_cell_center_(Eigen::Vector3d::Zero()),
+        leaf_size_(1.0),
+        size_x_(0),
+        size_y_(0),
+        size_z_(0),
+        words_per_row_(0) {}
+
+  VoxelGrid(const Eigen::Vector3d& first_cell_center, double leaf_size,
+            int size_x, int size_y, int size_z) {
+    Reset(first_cell_center, leaf_size, size_x, size_y, size_z);
+  }
+
+  /// \brief    Resizes the grid and clears all voxels.
+  void Reset(const Eigen::Vector3d& first_cell_center, double leaf_size,
+             int size_x, int size_y, int size_z) {
+    first_cell_center_ = first_cell_center;
+    leaf_size_ = leaf_size;
+    size_x_ = size_x;
+    size_y_ = size_y;
+    size_z_ = size_z;
+    words_per_row_ = (size_x + 63) / 64;
+    words_.assign(static_cast<size_t>(words_per_row_) * size_y * size_z, 0);
+  }
+
+  int size_x() const { return size_x_; }
+  int size_y() const { return size_y_; }
+  int size_z() const { return size_z_; }
+  int words_per_row() const { return words_per_row_; }
+  double leaf_size() const { return leaf_size_; }
+  const Eigen::Vector3d& first_cell_center() const {
+    return first_cell_center_;
+  }
+
+  Eigen::Vector3d CellCenter(int x, int y, int z) const {
+    return first_cell_center_ + leaf_size_ * Eigen::Vector3d(x, y, z);
+  }
+
+  bool IsSet(int x, int y, int z) const {
+    return (Row(y, z)[x >> 6] >> (x & 63)) & 1;
+  }
+
+  void Set(int x, int y, int z) {
+    Row(y, z)[x >> 6] |= static_cast<uint64_t>(1) << (x & 63);
+  }
+
+  /// \brief    Sets the voxels x_begin <= x < x_end of a row.
+  void SetRun(int x_begin, int x_end, int y, int z) {
+    if (x_begin >= x_end) {
+      return;
+    }
+    uint64_t* row = Row(y, z);
+    const int first_word = x_begin >> 6;
+    const int last_word = (x_end - 1) >> 6;
+    const uint64_t first_mask = ~static_cast<uint64_t>(0) << (x_begin & 63);
+    const uint64_t last_mask =
+        ~static_cast<uint64_t>(0) >> (63 - ((x_end - 1) & 63));
+    if (first_word == last_word) {
+      row[first_word] |= first_mask & last_mask;
+      return;
+    }
+    row[first_word] |= first_mask;
+    std::fill(row + first_word + 1, row + last_word, ~static_cast<uint64_t>(0));
+    row[last_word] |= last_mask;
+  }
+
+  /// \brief    Mask of the bits of a row word that hold voxels, the last
+  ///           word of a row is padded.
+  uint64_t WordMask(int word_index) const {
+    const int num_bits = size_x_ - 64 * word_index;
+    return num_bits >= 64 ? ~static_cast<uint64_t>(0)
+                          : ~(~static_cast<uint64_t>(0) << num_bits);
+  }
+
+  /// \brief    Clears the voxels first <= (x, y, z) <= last.
+  void ClearBox(const Eigen::Vector3i& first, const Eigen::Vector3i& last) {
+    for (int z = first.z(); z <= last.z(); ++z) {
+      for (int y = first.y(); y <= last.y(); ++y) {
+        uint64_t* row = Row(y, z);
+        for (int x = first.x(); x <= last.x(); ++x) {
+          row[x >> 6] &= ~(static_cast<uint64_t>(1) << (x & 63));
+        }
+      }
+    }
+  }
+
+  uint64_t* Row(int y, int z) {
+    return &words_[(static_cast<size_t>(z) * size_y_ + y) * words_per_row_];
+  }
+
+  const uint64_t* Row(int y, int z) const {
+    return &words_[(static_cast<size_t>(z) * size_y_ + y) * words_per_row_];
+  }
+
+  /// \brief    Computes the range of cells that overlap the axis aligned box
+  ///           [min, max], clipped to the grid. Returns false if it is empty.
+  bool CellRange(const Eigen::Vector3d& min, const Eigen::Vector3d& max,
+                 Eigen::Vector3i* first, Eigen::Vector3i* last) const {
+    const int sizes[3] = {size_x_, size_y_, size_z_};
+    for (int i = 0; i < 3; ++i) {
+      // Clamped before the cast, the box may be unbounded.
+      const double lower =
+          std::ceil((min[i] - first_cell_center_[i]) / leaf_size_ - 0.5);
+      const double upper =
+          std::floor((max[i] - first_cell_center_[i]) / leaf_size_ + 0.5);
+      (*first)[i] = static_cast<int>(
+          std::min(std::max(lower, 0.0), static_cast<double>(sizes[i])));
+      (*last)[i] = static_cast<int>(
+          std::min(std::max(upper, -1.0), sizes[i] - 1.0));
+      if ((*first)[i] > (*last)[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// \brief    Calls function(x, y, z) for every set voxel, in memory order.
+  template <typename Function>
+  void ForEachSet(Function function) const {
+    for (int z = 0; z < size_z_; ++z) {
+      for (int y = 0; y < size_y_; ++y) {
+        const uint64_t* row = Row(y, z);
+        for (int word_index = 0; word_index < words_per_row_; ++word_index) {
+          for (uint64_t word = row[word_index]; word != 0;
+               word &= word - 1) {
+            function(64 * word_index + __builtin_ctzll(word), y, z);
+          }
+        }
+      }
+    }
+  }
+
+  size_t CountSet() const {
+    size_t count = 0;
+    for (uint64_t word : words_) {
+      count += __builtin_popcountll(word);
+    }
+    return count;
+  }
+
+ private:
+  Eigen::Vector3d first_cell_center_;
+  double leaf_size_;
+  int size_x_;
+  int size_y_;
+  int size_z_;
+  int words_per_row_;
+  std::vector<uint64_t> words_;
+};
+
+/// \brief    Marks all voxels that are connected to a seed through voxels
+///           that are not occupied (6-connected) in reached.
+/// \details  Voxels that are already reached are not expanded again. Works on
+///           whole rows: a row is filled from its seeds with word operations,
+///           then its new voxels seed the four neighbouring rows. The rows of
+///           one step of this breadth first search are processed by
+///           num_threads threads. If newly_reached is not NULL, the voxels
+///           this call adds to reached are also set in it.
+/// \param[in] occupied  Voxels that block the flood, of the same size as
+///           reached.
+void FloodFill(const VoxelGrid& occupied,
+               const std::vector<Eigen::Vector3i>& seeds, int num_threads,
+               VoxelGrid* reached, VoxelGrid* newly_reached);
+
+/// \brief    Writes count 32 bit values (floats or integers) starting at data
+///           to file as little endian, on any host.
+void WriteLittleEndian32(const void* data, size_t count, std::ostream* file);
+
+/// \brief    Signed distances of the voxel centers of a grid [m].
+struct DistanceField {
+  Eigen::Vector3d first_cell_center;
+  double leaf_size;
+  Eigen::Vector3i size;
+  /// In the order of the voxels of the grid, x fastest, then y and z.
+  std::vector<float> distances;
+
+  DistanceField()
+      : first_cell_center(Eigen::Vector3d::Zero()),
+        leaf_size(1.0),
+        size(Eigen::Vector3i::Zero()) {}
+
+  /// \brief    Writes a short text header followed by the distances as
+  ///           little endian 32 bit floats, on any host. The header states
+  ///           the byte order in its "format" line.
+  /// \return   False if the file could not be written.
+  bool Write(const std::string& filename) const;
+};
+
+/// \brief    Computes the distance from every voxel center to the nearest
+///           voxel center of the other kind, positive for set voxels of
+///           free_space and negative for the others. Infinite if there are
+///           none of the other kind.
+/// \details  Exact Euclidean distance transform of Felzenszwalb and
+///           Huttenlocher, one pass of lower envelopes of parabolas per
+///           axis. The lines of each pass are split among num_threads
+///           threads.
+void ComputeDistanceField(const VoxelGrid& free_space, int num_threads,
+                          DistanceField* field);
+
+}
+
+#endif // ROTORS_GAZEBO_PLUGINS_VOXEL_GRID_H
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROTORS_GAZEBO_PLUGINS_VOXELIZER_H
+#define ROTORS_GAZEBO_PLUGINS_VOXELIZER_H
+
+#include <functional>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "rotors_gazebo_plugins/voxel_grid.h"
+
+namespace gazebo {
+
+/// \brief    Collision shape in the world frame.
+/// \details  Holds no Gazebo state, OctomapFromGazeboWorld fills it from the
+///           collisions of the world.
+struct CollisionPrimitive {
+  enum Type { kBox, kSphere, kCylinder, kMesh, kPlane };
+
+  Type type;
+  /// Origin in the world frame. Boxes, spheres and cylinders are centered
+  /// on it, planes pass through it.
+  Eigen::Vector3d position;
+  /// Orientation in the world frame. Cylinders extend along its z axis.
+  Eigen::Matrix3d rotation;
+  /// Half side lengths of a box [m]
+  Eigen::Vector3d half_extents;
+  /// Radius of a sphere or cylinder [m]
+  double radius;
+  /// Half length of a cylinder [m]
+  double half_length;
+  /// Unit normal of a plane in the world frame
+  Eigen::Vector3d normal;
+  /// Triangles of a mesh in the world frame, three vertices per triangle
+  std::vector<Eigen::Vector3d> triangle_vertices;
+
+  CollisionPrimitive()
+      : type(kBox),
+        position(Eigen::Vector3d::Zero()),
+        rotation(Eigen::Matrix3d::Identity()),
+        half_extents(Eigen::Vector3d::Zero()),
+        radius(0.0),
+        half_length(0.0),
+        normal(Eigen::Vector3d::UnitZ()) {}
+
+  /// \brief    Axis aligned bounding box in the world frame, unbounded for
+  ///           planes.
+  void GetAabb(Eigen::Vector3d* min, Eigen::Vector3d* max) const;
+};
+
+/// \brief    Overlap tests with an axis aligned box, given by its center and
+///           half side lengths. Touching counts as overlapping.
+bool BoxOverlapsAabb(const Eigen::Vector3d& box_center,
+                     const Eigen::Matrix3d& box_rotation,
+                     const Eigen::Vector3d& box_half_extents,
+                     const Eigen::Vector3d& aabb_center,
+                     const Eigen::Vector3d& aabb_half_extents);
+
+bool SphereOverlapsAabb(const Eigen::Vector3d& sphere_center, double radius,
+                        const Eigen::Vector3d& aabb_center,
+                        const Eigen::Vector3d& aabb_half_extents);
+
+/// \details  Exact for cylinders aligned with a world axis, otherwise it may
+///           also accept boxes that only come close to the rims of the caps.
+bool CylinderOverlapsAabb(const Eigen::Vector3d& cylinder_center,
+                          const Eigen::Vector3d& axis, double radius,
+                          double half_length,
+                          const Eigen::Vector3d& aabb_center,
+                          const Eigen::Vector3d& aabb_half_extents);
+
+bool TriangleOverlapsAabb(const Eigen::Vector3d& vertex0,
+                          const Eigen::Vector3d& vertex1,
+                          const Eigen::Vector3d& vertex2,
+                          const Eigen::Vector3d& aabb_center,
+                          const Eigen::Vector3d& aabb_half_extents);
+
+bool PlaneOverlapsAabb(const Eigen::Vector3d& point,
+                       const Eigen::Vector3d& normal,
+                       const Eigen::Vector3d& aabb_center,
+                       const Eigen::Vector3d& aabb_half_extents);
+
+bool PrimitiveOverlapsAabb(const CollisionPrimitive& primitive,
+                           const Eigen::Vector3d& aabb_center,
+                           const Eigen::Vector3d& aabb_half_extents);
+
+/// \brief    Whether the axis aligned box lies completely inside the solid
+///           of a box, sphere or cylinder. Always false for meshes and
+///           planes, which have no inside.
+bool AabbInsidePrimitive(const CollisionPrimitive& primitive,
+                         const Eigen::Vector3d& aabb_center,
+                         const Eigen::Vector3d& aabb_half_extents);
+
+/// \brief    Sets all voxels of the grid that overlap the primitive, within
+///           the cells first <= (x, y, z) <= last.
+/// \details  Boxes, spheres and cylinders are filled solid, meshes and
+///           planes only mark the voxels their surface passes through.
+///           Calls for disjoint layers in z write disjoint rows of the grid
+///           and can run in parallel.
+void VoxelizePrimitive(const CollisionPrimitive& primitive,
+                       const Eigen::Vector3i& first,
+                       const Eigen::Vector3i& last, VoxelGrid* grid);
+
+/// \brief    Sets the same voxels as VoxelizePrimitive, coarse to fine.
+/// \details  Tests cubic blocks of voxels, starting from one that covers the
+///           bounding box of the primitive. Blocks that miss it are skipped,
+///           blocks inside it are filled at once and only blocks that
+///           straddle its surface are split into eight. Meshes only pass the
+///           triangles that overlap a block on to its children. The work
+///           grows with the surface of the primitive instead of its volume.
+void VoxelizePrimitiveHierarchical(const CollisionPrimitive& primitive,
+                                   const Eigen::Vector3i& first,
+                                   const Eigen::Vector3i& last,
+                                   VoxelGrid* grid);
+
+/// \brief    Voxelizes all primitives into the cells first <= (x, y, z) <=
+///           last, in chunks of layers along z that num_threads threads take
+///           in turn. The chunks share no words of the grid.
+/// \details  chunk_done(chunk_first, chunk_last) is called by the thread
+///           that voxelized a chunk, right after it. Once it returns false,
+///           no more chunks are started.
+/// \return   The number of threads used.
+int VoxelizePrimitives(
+    const std::vector<CollisionPrimitive>& primitives,
+    const Eigen::Vector3i& first, const Eigen::Vector3i& last,
+    bool coarse_to_fine, int num_threads, VoxelGrid* grid,
+    const std::function<bool(const Eigen::Vector3i& chunk_first,
+                             const Eigen::Vector3i& chunk_last)>& chunk_done);
+
+}
+
+#endif // ROTORS_GAZEBO_PLUGINS_VOXELIZER_H
@@ -0,0 +1,326 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// MODULE
+#include "rotors_gazebo_plugins/async_bag_writer.h"
+
+// SYSTEM
+#include <chrono>
+#include <sys/stat.h>
+
+// 3RD PARTY
+#include <gazebo/common/common.hh>
+#include <topic_tools/shape_shifter.h>
+
+namespace gazebo {
+
+// How long the writer thread sleeps if the queue is empty.
+static constexpr std::chrono::microseconds kWriterIdleSleep(500);
+
+AsyncBagWriter::AsyncBagWriter()
+    : bag_open_(false),
+      writer_triggered_(false),
+      running_(false),
+      triggered_(false),
+      active_producers_(0),
+      overflow_policy_(BagOverflowPolicy::kDropNewest),
+      mask_(0),
+      enqueue_position_(0),
+      dequeue_position_(0),
+      written_count_(0),
+      dropped_count_(0),
+      error_count_(0),
+      file_size_(0),
+      pre_trigger_bytes_(0) {}
+
+AsyncBagWriter::~AsyncBagWriter() {
+  Close();
+}
+
+void AsyncBagWriter::Open(const std::string& filename,
+                          const AsyncBagWriterOptions& options) {
+  Close();
+
+  size_t capacity = 2;
+  while (capacity < options.queue_size) {
+    capacity <<= 1;
+  }
+  cells_.reset(new Cell[capacity]);
+  for (size_t i = 0; i < capacity; ++i) {
+    cells_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  mask_ = capacity - 1;
+  enqueue_position_.store(0, std::memory_order_relaxed);
+  dequeue_position_ = 0;
+  overflow_policy_ = options.overflow_policy;
+
+  written_count_ = 0;
+  dropped_count_ = 0;
+  error_count_ = 0;
+  topic_statistics_.clear();
+  file_size_ = 0;
+
+  pre_trigger_records_.clear();
+  pre_trigger_bytes_ = 0;
+
+  filename_ = filename;
+  options_ = options;
+  triggered_ = options.pre_trigger_duration <= 0.0;
+  if (triggered_) {
+    // Throws a rosbag::BagException on failure, as the synchronous bag did.
+    bag_.open(filename_, rosbag::bagmode::Write);
+    bag_.setCompression(options_.compression);
+    bag_.setChunkThreshold(options_.chunk_threshold);
+    bag_open_ = true;
+  }
+  writer_triggered_ = triggered_;
+
+  running_ = true;
+  thread_ = std::thread(&AsyncBagWriter::Run, this);
+}
+
+void AsyncBagWriter::Close() {
+  if (!thread_.joinable()) {
+    return;
+  }
+  running_ = false;
+  // The writer thread drains the queue before it exits.
+  thread_.join();
+  if (!bag_open_) {
+    pre_trigger_records_.clear();
+    pre_trigger_bytes_ = 0;
+    return;
+  }
+  CloseBag();
+}
+
+void AsyncBagWriter::CloseBag() {
+  bag_.close();
+  bag_open_ = false;
+
+  struct stat file_stat;
+  if (stat(filename_.c_str(), &file_stat) == 0) {
+    file_size_ = file_stat.st_size;
+  }
+}
+
+void AsyncBagWriter::Trigger() {
+  if (!triggered_.exchange(true)) {
+    Request(Slot::kTrigger, std::string());
+  }
+}
+
+void AsyncBagWriter::Rotate(const std::string& filename) {
+  triggered_ = options_.pre_trigger_duration <= 0.0;
+  Request(Slot::kRotate, filename);
+}
+
+void AsyncBagWriter::Request(Slot::Kind kind, const std::string& filename) {
+  ++active_producers_;
+  if (!running_) {
+    --active_producers_;
+    return;
+  }
+  // Requests are never dropped, they wait for a free cell.
+  size_t position;
+  Cell* cell = AcquireCell(&position, false);
+  cell->slot.kind = kind;
+  cell->slot.topic.assign(filename);
+  CommitCell(cell, position);
+  --active_producers_;
+}
+
+AsyncBagWriter::Cell* AsyncBagWriter::AcquireCell(size_t* position,
+                                                  bool may_drop) {
+  // Bounded multi-producer queue, see D. Vyukov, "Bounded MPMC queue".
+  // A cell is free for the producer at position pos if its sequence is pos.
+  size_t pos = enqueue_position_.load(std::memory_order_relaxed);
+  while (true) {
+    Cell* cell = &cells_[pos & mask_];
+    const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+    const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+    if (diff == 0) {
+      if (enqueue_position_.compare_exchange_weak(pos, pos + 1,
+                                                  std::memory_order_relaxed)) {
+        *position = pos;
+        return cell;
+      }
+    }
+    else if (diff < 0) {
+      // Full, the writer thread has not released this cell yet.
+      if (may_drop && overflow_policy_ == BagOverflowPolicy::kDropNewest) {
+        return nullptr;
+      }
+      std::this_thread::yield();
+      pos = enqueue_position_.load(std::memory_order_relaxed);
+    }
+    else {
+      pos = enqueue_position_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void AsyncBagWriter::CommitCell(Cell* cell, size_t position) {
+  cell->sequence.store(position + 1, std::memory_order_release);
+}
+
+bool AsyncBagWriter::WriteNext() {
+  Cell* cell = &cells_[dequeue_position_ & mask_];
+  const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+  if (sequence != dequeue_position_ + 1) {
+    return false;
+  }
+
+  const Slot& slot = cell->slot;
+  if (slot.kind == Slot::kTrigger) {
+    if (!writer_triggered_) {
+      FlushPreTrigger();
+    }
+  }
+  else if (slot.kind == Slot::kRotate) {
+    RotateBag(slot.topic);
+  }
+  else if (!writer_triggered_) {
+    HoldForTrigger(slot);
+  }
+  else {
+    WriteToBag(slot.topic, slot.time, slot.md5sum, slot.datatype,
+               slot.definition, slot.buffer.data(), slot.length);
+  }
+
+  // Release the cell for the producer one lap ahead.
+  cell->sequence.store(dequeue_position_ + mask_ + 1, std::memory_order_release);
+  ++dequeue_position_;
+  return true;
+}
+
+void AsyncBagWriter::WriteToBag(const std::string& topic, const ros::Time& time,
+                                const char* md5sum, const char* datatype,
+                                const char* definition, const uint8_t* buffer,
+                                uint32_t length) {
+  if (!bag_open_) {
+    return;
+  }
+  try {
+    topic_tools::ShapeShifter shape_shifter;
+    shape_shifter.morph(md5sum, datatype, definition, "");
+    ros::serialization::IStream stream(const_cast<uint8_t*>(buffer), length);
+    shape_shifter.read(stream);
+    bag_.write(topic, time, shape_shifter);
+    ++written_count_;
+    BagTopicStatistics& statistics = topic_statistics_[topic];
+    ++statistics.messages;
+    statistics.bytes += length;
+  }
+  catch (const std::exception& e) {
+    // Only report the first failure, a broken bag fails on every message.
+    if (error_count_++ == 0) {
+      if (time < ros::TIME_MIN) {
+        gzerr << "Header stamp not set for msg published on topic: "
+              << topic << ". " << e.what() << std::endl;
+      }
+      else {
+        gzerr << "Error while writing to bag " << e.what() << std::endl;
+      }
+    }
+  }
+}
+
+void AsyncBagWriter::HoldForTrigger(const Slot& slot) {
+  pre_trigger_records_.emplace_back();
+  PreTriggerRecord& record = pre_trigger_records_.back();
+  if (!spare_buffers_.empty()) {
+    record.buffer.swap(spare_buffers_.back());
+    spare_buffers_.pop_back();
+  }
+  record.topic = slot.topic;
+  record.time = slot.time;
+  record.md5sum = slot.md5sum;
+  record.datatype = slot.datatype;
+  record.definition = slot.definition;
+  record.buffer.assign(slot.buffer.begin(), slot.buffer.begin() + slot.length);
+  pre_trigger_bytes_ += slot.length;
+
+  const ros::Duration window(options_.pre_trigger_duration);
+  while (!pre_trigger_records_.empty() &&
+         (pre_trigger_bytes_ > options_.pre_trigger_memory_limit ||
+          slot.time - pre_trigger_records_.front().time > window)) {
+    PreTriggerRecord& oldest = pre_trigger_records_.front();
+    pre_trigger_bytes_ -= oldest.buffer.size();
+    spare_buffers_.push_back(std::vector<uint8_t>());
+    spare_buffers_.back().swap(oldest.buffer);
+    pre_trigger_records_.pop_front();
+  }
+}
+
+void AsyncBagWriter::FlushPreTrigger() {
+  writer_triggered_ = true;
+  try {
+    bag_.open(filename_, rosbag::bagmode::Write);
+    bag_.setCompression(options_.compression);
+    bag_.setChunkThreshold(options_.chunk_threshold);
+    bag_open_ = true;
+  }
+  catch (const rosbag::BagException& e) {
+    gzerr << "Error while opening bag " << filename_ << ": " << e.what()
+          << std::endl;
+    ++error_count_;
+    // Stay triggered, later messages are counted as errors.
+  }
+
+  for (const PreTriggerRecord& record : pre_trigger_records_) {
+    WriteToBag(record.topic, record.time, record.md5sum, record.datatype,
+               record.definition, record.buffer.data(), record.buffer.size());
+  }
+  pre_trigger_records_.clear();
+  spare_buffers_.clear();
+  pre_trigger_bytes_ = 0;
+}
+
+void AsyncBagWriter::RotateBag(const std::string& filename) {
+  if (bag_open_) {
+    CloseBag();
+    gzmsg << "[async_bag_writer] Closed " << filename_ << ", "
+          << written_count_ << " messages, " << file_size_ << " bytes\n";
+  }
+  pre_trigger_records_.clear();
+  pre_trigger_bytes_ = 0;
+  written_count_ = 0;
+  topic_statistics_.clear();
+  file_size_ = 0;
+
+  filename_ = filename;
+  writer_triggered_ = false;
+  if (options_.pre_trigger_duration <= 0.0) {
+    // Opens the bag, there is nothing held.
+    FlushPreTrigger();
+  }
+}
+
+void AsyncBagWriter::Run() {
+  while (running_ || active_producers_ > 0) {
+    if (!WriteNext()) {
+      std::this_thread::sleep_for(kWriterIdleSleep);
+    }
+  }
+  while (WriteNext()) {}
+}
+
+}
@@ -0,0 +1,317 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// MODULE
+#include "rotors_gazebo_plugins/flight_recorder.h"
+
+// SYSTEM
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace gazebo {
+
+static const char kFlightRecorderMagic[8] = {'R', 'F', 'L', 'T', 'R', 'E', 'C', '\0'};
+static const uint32_t kFlightRecorderVersion = 2;
+
+static_assert(sizeof(FlightRecorderHeader) <= kFlightRecorderHeaderSize,
+              "FlightRecorderHeader does not fit into its page.");
+
+static size_t SegmentSize(uint64_t capacity) {
+  return kFlightRecorderHeaderSize +
+      capacity * (sizeof(uint64_t) + kFrDoubleColumnCount * sizeof(double) +
+                  kFrColumnCount * sizeof(float));
+}
+
+static size_t DoubleColumnOffset(uint64_t capacity, unsigned int column) {
+  return kFlightRecorderHeaderSize + capacity * sizeof(uint64_t) +
+      capacity * column * sizeof(double);
+}
+
+static size_t ColumnOffset(uint64_t capacity, unsigned int column) {
+  return DoubleColumnOffset(capacity, kFrDoubleColumnCount) +
+      capacity * column * sizeof(float);
+}
+
+/// \brief    Copies a name into a header field, truncated and null terminated.
+static void CopyName(const std::string& name,
+                     char (&field)[kFlightRecorderNameLength]) {
+  const size_t length = std::min(name.size(), kFlightRecorderNameLength - 1);
+  memcpy(field, name.data(), length);
+  field[length] = '\0';
+}
+
+static std::string ReadName(const char (&field)[kFlightRecorderNameLength]) {
+  return std::string(field, strnlen(field, kFlightRecorderNameLength));
+}
+
+std::string FlightRecorderReader::SegmentPath(const std::string& base_path,
+                                              unsigned int slot) {
+  return base_path + "." + std::to_string(slot) + ".frec";
+}
+
+FlightRecorderWriter::FlightRecorderWriter()
+    : segment_samples_(kDefaultFlightRecorderSegmentSamples),
+      num_segments_(kDefaultFlightRecorderSegments),
+      num_rotors_(0),
+      sequence_(0),
+      total_samples_(0),
+      fd_(-1),
+      data_(nullptr),
+      size_(0),
+      header_(nullptr),
+      time_column_(nullptr) {}
+
+FlightRecorderWriter::~FlightRecorderWriter() {
+  Close();
+}
+
+bool FlightRecorderWriter::Open(const std::string& base_path,
+                                uint64_t segment_samples,
+                                unsigned int num_segments,
+                                unsigned int num_rotors,
+                                const FlightRecorderNames& names) {
+  Close();
+  base_path_ = base_path;
+  segment_samples_ = std::max<uint64_t>(segment_samples, 1);
+  num_segments_ = std::max(num_segments, 1u);
+  num_rotors_ = std::min(num_rotors, kFlightRecorderMaxRotors);
+  names_ = names;
+  sequence_ = 0;
+  total_samples_ = 0;
+
+  // Remove segments of an earlier recording with the same name, they would
+  // otherwise be listed as part of this one.
+  for (unsigned int slot = 0;
+       unlink(FlightRecorderReader::SegmentPath(base_path_, slot).c_str()) == 0 ||
+       slot < num_segments_;
+       ++slot) {}
+
+  return OpenSegment();
+}
+
+void FlightRecorderWriter::Close() {
+  CloseSegment();
+}
+
+bool FlightRecorderWriter::OpenSegment() {
+  const std::string path =
+      FlightRecorderReader::SegmentPath(base_path_, sequence_ % num_segments_);
+  size_ = SegmentSize(segment_samples_);
+
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    return false;
+  }
+  if (ftruncate(fd_, size_) != 0) {
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  void* data = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (data == MAP_FAILED) {
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  data_ = static_cast<uint8_t*>(data);
+
+  header_ = reinterpret_cast<FlightRecorderHeader*>(data_);
+  memcpy(header_->magic, kFlightRecorderMagic, sizeof(kFlightRecorderMagic));
+  header_->version = kFlightRecorderVersion;
+  header_->num_rotors = num_rotors_;
+  header_->num_segments = num_segments_;
+  header_->double_column_count = kFrDoubleColumnCount;
+  header_->column_count = kFrColumnCount;
+  header_->sequence = sequence_;
+  header_->capacity = segment_samples_;
+  header_->sample_count = 0;
+  CopyName(names_.robot_namespace, header_->robot_namespace);
+  CopyName(names_.frame_id, header_->frame_id);
+  CopyName(names_.wrench_frame_id, header_->wrench_frame_id);
+
+  time_column_ = reinterpret_cast<uint64_t*>(data_ + kFlightRecorderHeaderSize);
+  for (unsigned int c = 0; c < kFrDoubleColumnCount; ++c) {
+    double_columns_[c] =
+        reinterpret_cast<double*>(data_ + DoubleColumnOffset(segment_samples_, c));
+  }
+  for (unsigned int c = 0; c < kFrColumnCount; ++c) {
+    columns_[c] = reinterpret_cast<float*>(data_ + ColumnOffset(segment_samples_, c));
+  }
+  return true;
+}
+
+void FlightRecorderWriter::CloseSegment() {
+  if (data_) {
+    // Start the write back, but do not wait for it.
+    msync(data_, size_, MS_ASYNC);
+    munmap(data_, size_);
+    data_ = nullptr;
+    header_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+bool FlightRecorderWriter::Write(const FlightRecorderSample& sample) {
+  if (!data_) {
+    return false;
+  }
+  if (header_->sample_count == segment_samples_) {
+    CloseSegment();
+    ++sequence_;
+    if (!OpenSegment()) {
+      return false;
+    }
+  }
+
+  const uint64_t index = header_->sample_count;
+  time_column_[index] = sample.time_ns;
+  for (unsigned int c = 0; c < kFrDoubleColumnCount; ++c) {
+    double_columns_[c][index] = sample.double_values[c];
+  }
+  for (unsigned int c = 0; c < kFrColumnCount; ++c) {
+    columns_[c][index] = sample.values[c];
+  }
+  header_->sample_count = index + 1;
+  ++total_samples_;
+  return true;
+}
+
+FlightRecorderReader::FlightRecorderReader()
+    : fd_(-1),
+      data_(nullptr),
+      size_(0),
+      header_(nullptr),
+      sample_count_(0),
+      time_column_(nullptr) {}
+
+FlightRecorderReader::~FlightRecorderReader() {
+  Close();
+}
+
+bool FlightRecorderReader::Open(const std::string& path) {
+  Close();
+
+  fd_ = open(path.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd_, &file_stat) != 0 ||
+      static_cast<size_t>(file_stat.st_size) < kFlightRecorderHeaderSize) {
+    Close();
+    return false;
+  }
+  size_ = file_stat.st_size;
+  void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+  if (data == MAP_FAILED) {
+    data_ = nullptr;
+    Close();
+    return false;
+  }
+  data_ = static_cast<const uint8_t*>(data);
+  header_ = reinterpret_cast<const FlightRecorderHeader*>(data_);
+
+  if (memcmp(header_->magic, kFlightRecorderMagic, sizeof(kFlightRecorderMagic)) != 0 ||
+      header_->version != kFlightRecorderVersion ||
+      header_->double_column_count != kFrDoubleColumnCount ||
+      header_->column_count != kFrColumnCount ||
+      size_ < SegmentSize(header_->capacity)) {
+    Close();
+    return false;
+  }
+
+  sample_count_ = std::min(header_->sample_count, header_->capacity);
+  time_column_ = reinterpret_cast<const uint64_t*>(data_ + kFlightRecorderHeaderSize);
+  for (unsigned int c = 0; c < kFrDoubleColumnCount; ++c) {
+    double_columns_[c] = reinterpret_cast<const double*>(
+        data_ + DoubleColumnOffset(header_->capacity, c));
+  }
+  for (unsigned int c = 0; c < kFrColumnCount; ++c) {
+    columns_[c] = reinterpret_cast<const float*>(data_ + ColumnOffset(header_->capacity, c));
+  }
+  return true;
+}
+
+void FlightRecorderReader::Close() {
+  if (data_) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+    data_ = nullptr;
+    header_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+  sample_count_ = 0;
+}
+
+void FlightRecorderReader::GetSample(uint64_t index,
+                                     FlightRecorderSample* sample) const {
+  sample->time_ns = time_column_[index];
+  for (unsigned int c = 0; c < kFrDoubleColumnCount; ++c) {
+    sample->double_values[c] = double_columns_[c][index];
+  }
+  for (unsigned int c = 0; c < kFrColumnCount; ++c) {
+    sample->values[c] = columns_[c][index];
+  }
+}
+
+FlightRecorderNames FlightRecorderReader::GetNames() const {
+  FlightRecorderNames names;
+  names.robot_namespace = ReadName(header_->robot_namespace);
+  names.frame_id = ReadName(header_->frame_id);
+  names.wrench_frame_id = ReadName(header_->wrench_frame_id);
+  return names;
+}
+
+std::vector<std::string> FlightRecorderReader::ListSegments(
+    const std::string& base_path) {
+  std::vector<std::string> segments;
+
+  FlightRecorderReader reader;
+  if (!reader.Open(SegmentPath(base_path, 0))) {
+    return segments;
+  }
+  const unsigned int num_segments = reader.GetNumSegments();
+
+  std::vector<std::pair<uint64_t, std::string> > sequenced_segments;
+  for (unsigned int slot = 0; slot < num_segments; ++slot) {
+    const std::string path = SegmentPath(base_path, slot);
+    if (reader.Open(path)) {
+      sequenced_segments.push_back(std::make_pair(reader.GetSequence(), path));
+    }
+  }
+  std::sort(sequenced_segments.begin(), sequenced_segments.end());
+
+  for (const auto& segment : sequenced_segments) {
+    segments.push_back(segment.second);
+  }
+  return segments;
+}
+
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/// \brief    Converts a flight recorder written by GazeboBagPlugin to a bag
+///           with the same topics as the bag plugin writes.
+/// \details  Usage: flight_recorder_to_bag <base_path> <output.bag> [namespace]
+///           where <base_path> is the segment name without ".<slot>.frec".
+///           The namespace and the frame ids are the ones recorded, the
+///           optional namespace argument replaces the recorded one.
+
+// SYSTEM
+#include <iostream>
+#include <string>
+#include <vector>
+
+// 3RD PARTY
+#include <geometry_msgs/PoseStamped.h>
+#include <geometry_msgs/TwistStamped.h>
+#include <geometry_msgs/WrenchStamped.h>
+#include <mav_msgs/Actuators.h>
+#include <mav_msgs/default_topics.h>
+#include <ros/time.h>
+#include <rosbag/bag.h>
+
+// USER
+#include "rotors_gazebo_plugins/flight_recorder.h"
+
+using namespace gazebo;
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cerr << "Usage: flight_recorder_to_bag <base_path> <output.bag> "
+                 "[namespace]" << std::endl;
+    return 1;
+  }
+  const std::string base_path(argv[1]);
+  const std::string bag_path(argv[2]);
+
+  const std::vector<std::string> segments =
+      FlightRecorderReader::ListSegments(base_path);
+  FlightRecorderReader reader;
+  if (segments.empty() || !reader.Open(segments.front())) {
+    std::cerr << "No flight recorder segments found at " << base_path << std::endl;
+    return 1;
+  }
+  FlightRecorderNames names = reader.GetNames();
+  if (argc > 3) {
+    names.robot_namespace = argv[3];
+  }
+  // The same topic names as GazeboBagPlugin writes.
+  const std::string topic_prefix = names.robot_namespace + "/";
+
+  ros::Time::init();
+  rosbag::Bag bag;
+  bag.open(bag_path, rosbag::bagmode::Write);
+  bag.setCompression(rosbag::compression::LZ4);
+
+  const std::string pose_topic =
+      topic_prefix + mav_msgs::default_topics::GROUND_TRUTH_POSE;
+  const std::string twist_topic =
+      topic_prefix + mav_msgs::default_topics::GROUND_TRUTH_TWIST;
+  const std::string motor_topic =
+      topic_prefix + mav_msgs::default_topics::MOTOR_MEASUREMENT;
+  const std::string wrench_topic = topic_prefix + mav_msgs::default_topics::WRENCH;
+
+  geometry_msgs::PoseStamped pose_msg;
+  geometry_msgs::TwistStamped twist_msg;
+  geometry_msgs::WrenchStamped wrench_msg;
+  mav_msgs::Actuators rot_velocities_msg;
+  pose_msg.header.frame_id = names.frame_id;
+  twist_msg.header.frame_id = names.frame_id;
+  wrench_msg.header.frame_id = names.wrench_frame_id;
+
+  uint64_t sample_count = 0;
+  FlightRecorderSample sample;
+  for (const std::string& segment : segments) {
+    if (!reader.Open(segment)) {
+      std::cerr << "Skipping unreadable segment " << segment << std::endl;
+      continue;
+    }
+    rot_velocities_msg.angular_velocities.resize(reader.GetNumRotors());
+
+    for (uint64_t i = 0; i < reader.GetSampleCount(); ++i) {
+      reader.GetSample(i, &sample);
+      const float* values = sample.values;
+      ros::Time stamp;
+      stamp.fromNSec(sample.time_ns);
+
+      pose_msg.header.stamp = stamp;
+      pose_msg.pose.position.x = sample.double_values[kFrPositionX];
+      pose_msg.pose.position.y = sample.double_values[kFrPositionY];
+      pose_msg.pose.position.z = sample.double_values[kFrPositionZ];
+      pose_msg.pose.orientation.w = values[kFrOrientationW];
+      pose_msg.pose.orientation.x = values[kFrOrientationX];
+      pose_msg.pose.orientation.y = values[kFrOrientationY];
+      pose_msg.pose.orientation.z = values[kFrOrientationZ];
+      bag.write(pose_topic, stamp, pose_msg);
+
+      twist_msg.header.stamp = stamp;
+      twist_msg.twist.linear.x = values[kFrLinearVelocityX];
+      twist_msg.twist.linear.y = values[kFrLinearVelocityY];
+      twist_msg.twist.linear.z = values[kFrLinearVelocityZ];
+      twist_msg.twist.angular.x = values[kFrAngularVelocityX];
+      twist_msg.twist.angular.y = values[kFrAngularVelocityY];
+      twist_msg.twist.angular.z = values[kFrAngularVelocityZ];
+      bag.write(twist_topic, stamp, twist_msg);
+
+      rot_velocities_msg.header.stamp = stamp;
+      for (unsigned int r = 0; r < reader.GetNumRotors(); ++r) {
+        rot_velocities_msg.angular_velocities[r] = values[kFrRotorSpeed0 + r];
+      }
+      bag.write(motor_topic, stamp, rot_velocities_msg);
+
+      wrench_msg.header.stamp = stamp;
+      wrench_msg.wrench.force.x = values[kFrForceX];
+      wrench_msg.wrench.force.y = values[kFrForceY];
+      wrench_msg.wrench.force.z = values[kFrForceZ];
+      wrench_msg.wrench.torque.x = values[kFrTorqueX];
+      wrench_msg.wrench.torque.y = values[kFrTorqueY];
+      wrench_msg.wrench.torque.z = values[kFrTorqueZ];
+      bag.write(wrench_topic, stamp, wrench_msg);
+    }
+    sample_count += reader.GetSampleCount();
+  }
+
+  bag.close();
+  std::cout << "Wrote " << sample_count << " samples from " << segments.size()
+            << " segments to " << bag_path << std::endl;
+  return 0;
+}
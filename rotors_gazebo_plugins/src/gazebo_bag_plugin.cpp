@@ -21,6 +21,8 @@
 
 #include "rotors_gazebo_plugins/gazebo_bag_plugin.h"
 
+#include <algorithm>
+#include <cmath>
 #include <ctime>
 
 #include <mav_msgs/Actuators.h>
@@ -33,7 +35,8 @@ GazeboBagPlugin::~GazeboBagPlugin() {
     node_handle_->shutdown();
     delete node_handle_;
   }
-  bag_.close();
+  bag_writer_.Close();
+  flight_recorder_.Close();
 }
 
 void GazeboBagPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
@@ -43,6 +46,8 @@ void GazeboBagPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
 
   // Store the pointer to the model
   model_ = _model;
+  profiler_entry_ = PluginProfiler::Instance().GetEntry(
+      "GazeboBagPlugin", model_->GetName());
   // world_ = physics::get_world(model_->world.name);
   world_ = model_->GetWorld();
 
@@ -108,6 +113,106 @@ void GazeboBagPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
 
   getSdfParam<bool>(_sdf, "waitToRecordBag", wait_to_record_, wait_to_record_);
 
+  int writer_queue_size = writer_options_.queue_size;
+  getSdfParam<int>(_sdf, "writerQueueSize", writer_queue_size,
+                   writer_queue_size);
+  if (writer_queue_size > 0) {
+    writer_options_.queue_size = writer_queue_size;
+  } else {
+    gzerr << "[gazebo_bag_plugin] writerQueueSize must be positive, using "
+          << writer_options_.queue_size << ".\n";
+  }
+  std::string writer_overflow_policy = kDefaultWriterOverflowPolicy;
+  getSdfParam<std::string>(_sdf, "writerOverflowPolicy", writer_overflow_policy,
+                           writer_overflow_policy);
+  if (writer_overflow_policy == "drop") {
+    writer_options_.overflow_policy = BagOverflowPolicy::kDropNewest;
+  } else if (writer_overflow_policy == "block") {
+    writer_options_.overflow_policy = BagOverflowPolicy::kBlock;
+  } else {
+    gzerr << "[gazebo_bag_plugin] Unknown writerOverflowPolicy \""
+          << writer_overflow_policy << "\", using \""
+          << kDefaultWriterOverflowPolicy << "\".\n";
+  }
+
+  std::string bag_compression = kDefaultBagCompression;
+  getSdfParam<std::string>(_sdf, "bagCompression", bag_compression,
+                           bag_compression);
+  if (bag_compression == "none") {
+    writer_options_.compression = rosbag::compression::Uncompressed;
+  } else if (bag_compression == "lz4") {
+    writer_options_.compression = rosbag::compression::LZ4;
+  } else if (bag_compression == "bz2") {
+    writer_options_.compression = rosbag::compression::BZ2;
+  } else {
+    gzerr << "[gazebo_bag_plugin] Unknown bagCompression \""
+          << bag_compression << "\", using \""
+          << kDefaultBagCompression << "\".\n";
+  }
+  int bag_chunk_size = writer_options_.chunk_threshold;
+  getSdfParam<int>(_sdf, "bagChunkSize", bag_chunk_size, bag_chunk_size);
+  if (bag_chunk_size > 0) {
+    writer_options_.chunk_threshold = bag_chunk_size;
+  } else {
+    gzerr << "[gazebo_bag_plugin] bagChunkSize must be positive, using "
+          << writer_options_.chunk_threshold << ".\n";
+  }
+
+  getSdfParam<int>(_sdf, "groundTruthDecimation", ground_truth_decimation_,
+                   ground_truth_decimation_);
+  getSdfParam<int>(_sdf, "motorDecimation", motor_decimation_,
+                   motor_decimation_);
+  getSdfParam<int>(_sdf, "wrenchDecimation", wrench_decimation_,
+                   wrench_decimation_);
+  ground_truth_decimation_ = std::max(ground_truth_decimation_, 1);
+  motor_decimation_ = std::max(motor_decimation_, 1);
+  wrench_decimation_ = std::max(wrench_decimation_, 1);
+  getSdfParam<bool>(_sdf, "motorLogOnChange", motor_log_on_change_,
+                    motor_log_on_change_);
+  getSdfParam<double>(_sdf, "motorChangeThreshold", motor_change_threshold_,
+                      motor_change_threshold_);
+
+  getSdfParam<double>(_sdf, "preTriggerDuration",
+                      writer_options_.pre_trigger_duration,
+                      kDefaultPreTriggerDuration);
+  int pre_trigger_memory_limit_mb =
+      writer_options_.pre_trigger_memory_limit / (1024 * 1024);
+  getSdfParam<int>(_sdf, "preTriggerMemoryLimitMB", pre_trigger_memory_limit_mb,
+                   pre_trigger_memory_limit_mb);
+  writer_options_.pre_trigger_memory_limit =
+      static_cast<uint64_t>(pre_trigger_memory_limit_mb) * 1024 * 1024;
+  getSdfParam<double>(_sdf, "postTriggerDuration", post_trigger_duration_,
+                      post_trigger_duration_);
+  getSdfParam<double>(_sdf, "triggerCollisionForce", trigger_collision_force_,
+                      trigger_collision_force_);
+  getSdfParam<double>(_sdf, "triggerAttitudeLimit", trigger_attitude_limit_,
+                      trigger_attitude_limit_);
+
+  getSdfParam<std::string>(_sdf, "flightRecorderPath", flight_recorder_path_,
+                           flight_recorder_path_);
+  getSdfParam<int>(_sdf, "flightRecorderSegmentSamples",
+                   flight_recorder_segment_samples_,
+                   flight_recorder_segment_samples_);
+  getSdfParam<int>(_sdf, "flightRecorderSegments", flight_recorder_segments_,
+                   flight_recorder_segments_);
+
+  bag_topics_.ground_truth_pose = namespace_ + "/" + ground_truth_pose_topic_;
+  bag_topics_.ground_truth_twist = namespace_ + "/" + ground_truth_twist_topic_;
+  bag_topics_.imu = namespace_ + "/" + imu_topic_;
+  bag_topics_.external_force = namespace_ + "/" + external_force_topic_;
+  bag_topics_.waypoint = namespace_ + "/" + waypoint_topic_;
+  bag_topics_.command_pose = namespace_ + "/" + command_pose_topic_;
+  bag_topics_.control_attitude_thrust =
+      namespace_ + "/" + control_attitude_thrust_topic_;
+  bag_topics_.control_motor_speed = namespace_ + "/" + control_motor_speed_topic_;
+  bag_topics_.control_rate_thrust = namespace_ + "/" + control_rate_thrust_topic_;
+  bag_topics_.wind_speed = namespace_ + "/" + wind_speed_topic_;
+  bag_topics_.wrench = namespace_ + "/" + wrench_topic_;
+  bag_topics_.motor = namespace_ + "/" + motor_topic_;
+
+  pose_msg_.header.frame_id = frame_id_;
+  twist_msg_.header.frame_id = frame_id_;
+
   recording_service_ = node_handle_->advertiseService(
       recording_service_name_, &GazeboBagPlugin::RecordingServiceCallback,
       this);
@@ -127,6 +232,7 @@ void GazeboBagPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
       motor_joints_.insert(MotorNumberToJointPair(motor_number, joint));
     }
   }
+  rot_velocities_msg_.angular_velocities.resize(motor_joints_.size());
 
   // Get the contact manager.
   std::vector<std::string> collisions;
@@ -135,8 +241,9 @@ void GazeboBagPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
     physics::CollisionPtr collision = link_->GetCollision(i);
     collisions.push_back(collision->GetScopedName());
   }
+  link_ids_.insert(link_->GetId());
   for (unsigned int j = 0; j < child_links_.size(); ++j) {
-    unsigned int zero = 0;
+    link_ids_.insert(child_links_[j]->GetId());
     for (unsigned int i = 0; i < child_links_[j]->GetCollisions().size(); ++i) {
       collisions.push_back(child_links_[j]->GetCollision(i)->GetScopedName());
     }
@@ -152,18 +259,33 @@ void GazeboBagPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
 
 // This gets called by the world update start event.
 void GazeboBagPlugin::OnUpdate(const common::UpdateInfo& _info) {
+  ROTORS_PROFILE_SCOPE(profiler_entry_);
   if (kPrintOnUpdates) {
     gzdbg << __FUNCTION__ << "() called." << std::endl;
   }
 
   // Get the current simulation time.
   common::Time now = world_->GetSimTime();
-  LogWrenches(now);
-  LogGroundTruth(now);
-  LogMotorVelocities(now);
+  if (writer_options_.pre_trigger_duration > 0.0) {
+    CheckTriggers(now);
+  }
+  if (flight_recorder_.IsOpen()) {
+    LogFlightRecorderSample(now);
+    return;
+  }
+  if (update_counter_ % wrench_decimation_ == 0) {
+    LogWrenches(now);
+  }
+  if (update_counter_ % ground_truth_decimation_ == 0) {
+    LogGroundTruth(now);
+  }
+  if (update_counter_ % motor_decimation_ == 0) {
+    LogMotorVelocities(now);
+  }
+  ++update_counter_;
 }
 
-void GazeboBagPlugin::StartRecording() {
+static std::string GetDateTimeString() {
   time_t rawtime;
   struct tm* timeinfo;
   char buffer[80];
@@ -172,7 +294,11 @@ void GazeboBagPlugin::StartRecording() {
   timeinfo = localtime(&rawtime);
 
   strftime(buffer, 80, "%Y-%m-%d-%H-%M-%S", timeinfo);
-  std::string date_time_str(buffer);
+  return std::string(buffer);
+}
+
+void GazeboBagPlugin::StartRecording() {
+  std::string date_time_str = GetDateTimeString();
 
   std::string key(".bag");
   size_t pos = bag_filename_.rfind(key);
@@ -182,7 +308,28 @@ void GazeboBagPlugin::StartRecording() {
   std::string full_bag_filename = bag_filename_ + "_" + date_time_str + ".bag";
 
   // Open a bag file and store it in ~/.ros/<full_bag_filename>.
-  bag_.open(full_bag_filename, rosbag::bagmode::Write);
+  bag_writer_.Open(full_bag_filename, writer_options_);
+  update_counter_ = 0;
+  last_motor_velocities_.clear();
+  trigger_requested_ = false;
+
+  if (!flight_recorder_path_.empty()) {
+    std::string flight_recorder_base = flight_recorder_path_ + "_" + date_time_str;
+    FlightRecorderNames flight_recorder_names;
+    flight_recorder_names.robot_namespace = namespace_;
+    flight_recorder_names.frame_id = frame_id_;
+    flight_recorder_names.wrench_frame_id = link_->GetScopedName();
+    if (flight_recorder_.Open(flight_recorder_base,
+                              flight_recorder_segment_samples_,
+                              flight_recorder_segments_, motor_joints_.size(),
+                              flight_recorder_names)) {
+      ROS_INFO("GazeboBagPlugin START flight recorder %s",
+               flight_recorder_base.c_str());
+    } else {
+      gzerr << "[gazebo_bag_plugin] Could not open the flight recorder at "
+            << flight_recorder_base << ", logging to the bag instead.\n";
+    }
+  }
 
   // Subscriber to IMU sensor_msgs::Imu Message.
   imu_sub_ = node_handle_->subscribe(imu_topic_, 10,
@@ -228,8 +375,14 @@ void GazeboBagPlugin::StartRecording() {
   // Set the flag that we are actively recording.
   is_recording_ = true;
 
-  ROS_INFO("GazeboBagPlugin START recording bagfile %s",
-           full_bag_filename.c_str());
+  if (bag_writer_.IsTriggered()) {
+    ROS_INFO("GazeboBagPlugin START recording bagfile %s",
+             full_bag_filename.c_str());
+  } else {
+    ROS_INFO("GazeboBagPlugin ARMED bagfile %s, holding %.1f s before the "
+             "trigger", full_bag_filename.c_str(),
+             writer_options_.pre_trigger_duration);
+  }
 }
 
 void GazeboBagPlugin::StopRecording() {
@@ -246,171 +399,363 @@ void GazeboBagPlugin::StopRecording() {
   // Disconnect the update event.
   event::Events::DisconnectWorldUpdateBegin(update_connection_);
 
-  // Close the bag.
-  bag_.close();
+  // Write the remaining queued messages and close the bag.
+  bag_writer_.Close();
+  if (flight_recorder_.IsOpen()) {
+    ROS_INFO("GazeboBagPlugin STOP flight recorder, %lu samples written",
+             static_cast<unsigned long>(flight_recorder_.GetSampleCount()));
+    flight_recorder_.Close();
+  }
 
   // Clear the flag to show that we are not actively recording
   is_recording_ = false;
 
-  ROS_INFO("GazeboBagPlugin STOP recording bagfile");
+  ROS_INFO("GazeboBagPlugin STOP recording bagfile, %lu messages written, "
+           "%lu dropped, %lu write errors",
+           static_cast<unsigned long>(bag_writer_.GetWrittenCount()),
+           static_cast<unsigned long>(bag_writer_.GetDroppedCount()),
+           static_cast<unsigned long>(bag_writer_.GetErrorCount()));
+  PrintBagStatistics();
+}
+
+void GazeboBagPlugin::PrintBagStatistics() {
+  uint64_t total_bytes = 0;
+  for (const auto& topic : bag_writer_.GetTopicStatistics()) {
+    total_bytes += topic.second.bytes;
+  }
+  ROS_INFO("GazeboBagPlugin bagfile size %lu bytes, %lu bytes of messages",
+           static_cast<unsigned long>(bag_writer_.GetFileSize()),
+           static_cast<unsigned long>(total_bytes));
+  for (const auto& topic : bag_writer_.GetTopicStatistics()) {
+    ROS_INFO("  %s: %lu messages, %lu bytes (%.1f%%)", topic.first.c_str(),
+             static_cast<unsigned long>(topic.second.messages),
+             static_cast<unsigned long>(topic.second.bytes),
+             total_bytes ? 100.0 * topic.second.bytes / total_bytes : 0.0);
+  }
 }
 
 void GazeboBagPlugin::ImuCallback(const sensor_msgs::ImuConstPtr& imu_msg) {
   common::Time now = world_->GetSimTime();
   ros::Time ros_now = ros::Time(now.sec, now.nsec);
-  writeBag(namespace_ + "/" + imu_topic_, ros_now, imu_msg);
+  writeBag(bag_topics_.imu, ros_now, imu_msg);
 }
 
 void GazeboBagPlugin::ExternalForceCallback(
     const geometry_msgs::WrenchStampedConstPtr& force_msg) {
   common::Time now = world_->GetSimTime();
   ros::Time ros_now = ros::Time(now.sec, now.nsec);
-  writeBag(namespace_ + "/" + external_force_topic_, ros_now, force_msg);
+  writeBag(bag_topics_.external_force, ros_now, force_msg);
 }
 
 void GazeboBagPlugin::WaypointCallback(
     const trajectory_msgs::MultiDOFJointTrajectoryConstPtr& trajectory_msg) {
   common::Time now = world_->GetSimTime();
   ros::Time ros_now = ros::Time(now.sec, now.nsec);
-  writeBag(namespace_ + "/" + waypoint_topic_, ros_now, trajectory_msg);
+  writeBag(bag_topics_.waypoint, ros_now, trajectory_msg);
 }
 
 void GazeboBagPlugin::CommandPoseCallback(
     const geometry_msgs::PoseStampedConstPtr& pose_msg) {
   common::Time now = world_->GetSimTime();
   ros::Time ros_now = ros::Time(now.sec, now.nsec);
-  writeBag(namespace_ + "/" + command_pose_topic_, ros_now, pose_msg);
+  writeBag(bag_topics_.command_pose, ros_now, pose_msg);
 }
 
 void GazeboBagPlugin::AttitudeThrustCallback(
     const mav_msgs::AttitudeThrustConstPtr& control_msg) {
   common::Time now = world_->GetSimTime();
   ros::Time ros_now = ros::Time(now.sec, now.nsec);
-  writeBag(namespace_ + "/" + control_attitude_thrust_topic_, ros_now,
-           control_msg);
+  writeBag(bag_topics_.control_attitude_thrust, ros_now, control_msg);
 }
 
 void GazeboBagPlugin::ActuatorsCallback(
     const mav_msgs::ActuatorsConstPtr& control_msg) {
   common::Time now = world_->GetSimTime();
   ros::Time ros_now = ros::Time(now.sec, now.nsec);
-  writeBag(namespace_ + "/" + control_motor_speed_topic_, ros_now, control_msg);
+  writeBag(bag_topics_.control_motor_speed, ros_now, control_msg);
 }
 
 void GazeboBagPlugin::RateThrustCallback(
     const mav_msgs::RateThrustConstPtr& control_msg) {
   common::Time now = world_->GetSimTime();
   ros::Time ros_now = ros::Time(now.sec, now.nsec);
-  writeBag(namespace_ + "/" + control_rate_thrust_topic_, ros_now, control_msg);
+  writeBag(bag_topics_.control_rate_thrust, ros_now, control_msg);
 }
 
 void GazeboBagPlugin::WindSpeedCallback(
     const rotors_comm::WindSpeedConstPtr& wind_speed_msg) {
   common::Time now = world_->GetSimTime();
   ros::Time ros_now = ros::Time(now.sec, now.nsec);
-  writeBag(namespace_ + "/" + wind_speed_topic_, ros_now, wind_speed_msg);
+  writeBag(bag_topics_.wind_speed, ros_now, wind_speed_msg);
 }
 
 void GazeboBagPlugin::LogMotorVelocities(const common::Time now) {
   ros::Time ros_now = ros::Time(now.sec, now.nsec);
 
-  mav_msgs::Actuators rot_velocities_msg;
-  rot_velocities_msg.angular_velocities.resize(motor_joints_.size());
-
   MotorNumberToJointMap::iterator m;
   for (m = motor_joints_.begin(); m != motor_joints_.end(); ++m) {
     double motor_rot_vel =
         m->second->GetVelocity(0) * rotor_velocity_slowdown_sim_;
-    rot_velocities_msg.angular_velocities[m->first] = motor_rot_vel;
+    rot_velocities_msg_.angular_velocities[m->first] = motor_rot_vel;
+  }
+  rot_velocities_msg_.header.stamp.sec = now.sec;
+  rot_velocities_msg_.header.stamp.nsec = now.nsec;
+
+  if (motor_log_on_change_) {
+    bool changed =
+        last_motor_velocities_.size() != rot_velocities_msg_.angular_velocities.size();
+    for (size_t i = 0; !changed && i < last_motor_velocities_.size(); ++i) {
+      changed = std::abs(rot_velocities_msg_.angular_velocities[i] -
+                         last_motor_velocities_[i]) > motor_change_threshold_;
+    }
+    if (!changed) {
+      return;
+    }
+    last_motor_velocities_ = rot_velocities_msg_.angular_velocities;
   }
-  rot_velocities_msg.header.stamp.sec = now.sec;
-  rot_velocities_msg.header.stamp.nsec = now.nsec;
 
-  writeBag(namespace_ + "/" + motor_topic_, ros_now, rot_velocities_msg);
+  writeBag(bag_topics_.motor, ros_now, rot_velocities_msg_);
 }
 
 void GazeboBagPlugin::LogGroundTruth(const common::Time now) {
   ros::Time ros_now = ros::Time(now.sec, now.nsec);
 
-  geometry_msgs::PoseStamped pose_msg;
-  geometry_msgs::TwistStamped twist_msg;
-
   // Get pose and update the message.
   math::Pose pose = link_->GetWorldPose();
-  pose_msg.header.frame_id = frame_id_;
-  pose_msg.header.stamp.sec = now.sec;
-  pose_msg.header.stamp.nsec = now.nsec;
-  pose_msg.pose.position.x = pose.pos.x;
-  pose_msg.pose.position.y = pose.pos.y;
-  pose_msg.pose.position.z = pose.pos.z;
-  pose_msg.pose.orientation.w = pose.rot.w;
-  pose_msg.pose.orientation.x = pose.rot.x;
-  pose_msg.pose.orientation.y = pose.rot.y;
-  pose_msg.pose.orientation.z = pose.rot.z;
-
-  writeBag(namespace_ + "/" + ground_truth_pose_topic_, ros_now, pose_msg);
+  pose_msg_.header.stamp.sec = now.sec;
+  pose_msg_.header.stamp.nsec = now.nsec;
+  pose_msg_.pose.position.x = pose.pos.x;
+  pose_msg_.pose.position.y = pose.pos.y;
+  pose_msg_.pose.position.z = pose.pos.z;
+  pose_msg_.pose.orientation.w = pose.rot.w;
+  pose_msg_.pose.orientation.x = pose.rot.x;
+  pose_msg_.pose.orientation.y = pose.rot.y;
+  pose_msg_.pose.orientation.z = pose.rot.z;
+
+  writeBag(bag_topics_.ground_truth_pose, ros_now, pose_msg_);
 
   // Get twist and update the message.
   math::Vector3 linear_veloctiy = link_->GetWorldLinearVel();
   math::Vector3 angular_veloctiy = link_->GetWorldAngularVel();
-  twist_msg.header.frame_id = frame_id_;
-  twist_msg.header.stamp.sec = now.sec;
-  twist_msg.header.stamp.nsec = now.nsec;
-  twist_msg.twist.linear.x = linear_veloctiy.x;
-  twist_msg.twist.linear.y = linear_veloctiy.y;
-  twist_msg.twist.linear.z = linear_veloctiy.z;
-  twist_msg.twist.angular.x = angular_veloctiy.x;
-  twist_msg.twist.angular.y = angular_veloctiy.y;
-  twist_msg.twist.angular.z = angular_veloctiy.z;
-
-  writeBag(namespace_ + "/" + ground_truth_twist_topic_, ros_now, twist_msg);
+  twist_msg_.header.stamp.sec = now.sec;
+  twist_msg_.header.stamp.nsec = now.nsec;
+  twist_msg_.twist.linear.x = linear_veloctiy.x;
+  twist_msg_.twist.linear.y = linear_veloctiy.y;
+  twist_msg_.twist.linear.z = linear_veloctiy.z;
+  twist_msg_.twist.angular.x = angular_veloctiy.x;
+  twist_msg_.twist.angular.y = angular_veloctiy.y;
+  twist_msg_.twist.angular.z = angular_veloctiy.z;
+
+  writeBag(bag_topics_.ground_truth_twist, ros_now, twist_msg_);
 }
 
-void GazeboBagPlugin::LogWrenches(const common::Time now) {
-  geometry_msgs::WrenchStamped wrench_msg;
-  std::vector<physics::Contact*> contacts = contact_mgr_->GetContacts();
-  for (int i = 0; i < contact_mgr_->GetContactCount(); ++i) {
-    std::string collision2_name =
-        contacts[i]->collision2->GetLink()->GetScopedName();
+template<class F>
+void GazeboBagPlugin::ForEachOwnContact(F callback) {
+  // The contact manager holds the contacts of the whole world, only the
+  // first GetContactCount() entries are valid.
+  const std::vector<physics::Contact*>& contacts = contact_mgr_->GetContacts();
+  const unsigned int contact_count = contact_mgr_->GetContactCount();
+  geometry_msgs::Vector3 force;
+  geometry_msgs::Vector3 torque;
+  for (unsigned int i = 0; i < contact_count; ++i) {
+    const physics::Contact* contact = contacts[i];
+    physics::LinkPtr link1 = contact->collision1->GetLink();
+    physics::LinkPtr link2 = contact->collision2->GetLink();
+
+    // Report the wrench acting on this model's link, which can be either
+    // side of the contact.
+    bool own_link_first = link_ids_.count(link1->GetId()) > 0;
+    if (!own_link_first) {
+      if (link_ids_.count(link2->GetId()) == 0) {
+        continue;
+      }
+      std::swap(link1, link2);
+    }
+    const physics::JointWrench& wrench = contact->wrench[0];
+    const auto& contact_force = own_link_first ? wrench.body1Force : wrench.body2Force;
+    const auto& contact_torque = own_link_first ? wrench.body1Torque : wrench.body2Torque;
 #if GAZEBO_MAJOR_VERSION >= 8
-    double body1_force = contacts[i]->wrench->body1Force.Length();
+    force.x = contact_force.X();
+    force.y = contact_force.Y();
+    force.z = contact_force.Z();
+    torque.x = contact_torque.X();
+    torque.y = contact_torque.Y();
+    torque.z = contact_torque.Z();
 #else
-    double body1_force = contacts[i]->wrench->body1Force.GetLength();
+    force.x = contact_force.x;
+    force.y = contact_force.y;
+    force.z = contact_force.z;
+    torque.x = contact_torque.x;
+    torque.y = contact_torque.y;
+    torque.z = contact_torque.z;
 #endif
+    callback(link1, link2, force, torque);
+  }
+}
 
+void GazeboBagPlugin::LogWrenches(const common::Time now) {
+  unsigned int logged_count = 0;
+  ForEachOwnContact([&](const physics::LinkPtr& own_link,
+                        const physics::LinkPtr& other_link,
+                        const geometry_msgs::Vector3& force,
+                        const geometry_msgs::Vector3& torque) {
     // Exclude extremely small forces.
-    if (body1_force < 1e-10) continue;
+    if (force.x * force.x + force.y * force.y + force.z * force.z < 1e-20) {
+      return;
+    }
     // Do this, such that all the contacts are logged.
     // (publishing on the same topic with the same time stamp is impossible)
-    ros::Time ros_now = ros::Time(now.sec, now.nsec + i * 1000);
-    std::string collision1_name =
-        contacts[i]->collision1->GetLink()->GetScopedName();
-    wrench_msg.header.frame_id = collision1_name + "--" + collision2_name;
-    wrench_msg.header.stamp.sec = now.sec;
-    wrench_msg.header.stamp.nsec = now.nsec;
-#if GAZEBO_MAJOR_VERSION >= 8
-    wrench_msg.wrench.force.x = contacts[i]->wrench->body1Force.X();
-    wrench_msg.wrench.force.y = contacts[i]->wrench->body1Force.Y();
-    wrench_msg.wrench.force.z = contacts[i]->wrench->body1Force.Z();
-    wrench_msg.wrench.torque.x = contacts[i]->wrench->body1Torque.X();
-    wrench_msg.wrench.torque.y = contacts[i]->wrench->body1Torque.Y();
-    wrench_msg.wrench.torque.z = contacts[i]->wrench->body1Torque.Z();
-#else
-    wrench_msg.wrench.force.x = contacts[i]->wrench->body1Force.x;
-    wrench_msg.wrench.force.y = contacts[i]->wrench->body1Force.y;
-    wrench_msg.wrench.force.z = contacts[i]->wrench->body1Force.z;
-    wrench_msg.wrench.torque.x = contacts[i]->wrench->body1Torque.x;
-    wrench_msg.wrench.torque.y = contacts[i]->wrench->body1Torque.y;
-    wrench_msg.wrench.torque.z = contacts[i]->wrench->body1Torque.z;
-#endif
+    ros::Time ros_now = ros::Time(now.sec, now.nsec + logged_count * 1000);
+    ++logged_count;
+
+    const uint64_t contact_key =
+        (static_cast<uint64_t>(own_link->GetId()) << 32) | other_link->GetId();
+    auto frame_id = contact_frame_ids_.find(contact_key);
+    if (frame_id == contact_frame_ids_.end()) {
+      frame_id = contact_frame_ids_.emplace(
+          contact_key,
+          own_link->GetScopedName() + "--" + other_link->GetScopedName()).first;
+    }
+    wrench_msg_.header.frame_id = frame_id->second;
+    wrench_msg_.header.stamp.sec = now.sec;
+    wrench_msg_.header.stamp.nsec = now.nsec;
+    wrench_msg_.wrench.force = force;
+    wrench_msg_.wrench.torque = torque;
+
+    writeBag(bag_topics_.wrench, ros_now, wrench_msg_);
+  });
+}
+
+void GazeboBagPlugin::LogFlightRecorderSample(const common::Time now) {
+  FlightRecorderSample sample;
+  sample.time_ns = static_cast<uint64_t>(now.sec) * 1000000000ull + now.nsec;
+  float* values = sample.values;
+
+  math::Pose pose = link_->GetWorldPose();
+  math::Vector3 linear_velocity = link_->GetWorldLinearVel();
+  math::Vector3 angular_velocity = link_->GetWorldAngularVel();
+  sample.double_values[kFrPositionX] = pose.pos.x;
+  sample.double_values[kFrPositionY] = pose.pos.y;
+  sample.double_values[kFrPositionZ] = pose.pos.z;
+  values[kFrOrientationW] = pose.rot.w;
+  values[kFrOrientationX] = pose.rot.x;
+  values[kFrOrientationY] = pose.rot.y;
+  values[kFrOrientationZ] = pose.rot.z;
+  values[kFrLinearVelocityX] = linear_velocity.x;
+  values[kFrLinearVelocityY] = linear_velocity.y;
+  values[kFrLinearVelocityZ] = linear_velocity.z;
+  values[kFrAngularVelocityX] = angular_velocity.x;
+  values[kFrAngularVelocityY] = angular_velocity.y;
+  values[kFrAngularVelocityZ] = angular_velocity.z;
+
+  for (unsigned int i = 0; i < kFlightRecorderMaxRotors; ++i) {
+    values[kFrRotorSpeed0 + i] = 0.0f;
+  }
+  MotorNumberToJointMap::iterator m;
+  for (m = motor_joints_.begin(); m != motor_joints_.end(); ++m) {
+    if (m->first < kFlightRecorderMaxRotors) {
+      values[kFrRotorSpeed0 + m->first] =
+          m->second->GetVelocity(0) * rotor_velocity_slowdown_sim_;
+    }
+  }
+
+  // Sum of the contact wrenches acting on the base link. The wrenches of
+  // the other links are in their own frames and about their own origins,
+  // so they cannot be added to it.
+  double force[3] = {0.0, 0.0, 0.0};
+  double torque[3] = {0.0, 0.0, 0.0};
+  ForEachOwnContact([&](const physics::LinkPtr& own_link,
+                        const physics::LinkPtr& /*other_link*/,
+                        const geometry_msgs::Vector3& contact_force,
+                        const geometry_msgs::Vector3& contact_torque) {
+    if (own_link != link_) {
+      return;
+    }
+    force[0] += contact_force.x;
+    force[1] += contact_force.y;
+    force[2] += contact_force.z;
+    torque[0] += contact_torque.x;
+    torque[1] += contact_torque.y;
+    torque[2] += contact_torque.z;
+  });
+  for (unsigned int i = 0; i < 3; ++i) {
+    values[kFrForceX + i] = force[i];
+    values[kFrTorqueX + i] = torque[i];
+  }
+
+  flight_recorder_.Write(sample);
+}
+
+void GazeboBagPlugin::CheckTriggers(const common::Time now) {
+  if (bag_writer_.IsTriggered()) {
+    if ((now - trigger_time_).Double() < post_trigger_duration_) {
+      return;
+    }
+    // Post-trigger window is over, the writer thread closes this bag and
+    // arms a new one. The sequence number keeps bags that are armed within
+    // the same second apart.
+    std::string full_bag_filename = bag_filename_ + "_" + GetDateTimeString() +
+        "_" + std::to_string(++rearmed_bag_count_) + ".bag";
+    bag_writer_.Rotate(full_bag_filename);
+    trigger_requested_ = false;
+    ROS_INFO("GazeboBagPlugin post-trigger window over, ARMED bagfile %s",
+             full_bag_filename.c_str());
+    return;
+  }
+
+  std::string reason;
+  if (trigger_requested_) {
+    reason = "service call";
+  }
 
-    writeBag(namespace_ + "/" + wrench_topic_, ros_now, wrench_msg);
+  if (reason.empty() && trigger_attitude_limit_ > 0.0) {
+    // Angle between the body z axis and the world z axis.
+    math::Quaternion q = link_->GetWorldPose().rot;
+    double cos_tilt = 1.0 - 2.0 * (q.x * q.x + q.y * q.y);
+    if (std::acos(std::max(-1.0, std::min(1.0, cos_tilt))) > trigger_attitude_limit_) {
+      reason = "attitude limit";
+    }
+  }
+
+  if (reason.empty() && trigger_collision_force_ > 0.0) {
+    const double limit_squared = trigger_collision_force_ * trigger_collision_force_;
+    bool collision = false;
+    ForEachOwnContact([&](const physics::LinkPtr& /*own_link*/,
+                          const physics::LinkPtr& /*other_link*/,
+                          const geometry_msgs::Vector3& force,
+                          const geometry_msgs::Vector3& /*torque*/) {
+      collision |= force.x * force.x + force.y * force.y + force.z * force.z >
+          limit_squared;
+    });
+    if (collision) {
+      reason = "collision";
+    }
+  }
+
+  if (!reason.empty()) {
+    trigger_time_ = now;
+    bag_writer_.Trigger();
+    ROS_INFO("GazeboBagPlugin TRIGGERED by %s at %.3f s, recording %.1f s more",
+             reason.c_str(), now.Double(), post_trigger_duration_);
   }
 }
 
 bool GazeboBagPlugin::RecordingServiceCallback(
     rotors_comm::RecordRosbag::Request& req,
     rotors_comm::RecordRosbag::Response& res) {
+  if (req.trigger) {
+    if (is_recording_ && !bag_writer_.IsTriggered()) {
+      // Handled in the update thread, which owns the trigger state.
+      trigger_requested_ = true;
+      res.success = true;
+    } else {
+      gzwarn << "[gazebo_bag_plugin] Not waiting for a trigger, ignoring "
+                "trigger command.\n";
+      res.success = false;
+    }
+    return res.success;
+  }
+
   if (req.record && !is_recording_) {
     StartRecording();
     res.success = true;
@@ -39,6 +39,8 @@ void GazeboControllerInterface::Load(physics::ModelPtr _model,
 
   // Store the pointer to the model.
   model_ = _model;
+  profiler_entry_ = PluginProfiler::Instance().GetEntry(
+      "GazeboControllerInterface", model_->GetName());
 
   world_ = model_->GetWorld();
 
@@ -73,6 +75,7 @@ void GazeboControllerInterface::Load(physics::ModelPtr _model,
 }
 
 void GazeboControllerInterface::OnUpdate(const common::UpdateInfo& /*_info*/) {
+  ROTORS_PROFILE_SCOPE(profiler_entry_);
   if (kPrintOnUpdates) {
     gzdbg << __FUNCTION__ << "() called." << std::endl;
   }
@@ -31,7 +31,8 @@ GazeboFwDynamicsPlugin::GazeboFwDynamicsPlugin()
       delta_flap_(0.0),
       delta_rudder_(0.0),
       throttle_(0.0),
-      pubs_and_subs_created_(false) {
+      pubs_and_subs_created_(false),
+      profiler_entry_(nullptr) {
 }
 
 GazeboFwDynamicsPlugin::~GazeboFwDynamicsPlugin() {
@@ -48,6 +49,8 @@ void GazeboFwDynamicsPlugin::Load(physics::ModelPtr _model,
 
   // Store the pointer to the model.
   model_ = _model;
+  profiler_entry_ = PluginProfiler::Instance().GetEntry(
+      "GazeboFwDynamicsPlugin", model_->GetName());
   world_ = model_->GetWorld();
 
   namespace_.clear();
@@ -122,6 +125,7 @@ void GazeboFwDynamicsPlugin::Load(physics::ModelPtr _model,
 }
 
 void GazeboFwDynamicsPlugin::OnUpdate(const common::UpdateInfo& _info) {
+  ROTORS_PROFILE_SCOPE(profiler_entry_);
   if (kPrintOnUpdates) {
     gzdbg << __FUNCTION__ << "() called." << std::endl;
   }
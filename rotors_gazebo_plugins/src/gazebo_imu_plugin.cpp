@@ -41,7 +41,8 @@ GazeboImuPlugin::GazeboImuPlugin()
     : ModelPlugin(),
       node_handle_(0),
       velocity_prev_W_(0, 0, 0),
-      pubs_and_subs_created_(false) {}
+      pubs_and_subs_created_(false),
+      profiler_entry_(nullptr) {}
 
 GazeboImuPlugin::~GazeboImuPlugin() {
   event::Events::DisconnectWorldUpdateBegin(updateConnection_);
@@ -56,6 +57,8 @@ void GazeboImuPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
 
   // Store the pointer to the model
   model_ = _model;
+  profiler_entry_ = PluginProfiler::Instance().GetEntry(
+      "GazeboImuPlugin", model_->GetName());
   world_ = model_->GetWorld();
 
   // default params
@@ -195,20 +198,7 @@ void GazeboImuPlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
   gravity_W_ = world_->GetPhysicsEngine()->GetGravity();
   imu_parameters_.gravity_magnitude = gravity_W_.GetLength();
 
-  standard_normal_distribution_ = std::normal_distribution<double>(0.0, 1.0);
-
-  double sigma_bon_g = imu_parameters_.gyroscope_turn_on_bias_sigma;
-  double sigma_bon_a = imu_parameters_.accelerometer_turn_on_bias_sigma;
-  for (int i = 0; i < 3; ++i) {
-    gyroscope_turn_on_bias_[i] =
-        sigma_bon_g * standard_normal_distribution_(random_generator_);
-    accelerometer_turn_on_bias_[i] =
-        sigma_bon_a * standard_normal_distribution_(random_generator_);
-  }
-
-  // TODO(nikolicj) incorporate steady-state covariance of bias process
-  gyroscope_bias_.setZero();
-  accelerometer_bias_.setZero();
+  imu_noise_model_.Initialize(imu_parameters_);
 }
 
 void GazeboImuPlugin::AddNoise(Eigen::Vector3d* linear_acceleration,
@@ -218,53 +208,11 @@ void GazeboImuPlugin::AddNoise(Eigen::Vector3d* linear_acceleration,
   GZ_ASSERT(angular_velocity != nullptr, "Angular velocity was null.");
   GZ_ASSERT(dt > 0.0, "Change in time must be greater than 0.");
 
-  // Gyrosocpe
-  double tau_g = imu_parameters_.gyroscope_bias_correlation_time;
-  // Discrete-time standard deviation equivalent to an "integrating" sampler
-  // with integration time dt.
-  double sigma_g_d = 1 / sqrt(dt) * imu_parameters_.gyroscope_noise_density;
-  double sigma_b_g = imu_parameters_.gyroscope_random_walk;
-  // Compute exact covariance of the process after dt [Maybeck 4-114].
-  double sigma_b_g_d = sqrt(-sigma_b_g * sigma_b_g * tau_g / 2.0 *
-                            (exp(-2.0 * dt / tau_g) - 1.0));
-  // Compute state-transition.
-  double phi_g_d = exp(-1.0 / tau_g * dt);
-  // Simulate gyroscope noise processes and add them to the true angular rate.
-  for (int i = 0; i < 3; ++i) {
-    gyroscope_bias_[i] =
-        phi_g_d * gyroscope_bias_[i] +
-        sigma_b_g_d * standard_normal_distribution_(random_generator_);
-    (*angular_velocity)[i] =
-        (*angular_velocity)[i] + gyroscope_bias_[i] +
-        sigma_g_d * standard_normal_distribution_(random_generator_) +
-        gyroscope_turn_on_bias_[i];
-  }
-
-  // Accelerometer
-  double tau_a = imu_parameters_.accelerometer_bias_correlation_time;
-  // Discrete-time standard deviation equivalent to an "integrating" sampler
-  // with integration time dt.
-  double sigma_a_d = 1 / sqrt(dt) * imu_parameters_.accelerometer_noise_density;
-  double sigma_b_a = imu_parameters_.accelerometer_random_walk;
-  // Compute exact covariance of the process after dt [Maybeck 4-114].
-  double sigma_b_a_d = sqrt(-sigma_b_a * sigma_b_a * tau_a / 2.0 *
-                            (exp(-2.0 * dt / tau_a) - 1.0));
-  // Compute state-transition.
-  double phi_a_d = exp(-1.0 / tau_a * dt);
-  // Simulate accelerometer noise processes and add them to the true linear
-  // acceleration.
-  for (int i = 0; i < 3; ++i) {
-    accelerometer_bias_[i] =
-        phi_a_d * accelerometer_bias_[i] +
-        sigma_b_a_d * standard_normal_distribution_(random_generator_);
-    (*linear_acceleration)[i] =
-        (*linear_acceleration)[i] + accelerometer_bias_[i] +
-        sigma_a_d * standard_normal_distribution_(random_generator_) +
-        accelerometer_turn_on_bias_[i];
-  }
+  imu_noise_model_.AddNoise(linear_acceleration, angular_velocity, dt);
 }
 
 void GazeboImuPlugin::OnUpdate(const common::UpdateInfo& _info) {
+  ROTORS_PROFILE_SCOPE(profiler_entry_);
   if (kPrintOnUpdates) {
     gzdbg << __FUNCTION__ << "() called." << std::endl;
   }
@@ -26,7 +26,8 @@ namespace gazebo {
 GazeboMagnetometerPlugin::GazeboMagnetometerPlugin()
     : ModelPlugin(),
       random_generator_(random_device_()),
-      pubs_and_subs_created_(false) {
+      pubs_and_subs_created_(false),
+      profiler_entry_(nullptr) {
   // Nothing
 }
 
@@ -42,6 +43,8 @@ void GazeboMagnetometerPlugin::Load(physics::ModelPtr _model,
 
   // Store the pointer to the model and the world
   model_ = _model;
+  profiler_entry_ = PluginProfiler::Instance().GetEntry(
+      "GazeboMagnetometerPlugin", model_->GetName());
   world_ = model_->GetWorld();
 
   // Use the robot namespace to create the node handle
@@ -144,6 +147,7 @@ void GazeboMagnetometerPlugin::Load(physics::ModelPtr _model,
 }
 
 void GazeboMagnetometerPlugin::OnUpdate(const common::UpdateInfo& _info) {
+  ROTORS_PROFILE_SCOPE(profiler_entry_);
   if (kPrintOnUpdates) {
     gzdbg << __FUNCTION__ << "() called." << std::endl;
   }
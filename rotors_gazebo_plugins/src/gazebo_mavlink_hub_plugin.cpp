@@ -0,0 +1,151 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// MODULE
+#include "rotors_gazebo_plugins/gazebo_mavlink_hub_plugin.h"
+
+// SYSTEM
+#include <arpa/inet.h>
+
+namespace gazebo {
+
+GazeboMavlinkHubPlugin::~GazeboMavlinkHubPlugin() {
+  event::Events::DisconnectWorldUpdateBegin(update_connection_);
+
+  // Print a summary of every link before shutting the hub down.
+  for (const auto& link : MavlinkHub::Instance().GetLinks()) {
+    MavlinkLinkCounters counters = link->GetCounters();
+    gzmsg << "[gazebo_mavlink_hub_plugin] " << link->GetName()
+          << " (index " << link->GetVehicleIndex()
+          << ", port " << link->GetRemotePort() << "): "
+          << "rx " << counters.rx_messages << " msgs, "
+          << "tx " << counters.tx_messages << " msgs, "
+          << "tx errors " << counters.tx_errors << ", "
+          << "parse errors " << counters.parse_errors << ", "
+          << "sequence gaps " << counters.sequence_gaps << ", "
+          << "reordered " << counters.sequence_reordered << ", "
+          << "rtt mean "
+          << (counters.rtt_samples ? counters.rtt_sum_ms / counters.rtt_samples : 0.0)
+          << " ms, max " << counters.rtt_max_ms << " ms.\n";
+  }
+  MavlinkHub::Instance().Stop();
+}
+
+void GazeboMavlinkHubPlugin::Load(physics::WorldPtr _world, sdf::ElementPtr _sdf) {
+  if (kPrintOnPluginLoad) {
+    gzdbg << __FUNCTION__ << "() called." << std::endl;
+  }
+
+  world_ = _world;
+
+  //==============================================//
+  //========== READ IN PARAMS FROM SDF ===========//
+  //==============================================//
+
+  int base_port = kDefaultMavlinkHubBasePort;
+  getSdfParam<int>(_sdf, "mavlink_udp_base_port", base_port, base_port);
+  getSdfParam<std::string>(_sdf, "statsPubTopic", stats_pub_topic_,
+                           stats_pub_topic_);
+  getSdfParam<double>(_sdf, "statsInterval", stats_interval_, stats_interval_);
+
+  in_addr_t mavlink_addr = htonl(INADDR_ANY);
+  if (_sdf->HasElement("mavlink_addr")) {
+    std::string mavlink_addr_str = _sdf->GetElement("mavlink_addr")->Get<std::string>();
+    if (mavlink_addr_str != "INADDR_ANY") {
+      mavlink_addr = inet_addr(mavlink_addr_str.c_str());
+      if (mavlink_addr == INADDR_NONE) {
+        gzerr << "[gazebo_mavlink_hub_plugin] invalid mavlink_addr \""
+              << mavlink_addr_str << "\", not starting the hub.\n";
+        return;
+      }
+    }
+  }
+
+  if (!MavlinkHub::Instance().Start(base_port, mavlink_addr)) {
+    gzerr << "[gazebo_mavlink_hub_plugin] Could not start the MAVLink hub.\n";
+    return;
+  }
+  gzmsg << "[gazebo_mavlink_hub_plugin] MAVLink hub started, base port "
+        << base_port << ".\n";
+
+  node_handle_ = transport::NodePtr(new transport::Node());
+  node_handle_->Init();
+  stats_pub_ = node_handle_->Advertise<gz_mav_msgs::MavlinkHubStats>(
+      "~/" + stats_pub_topic_, 1);
+
+  last_stats_time_ = common::Time::GetWallTime();
+
+  // Listen to the update event. This event is broadcast every
+  // simulation iteration.
+  update_connection_ = event::Events::ConnectWorldUpdateBegin(
+      boost::bind(&GazeboMavlinkHubPlugin::OnUpdate, this, _1));
+}
+
+void GazeboMavlinkHubPlugin::OnUpdate(const common::UpdateInfo& /*_info*/) {
+  if (kPrintOnUpdates) {
+    gzdbg << __FUNCTION__ << "() called." << std::endl;
+  }
+
+  common::Time now = common::Time::GetWallTime();
+  if ((now - last_stats_time_).Double() >= stats_interval_) {
+    PublishStats(now);
+  }
+}
+
+void GazeboMavlinkHubPlugin::PublishStats(const common::Time& now) {
+  const double dt = (now - last_stats_time_).Double();
+  last_stats_time_ = now;
+
+  common::Time sim_time = world_->GetSimTime();
+  stats_msg_.mutable_header()->mutable_stamp()->set_sec(sim_time.sec);
+  stats_msg_.mutable_header()->mutable_stamp()->set_nsec(sim_time.nsec);
+  stats_msg_.clear_links();
+
+  for (const auto& link : MavlinkHub::Instance().GetLinks()) {
+    MavlinkLinkCounters counters = link->GetCounters();
+    const MavlinkLinkCounters& last = last_counters_[link->GetVehicleIndex()];
+
+    gz_mav_msgs::MavlinkLinkStats* link_stats = stats_msg_.add_links();
+    link_stats->set_vehicle_index(link->GetVehicleIndex());
+    link_stats->set_name(link->GetName());
+    link_stats->set_remote_port(link->GetRemotePort());
+    link_stats->set_rx_rate((counters.rx_messages - last.rx_messages) / dt);
+    link_stats->set_tx_rate((counters.tx_messages - last.tx_messages) / dt);
+    link_stats->set_rx_messages(counters.rx_messages);
+    link_stats->set_tx_messages(counters.tx_messages);
+    link_stats->set_tx_errors(counters.tx_errors);
+    link_stats->set_parse_errors(counters.parse_errors);
+    link_stats->set_sequence_gaps(counters.sequence_gaps);
+    link_stats->set_sequence_reordered(counters.sequence_reordered);
+    link_stats->set_rtt_mean_ms(
+        counters.rtt_samples ? counters.rtt_sum_ms / counters.rtt_samples : 0.0);
+    link_stats->set_rtt_max_ms(counters.rtt_max_ms);
+
+    last_counters_[link->GetVehicleIndex()] = counters;
+  }
+
+  stats_pub_->Publish(stats_msg_);
+
+  MavlinkHub::Instance().SendTimesyncRequests();
+}
+
+GZ_REGISTER_WORLD_PLUGIN(GazeboMavlinkHubPlugin);
+
+}
@@ -27,26 +27,24 @@
 
 namespace gazebo {
 
-// Set global reference point
+// Default global reference point, used if neither the plugin SDF
+// (home_latitude, home_longitude, home_altitude) nor the world's
+// <spherical_coordinates> provide one.
 // Zurich Irchel Park: 47.397742, 8.545594, 488m
 // Seattle downtown (15 deg declination): 47.592182, -122.316031, 86m
 // Moscow downtown: 55.753395, 37.625427, 155m
 
 // Zurich Irchel Park
-static const double kLatZurich_rad = 47.397742 * M_PI / 180;  // rad
-static const double kLonZurich_rad = 8.545594 * M_PI / 180;  // rad
+static const double kLatZurich_deg = 47.397742;
+static const double kLonZurich_deg = 8.545594;
 static const double kAltZurich_m = 488.0; // meters
-// Seattle downtown (15 deg declination): 47.592182, -122.316031
-// static const double lat_zurich = 47.592182 * M_PI / 180;  // rad
-// static const double lon_zurich = -122.316031 * M_PI / 180;  // rad
-// static const double alt_zurich = 86.0; // meters
-static const float kEarthRadius_m = 6353000;  // m
 
 
 GZ_REGISTER_MODEL_PLUGIN(GazeboMavlinkInterface);
 
 GazeboMavlinkInterface::~GazeboMavlinkInterface() {
   event::Events::DisconnectWorldUpdateBegin(updateConnection_);
+  MavlinkHub::Instance().Unregister(mavlink_hub_link_);
 }
 
 void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf) {
@@ -57,6 +55,8 @@ void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf
 
   // Store the pointer to the model.
   model_ = _model;
+  profiler_entry_ = PluginProfiler::Instance().GetEntry(
+      "GazeboMavlinkInterface", model_->GetName());
 
   world_ = model_->GetWorld();
 
@@ -435,8 +435,42 @@ void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf
 
   rotor_count_ = 5;
   last_time_ = world_->GetSimTime();
-  last_gps_time_ = world_->GetSimTime();
-  gps_update_interval_ = 0.2;  // in seconds for 5Hz
+
+  // Home position: the world's spherical coordinates (shared with the GPS
+  // sensor) unless it was left at its default, overridden by the plugin SDF.
+  double lat_home_deg = kLatZurich_deg;
+  double lon_home_deg = kLonZurich_deg;
+  double alt_home_m = kAltZurich_m;
+  common::SphericalCoordinatesPtr spherical_coordinates =
+      world_->GetSphericalCoordinates();
+#if GAZEBO_MAJOR_VERSION > 6
+  if (spherical_coordinates &&
+      (spherical_coordinates->LatitudeReference().Radian() != 0.0 ||
+       spherical_coordinates->LongitudeReference().Radian() != 0.0)) {
+    lat_home_deg = spherical_coordinates->LatitudeReference().Degree();
+    lon_home_deg = spherical_coordinates->LongitudeReference().Degree();
+    alt_home_m = spherical_coordinates->GetElevationReference();
+  }
+#else
+  if (spherical_coordinates &&
+      (spherical_coordinates->GetLatitudeReference().Radian() != 0.0 ||
+       spherical_coordinates->GetLongitudeReference().Radian() != 0.0)) {
+    lat_home_deg = spherical_coordinates->GetLatitudeReference().Degree();
+    lon_home_deg = spherical_coordinates->GetLongitudeReference().Degree();
+    alt_home_m = spherical_coordinates->GetElevationReference();
+  }
+#endif
+  getSdfParam<double>(_sdf, "home_latitude", lat_home_deg, lat_home_deg);
+  getSdfParam<double>(_sdf, "home_longitude", lon_home_deg, lon_home_deg);
+  getSdfParam<double>(_sdf, "home_altitude", alt_home_m, alt_home_m);
+  gzdbg << "home position = (" << lat_home_deg << ", " << lon_home_deg << ", "
+        << alt_home_m << ")." << std::endl;
+
+  geodetic_converter_.SetOrigin(lat_home_deg * M_PI / 180.0,
+                                lon_home_deg * M_PI / 180.0, alt_home_m);
+  lat_rad_ = geodetic_converter_.GetOriginLatitude();
+  lon_rad_ = geodetic_converter_.GetOriginLongitude();
+  alt_m_ = geodetic_converter_.GetOriginAltitude();
 
   gravity_W_ = world_->GetPhysicsEngine()->GetGravity();
 
@@ -451,6 +485,61 @@ void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf
   mag_d_.y = 0;
   mag_d_.z = -0.42741;
 
+  getSdfParam<double>(_sdf, "mag_declination_update_distance",
+                      mag_declination_update_distance_,
+                      mag_declination_update_distance_);
+
+  unsigned int seed;
+  if (_sdf->HasElement("seed")) {
+    seed = _sdf->GetElement("seed")->Get<unsigned int>();
+  } else {
+    seed = std::chrono::system_clock::now().time_since_epoch().count();
+  }
+  random_generator_.seed(seed);
+
+  imu_scheduler_.Load(_sdf, "imu", kDefaultImuStreamRate, seed + 1);
+  mag_scheduler_.Load(_sdf, "mag", kDefaultMagStreamRate, seed + 2);
+  baro_scheduler_.Load(_sdf, "baro", kDefaultBaroStreamRate, seed + 3);
+  airspeed_scheduler_.Load(_sdf, "airspeed", kDefaultAirspeedStreamRate, seed + 4);
+  hil_state_scheduler_.Load(_sdf, "hil_state", kDefaultHilStateStreamRate, seed + 5);
+  gps_scheduler_.Load(_sdf, "gps", kDefaultGpsStreamRate, seed + 6);
+
+  std::string mavlink_log_file;
+  getSdfParam<std::string>(_sdf, "mavlink_log_file", mavlink_log_file, "");
+  if (!mavlink_log_file.empty()) {
+    if (mavlink_log_writer_.Open(mavlink_log_file)) {
+      gzmsg << "Recording MAVLink traffic to \"" << mavlink_log_file << "\"." << std::endl;
+    } else {
+      gzerr << "Could not open MAVLink log file \"" << mavlink_log_file << "\".\n";
+    }
+  }
+
+  // In replay mode the recorded actuator commands replace the autopilot, so
+  // no socket is needed.
+  std::string mavlink_replay_file;
+  getSdfParam<std::string>(_sdf, "mavlink_replay_file", mavlink_replay_file, "");
+  if (!mavlink_replay_file.empty()) {
+    std::vector<MavlinkLogRecord> records;
+    if (!MavlinkLogReader::ReadAll(mavlink_replay_file, &records)) {
+      gzerr << "Could not read MAVLink replay file \"" << mavlink_replay_file << "\".\n";
+      return;
+    }
+    for (const MavlinkLogRecord& record : records) {
+      if (record.direction == MavlinkLogDirection::kInbound &&
+          record.msgid == MAVLINK_MSG_ID_HIL_ACTUATOR_CONTROLS) {
+        replay_records_.push_back(record);
+      }
+    }
+    std::stable_sort(replay_records_.begin(), replay_records_.end(),
+                     [](const MavlinkLogRecord& a, const MavlinkLogRecord& b) {
+                       return a.sim_time_usec < b.sim_time_usec;
+                     });
+    replay_mode_ = true;
+    gzmsg << "Replaying " << replay_records_.size() << " actuator messages from \""
+          << mavlink_replay_file << "\"." << std::endl;
+    return;
+  }
+
   //Create socket
   // udp socket data
   mavlink_addr_ = htonl(INADDR_ANY);
@@ -468,6 +557,17 @@ void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf
     mavlink_udp_port_ = _sdf->GetElement("mavlink_udp_port")->Get<int>();
   }
 
+  // If a GazeboMavlinkHubPlugin is running, the hub assigns the port and
+  // services the socket.
+  getSdfParam<int>(_sdf, "mavlink_vehicle_index", mavlink_vehicle_index_,
+                   mavlink_vehicle_index_);
+  mavlink_hub_link_ = MavlinkHub::Instance().Register(namespace_, mavlink_vehicle_index_);
+  if (mavlink_hub_link_) {
+    mavlink_udp_port_ = mavlink_hub_link_->GetRemotePort();
+    gzdbg << "Using MAVLink hub, autopilot port = " << mavlink_udp_port_ << "." << std::endl;
+    return;
+  }
+
   // try to setup udp socket for communcation with simulator
   if ((fd_ = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
     printf("create socket failed\n");
@@ -498,11 +598,16 @@ void GazeboMavlinkInterface::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf
 
 
 void GazeboMavlinkInterface::OnUpdate(const common::UpdateInfo& /*_info*/) {
+  ROTORS_PROFILE_SCOPE(profiler_entry_);
 
   common::Time current_time = world_->GetSimTime();
   double dt = (current_time - last_time_).Double();
 
-  pollForMAVLinkMessages(dt, 1000);
+  if (replay_mode_) {
+    replayMAVLinkMessages(current_time);
+  } else {
+    pollForMAVLinkMessages(dt, 1000);
+  }
 
   handle_control(dt);
 
@@ -539,27 +644,17 @@ void GazeboMavlinkInterface::OnUpdate(const common::UpdateInfo& /*_info*/) {
 
   // TODO: Remove GPS message from IMU plugin. Added gazebo GPS plugin. This is temp here.
   // reproject local position to gps coordinates
-  double x_rad = pos_W_I.y / kEarthRadius_m; // north
-  double y_rad = pos_W_I.x / kEarthRadius_m; // east
-  double c = sqrt(x_rad * x_rad + y_rad * y_rad);
-  double sin_c = sin(c);
-  double cos_c = cos(c);
-  if (c != 0.0) {
-    lat_rad_ = asin(cos_c * sin(kLatZurich_rad) + (x_rad * sin_c * cos(kLatZurich_rad)) / c);
-    lon_rad_ = (kLonZurich_rad + atan2(y_rad * sin_c, c * cos(kLatZurich_rad) * cos_c - x_rad * sin(kLatZurich_rad) * sin_c));
-  } else {
-   lat_rad_ = kLatZurich_rad;
-    lon_rad_ = kLonZurich_rad;
-  }
+  geodetic_converter_.EnuToGeodetic(
+      Eigen::Vector3d(pos_W_I.x, pos_W_I.y, pos_W_I.z), &lat_rad_, &lon_rad_, &alt_m_);
 
-  if (current_time.Double() - last_gps_time_.Double() > gps_update_interval_) {  // 5Hz
+  if (gps_scheduler_.IsDue(current_time.Double())) {
     // Raw UDP mavlink
     mavlink_hil_gps_t hil_gps_msg;
     hil_gps_msg.time_usec = current_time.nsec/1000;
     hil_gps_msg.fix_type = 3;
     hil_gps_msg.lat = lat_rad_ * 180 / M_PI * 1e7;
     hil_gps_msg.lon = lon_rad_ * 180 / M_PI * 1e7;
-    hil_gps_msg.alt = (pos_W_I.z + kAltZurich_m) * 1000;
+    hil_gps_msg.alt = alt_m_ * 1000;
     hil_gps_msg.eph = 100;
     hil_gps_msg.epv = 100;
     hil_gps_msg.vel = velocity_current_W_xy.GetLength() * 100;
@@ -599,13 +694,32 @@ void GazeboMavlinkInterface::OnUpdate(const common::UpdateInfo& /*_info*/) {
     gps_msg.set_z(hil_gps_msg.alt / 1000.f);
     gps_pub_->Publish(gps_msg);
 
-    last_gps_time_ = current_time;
   }
 }
 
 void GazeboMavlinkInterface::send_mavlink_message(const uint8_t msgid, const void *msg, uint8_t component_ID) {
 
   component_ID = 0;
+
+  if (mavlink_log_writer_.IsOpen()) {
+    common::Time now = world_->GetSimTime();
+    mavlink_log_writer_.Write(now.sec * 1000000ULL + now.nsec / 1000,
+                              MavlinkLogDirection::kOutbound, msgid, msg,
+                              mavlink_message_lengths[msgid]);
+  }
+
+  if (replay_mode_) {
+    // No autopilot attached.
+    return;
+  }
+
+  if (mavlink_hub_link_) {
+    if (!mavlink_hub_link_->Send(msgid, msg, component_ID)) {
+      printf("Failed sending mavlink message\n");
+    }
+    return;
+  }
+
   uint8_t payload_len = mavlink_message_lengths[msgid];
   unsigned packet_len = payload_len + MAVLINK_NUM_NON_PAYLOAD_BYTES;
 
@@ -697,25 +811,36 @@ void GazeboMavlinkInterface::ImuCallback(ImuPtr& imu_message) {
   math::Quaternion q_gb = q_gr*q_br.GetInverse();
   math::Quaternion q_nb = q_ng*q_gb;
 
+  const double now = world_->GetSimTime().Double();
+  uint32_t fields_updated = 0;
+  if (imu_scheduler_.IsDue(now)) {
+    fields_updated |= kHilSensorAccel | kHilSensorGyro;
+  }
+  if (mag_scheduler_.IsDue(now)) {
+    fields_updated |= kHilSensorMag;
+  }
+  if (baro_scheduler_.IsDue(now)) {
+    fields_updated |= kHilSensorAbsPressure | kHilSensorPressureAlt;
+  }
+  if (airspeed_scheduler_.IsDue(now)) {
+    fields_updated |= kHilSensorDiffPressure;
+  }
+
   math::Vector3 pos_g = model_->GetWorldPose().pos;
   math::Vector3 pos_n = q_ng.RotateVector(pos_g);
 
   //gzerr << "got imu: " << C_W_I << "\n";
   //gzerr << "got pose: " << T_W_I.rot << "\n";
-  float declination = get_mag_declination(lat_rad_, lon_rad_);
-
-  math::Quaternion q_dn(0.0, 0.0, declination);
-  math::Vector3 mag_n = q_dn.RotateVectorReverse(mag_d_);
+  const math::Vector3& mag_n = GetMagFieldNed(pos_g);
 
   math::Vector3 vel_b = q_br.RotateVector(model_->GetRelativeLinearVel());
   math::Vector3 vel_n = q_ng.RotateVector(model_->GetWorldLinearVel());
   math::Vector3 omega_nb_b = q_br.RotateVector(model_->GetRelativeAngularVel());
 
-  standard_normal_distribution_ = std::normal_distribution<float>(0, 0.01f);
   math::Vector3 mag_noise_b(
-    standard_normal_distribution_(random_generator_),
-    standard_normal_distribution_(random_generator_),
-    standard_normal_distribution_(random_generator_));
+    mag_noise_distribution_(random_generator_),
+    mag_noise_distribution_(random_generator_),
+    mag_noise_distribution_(random_generator_));
 
   math::Vector3 accel_b = q_br.RotateVector(math::Vector3(
     imu_message->linear_acceleration().x(),
@@ -742,20 +867,12 @@ void GazeboMavlinkInterface::ImuCallback(ImuPtr& imu_message) {
   float rho = 1.2754f; // density of air, TODO why is this not 1.225 as given by std. atmos.
   sensor_msg.diff_pressure = 0.5f*rho*vel_b.x*vel_b.x / 100;
 
-  float p1, p2;
-
   // need to add noise to pressure alt
-  do {
-      p1 = rand() * (1.0 / RAND_MAX);
-      p2 = rand() * (1.0 / RAND_MAX);
-  } while (p1 <= FLT_EPSILON);
-
-  float n = sqrtf(-2.0 * logf(p1)) * cosf(2.0f * M_PI * p2);
-  float alt_n = -pos_n.z + n * sqrtf(0.006f);
+  float alt_n = -pos_n.z + baro_alt_noise_distribution_(random_generator_);
 
   sensor_msg.pressure_alt = (std::isfinite(alt_n)) ? alt_n : -pos_n.z;
   sensor_msg.temperature = 0.0;
-  sensor_msg.fields_updated = 4095;
+  sensor_msg.fields_updated = fields_updated;
 
   //gyro needed for optical flow message
   optflow_xgyro_ = gyro_b.x;
@@ -785,7 +902,13 @@ void GazeboMavlinkInterface::ImuCallback(ImuPtr& imu_message) {
   }
   imu_msg_count++;*/
 
-  send_mavlink_message(MAVLINK_MSG_ID_HIL_SENSOR, &sensor_msg, 200);
+  if (fields_updated != 0) {
+    send_mavlink_message(MAVLINK_MSG_ID_HIL_SENSOR, &sensor_msg, 200);
+  }
+
+  if (!hil_state_scheduler_.IsDue(now)) {
+    return;
+  }
 
   // ground truth
   math::Vector3 accel_true_b = q_br.RotateVector(model_->GetRelativeLinearAccel());
@@ -804,7 +927,7 @@ void GazeboMavlinkInterface::ImuCallback(ImuPtr& imu_message) {
 
   hil_state_quat.lat = lat_rad_ * 180 / M_PI * 1e7;
   hil_state_quat.lon = lon_rad_ * 180 / M_PI * 1e7;
-  hil_state_quat.alt = (-pos_n.z + kAltZurich_m) * 1000;
+  hil_state_quat.alt = alt_m_ * 1000;
 
   hil_state_quat.vx = vel_n.x * 100;
   hil_state_quat.vy = vel_n.y * 100;
@@ -848,6 +971,18 @@ void GazeboMavlinkInterface::ImuCallback(ImuPtr& imu_message) {
   send_mavlink_message(MAVLINK_MSG_ID_HIL_STATE_QUATERNION, &hil_state_quat, 200);
 }
 
+const math::Vector3& GazeboMavlinkInterface::GetMagFieldNed(const math::Vector3& pos_W) {
+  if (!mag_declination_valid_ ||
+      (pos_W - last_declination_pos_W_).GetLength() > mag_declination_update_distance_) {
+    float declination = get_mag_declination(lat_rad_, lon_rad_);
+    math::Quaternion q_dn(0.0, 0.0, declination);
+    mag_n_ = q_dn.RotateVectorReverse(mag_d_);
+    last_declination_pos_W_ = pos_W;
+    mag_declination_valid_ = true;
+  }
+  return mag_n_;
+}
+
 void GazeboMavlinkInterface::LidarCallback(LidarPtr& lidar_message) {
 
   gzdbg << __FUNCTION__ << "() called." << std::endl;
@@ -917,6 +1052,16 @@ void GazeboMavlinkInterface::pollForMAVLinkMessages(double _dt, uint32_t _timeou
   tv.tv_sec = _timeoutMs / 1000;
   tv.tv_usec = (_timeoutMs % 1000) * 1000UL;
 
+  if (mavlink_hub_link_) {
+    // The hub thread already received and parsed the datagrams.
+    received_messages_.clear();
+    mavlink_hub_link_->Receive(&received_messages_);
+    for (mavlink_message_t& msg : received_messages_) {
+      handle_message(&msg);
+    }
+    return;
+  }
+
   // poll
   ::poll(&fds_[0], (sizeof(fds_[0])/sizeof(fds_[0])), 0);
 
@@ -937,9 +1082,28 @@ void GazeboMavlinkInterface::pollForMAVLinkMessages(double _dt, uint32_t _timeou
   }
 }
 
+void GazeboMavlinkInterface::replayMAVLinkMessages(const common::Time& current_time)
+{
+  const uint64_t current_time_usec = current_time.sec * 1000000ULL + current_time.nsec / 1000;
+  mavlink_message_t msg;
+  while (replay_index_ < replay_records_.size() &&
+         replay_records_[replay_index_].sim_time_usec <= current_time_usec) {
+    MavlinkLogReader::ToMessage(replay_records_[replay_index_], &msg);
+    handle_message(&msg);
+    ++replay_index_;
+  }
+}
+
 void GazeboMavlinkInterface::handle_message(mavlink_message_t *msg)
 {
 
+  if (mavlink_log_writer_.IsOpen()) {
+    common::Time now = world_->GetSimTime();
+    mavlink_log_writer_.Write(now.sec * 1000000ULL + now.nsec / 1000,
+                              MavlinkLogDirection::kInbound, msg->msgid,
+                              _MAV_PAYLOAD(msg), msg->len);
+  }
+
   //gzdbg << __FUNCTION__ << "() called, msg->msgid = " << msg->msgid << "." << std::endl;
 
   switch(msg->msgid) {
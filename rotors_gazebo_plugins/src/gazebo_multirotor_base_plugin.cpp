@@ -40,6 +40,8 @@ void GazeboMultirotorBasePlugin::Load(physics::ModelPtr _model,
   }
 
   model_ = _model;
+  profiler_entry_ = PluginProfiler::Instance().GetEntry(
+      "GazeboMultirotorBasePlugin", model_->GetName());
   world_ = model_->GetWorld();
   namespace_.clear();
 
@@ -87,6 +89,7 @@ void GazeboMultirotorBasePlugin::Load(physics::ModelPtr _model,
 
 // This gets called by the world update start event.
 void GazeboMultirotorBasePlugin::OnUpdate(const common::UpdateInfo& _info) {
+  ROTORS_PROFILE_SCOPE(profiler_entry_);
   if (kPrintOnUpdates) {
     gzdbg << __FUNCTION__ << "() called." << std::endl;
   }
@@ -20,16 +20,290 @@
 
 #include "rotors_gazebo_plugins/gazebo_octomap_plugin.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <Eigen/Geometry>
 #include <octomap_msgs/conversions.h>
+#include <sensor_msgs/point_cloud2_iterator.h>
 #include <gazebo/common/Time.hh>
 #include <gazebo/common/CommonTypes.hh>
 #include <gazebo/math/Vector3.hh>
 
 namespace gazebo {
 
+namespace {
+
+// Models that moved or turned less than this [m, rad] since the last build
+// are not updated.
+const double kModelMovedTolerance = 1e-3;
+
+// Above this fraction of the bounding box an update is slower than a build.
+const double kMaxIncrementalUpdateFraction = 0.5;
+
+bool SameBoundingBox(const rotors_comm::Octomap::Request& a,
+                     const rotors_comm::Octomap::Request& b) {
+  return a.bounding_box_origin.x == b.bounding_box_origin.x &&
+         a.bounding_box_origin.y == b.bounding_box_origin.y &&
+         a.bounding_box_origin.z == b.bounding_box_origin.z &&
+         a.bounding_box_lengths.x == b.bounding_box_lengths.x &&
+         a.bounding_box_lengths.y == b.bounding_box_lengths.y &&
+         a.bounding_box_lengths.z == b.bounding_box_lengths.z &&
+         a.leaf_size == b.leaf_size;
+}
+
+// Cells at the top and bottom of the central column of the bounding box, from
+// which the free space is flood filled.
+std::vector<Eigen::Vector3i> FloodFillSeeds(
+    const rotors_comm::Octomap::Request& msg, const VoxelGrid& grid) {
+  std::vector<Eigen::Vector3i> seeds;
+  const int z_ends[2] = {grid.size_z() - 1, 0};
+  for (int z : z_ends) {
+    const Eigen::Vector3d point(
+        msg.bounding_box_origin.x + msg.leaf_size / 2,
+        msg.bounding_box_origin.y + msg.leaf_size / 2,
+        grid.CellCenter(0, 0, z).z());
+    Eigen::Vector3i first;
+    Eigen::Vector3i last;
+    if (grid.CellRange(point, point, &first, &last)) {
+      seeds.push_back(first);
+    }
+  }
+  return seeds;
+}
+
+// Empty octree with the sensor model of the generated octomaps.
+octomap::OcTree* NewOctomap(double leaf_size) {
+  octomap::OcTree* octomap = new octomap::OcTree(leaf_size);
+  octomap->clear();
+  octomap->setProbHit(0.7);
+  octomap->setProbMiss(0.4);
+  octomap->setClampingThresMin(0.12);
+  octomap->setClampingThresMax(0.97);
+  octomap->setOccupancyThres(0.7);
+  return octomap;
+}
+
+// 64 bit FNV-1a hash, the same on every run and machine.
+const uint64_t kHashOffsetBasis = 14695981039346656037ULL;
+const uint64_t kHashPrime = 1099511628211ULL;
+
+void HashBytes(const void* data, size_t size, uint64_t* hash) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    *hash = (*hash ^ bytes[i]) * kHashPrime;
+  }
+}
+
+template <typename T>
+void HashValue(const T& value, uint64_t* hash) {
+  HashBytes(&value, sizeof(value), hash);
+}
+
+void HashString(const std::string& value, uint64_t* hash) {
+  HashValue(value.size(), hash);
+  HashBytes(value.data(), value.size(), hash);
+}
+
+// Rounds to the tolerance of a moved model, so that models that jitter in
+// place keep their hash.
+int64_t QuantizePose(double value) {
+  return llround(value / kModelMovedTolerance);
+}
+
+// Appends the set cells first <= (x, y, z) <= last of the grid.
+void AppendSetCells(const VoxelGrid& grid, const Eigen::Vector3i& first,
+                    const Eigen::Vector3i& last,
+                    std::vector<Eigen::Vector3i>* cells) {
+  for (int z = first.z(); z <= last.z(); ++z) {
+    for (int y = first.y(); y <= last.y(); ++y) {
+      for (int x = first.x(); x <= last.x(); ++x) {
+        if (grid.IsSet(x, y, z)) {
+          cells->push_back(Eigen::Vector3i(x, y, z));
+        }
+      }
+    }
+  }
+}
+
+// State of an octree node, encoded as in the binary octomap format.
+enum NodeState { kUnknown = 0, kFree = 1, kOccupied = 2, kInner = 3 };
+
+// Appends the node with the given depth and smallest key to data in the
+// binary octomap format and returns its state. Nodes whose cells all have
+// the same state are not appended, the parent stores them as one leaf.
+// cell_state(x, y, z) gives the state of a cell of the grid, whose first cell
+// has the key grid_key.
+template <typename CellState>
+NodeState AppendBinaryNode(const CellState& cell_state,
+                           const Eigen::Vector3i& grid_key,
+                           const Eigen::Vector3i& grid_size, int depth,
+                           int tree_depth, const Eigen::Vector3i& node_key,
+                           std::string* data) {
+  const int size = 1 << (tree_depth - depth);
+  for (int i = 0; i < 3; ++i) {
+    if (node_key[i] + size <= grid_key[i] ||
+        node_key[i] >= grid_key[i] + grid_size[i]) {
+      return kUnknown;
+    }
+  }
+  if (size == 1) {
+    const Eigen::Vector3i cell = node_key - grid_key;
+    return cell_state(cell.x(), cell.y(), cell.z());
+  }
+
+  // Two bits per child, followed by the children that have children.
+  const size_t header = data->size();
+  data->append(2, 0);
+  NodeState child_states[8];
+  for (int i = 0; i < 8; ++i) {
+    const Eigen::Vector3i child_key =
+        node_key + Eigen::Vector3i((i & 1) ? size / 2 : 0,
+                                   (i & 2) ? size / 2 : 0,
+                                   (i & 4) ? size / 2 : 0);
+    child_states[i] = AppendBinaryNode(cell_state, grid_key, grid_size,
+                                       depth + 1, tree_depth, child_key, data);
+  }
+  // The root always needs its children.
+  if (depth > 0 && child_states[0] != kInner &&
+      std::count(child_states, child_states + 8, child_states[0]) == 8) {
+    data->resize(header);
+    return child_states[0];
+  }
+  for (int i = 0; i < 8; ++i) {
+    (*data)[header + i / 4] |= child_states[i] << (2 * (i % 4));
+  }
+  return kInner;
+}
+
+bool HasExtension(const std::string& filename, const std::string& extension) {
+  return filename.size() >= extension.size() &&
+         filename.compare(filename.size() - extension.size(),
+                          extension.size(), extension) == 0;
+}
+
+// Writes the points as a binary .pcd or .ply file, by the extension of the
+// filename. Little endian on any host, like the distance field.
+bool WritePointCloud(const std::string& filename,
+                     const std::vector<Eigen::Vector3f>& points) {
+  const bool pcd = HasExtension(filename, ".pcd");
+  if (!pcd && !HasExtension(filename, ".ply")) {
+    return false;
+  }
+  std::ofstream file(filename.c_str(), std::ios::binary);
+  if (pcd) {
+    file << "# .PCD v0.7 - Point Cloud Data file format\n"
+         << "VERSION 0.7\n"
+         << "FIELDS x y z\n"
+         << "SIZE 4 4 4\n"
+         << "TYPE F F F\n"
+         << "COUNT 1 1 1\n"
+         << "WIDTH " << points.size() << "\n"
+         << "HEIGHT 1\n"
+         << "VIEWPOINT 0 0 0 1 0 0 0\n"
+         << "POINTS " << points.size() << "\n"
+         << "DATA binary\n";
+  } else {
+    file << "ply\n"
+         << "format binary_little_endian 1.0\n"
+         << "element vertex " << points.size() << "\n"
+         << "property float x\n"
+         << "property float y\n"
+         << "property float z\n"
+         << "end_header\n";
+  }
+  static_assert(sizeof(Eigen::Vector3f) == 3 * sizeof(float),
+                "Eigen::Vector3f is padded.");
+  WriteLittleEndian32(points.data(), 3 * points.size(), &file);
+  return file.good();
+}
+
+// Packs the index of a cell into a key, 21 bits per axis.
+uint64_t CellKey(const Eigen::Vector3i& cell) {
+  const uint64_t kOffset = 1 << 20;
+  const uint64_t kMask = (1 << 21) - 1;
+  return ((cell.x() + kOffset) & kMask) |
+         (((cell.y() + kOffset) & kMask) << 21) |
+         (((cell.z() + kOffset) & kMask) << 42);
+}
+
+// Writes a binary .ply mesh of the faces between the cells and the cells
+// that are not in the list, as one quad with four vertices of its own per
+// face, facing outwards.
+bool WriteVoxelMesh(const std::string& filename,
+                    const std::vector<Eigen::Vector3i>& cells,
+                    double cell_size) {
+  if (!HasExtension(filename, ".ply")) {
+    return false;
+  }
+  std::unordered_set<uint64_t> occupied;
+  occupied.reserve(cells.size());
+  for (const Eigen::Vector3i& cell : cells) {
+    occupied.insert(CellKey(cell));
+  }
+
+  // Corners of a face in the two other axes, counterclockwise seen from the
+  // positive side.
+  const int kCorners[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+  std::vector<Eigen::Vector3f> vertices;
+  for (const Eigen::Vector3i& cell : cells) {
+    for (int axis = 0; axis < 3; ++axis) {
+      for (int side = 0; side < 2; ++side) {
+        Eigen::Vector3i neighbour = cell;
+        neighbour[axis] += side ? 1 : -1;
+        if (occupied.count(CellKey(neighbour))) {
+          continue;
+        }
+        for (int i = 0; i < 4; ++i) {
+          const int* corner = kCorners[side ? i : 3 - i];
+          Eigen::Vector3i vertex = cell;
+          vertex[axis] += side;
+          vertex[(axis + 1) % 3] += corner[0];
+          vertex[(axis + 2) % 3] += corner[1];
+          vertices.push_back((vertex.cast<double>() * cell_size).cast<float>());
+        }
+      }
+    }
+  }
+
+  std::ofstream file(filename.c_str(), std::ios::binary);
+  file << "ply\n"
+       << "format binary_little_endian 1.0\n"
+       << "element vertex " << vertices.size() << "\n"
+       << "property float x\n"
+       << "property float y\n"
+       << "property float z\n"
+       << "element face " << vertices.size() / 4 << "\n"
+       << "property list uchar int vertex_indices\n"
+       << "end_header\n";
+  WriteLittleEndian32(vertices.data(), 3 * vertices.size(), &file);
+  for (int32_t index = 0; index < static_cast<int32_t>(vertices.size());
+       index += 4) {
+    const unsigned char num_vertices = 4;
+    const int32_t face[4] = {index, index + 1, index + 2, index + 3};
+    file.write(reinterpret_cast<const char*>(&num_vertices), 1);
+    WriteLittleEndian32(face, 4, &file);
+  }
+  return file.good();
+}
+
+}
+
 OctomapFromGazeboWorld::~OctomapFromGazeboWorld() {
-  delete octomap_;
-  octomap_ = NULL;
+  cancel_requested_ = true;
+  if (async_thread_.joinable()) {
+    async_thread_.join();
+  }
+  octomap_.reset();
 }
 
 void OctomapFromGazeboWorld::Load(physics::WorldPtr _parent,
@@ -46,12 +320,48 @@ void OctomapFromGazeboWorld::Load(physics::WorldPtr _parent,
                            octomap_pub_topic);
   getSdfParam<std::string>(_sdf, "octomapServiceName", service_name,
                            service_name);
+  std::string cancel_service_name = "world/cancel_octomap";
+  std::string progress_pub_topic = "world/octomap_progress";
+  std::string updates_pub_topic = "world/octomap_updates";
+  std::string point_cloud_pub_topic = "world/octomap_point_cloud";
+  getSdfParam<std::string>(_sdf, "cancelServiceName", cancel_service_name,
+                           cancel_service_name);
+  getSdfParam<std::string>(_sdf, "progressPubTopic", progress_pub_topic,
+                           progress_pub_topic);
+  getSdfParam<std::string>(_sdf, "updatesPubTopic", updates_pub_topic,
+                           updates_pub_topic);
+  getSdfParam<std::string>(_sdf, "pointCloudPubTopic", point_cloud_pub_topic,
+                           point_cloud_pub_topic);
+  getSdfParam<int>(_sdf, "numThreads", num_threads_, num_threads_);
+  getSdfParam<std::string>(_sdf, "occupancyBackend", occupancy_backend_,
+                           occupancy_backend_);
+  getSdfParam<bool>(_sdf, "coarseToFine", coarse_to_fine_, coarse_to_fine_);
+  getSdfParam<bool>(_sdf, "incrementalUpdates", incremental_updates_,
+                    incremental_updates_);
+  getSdfParam<int>(_sdf, "cacheSize", cache_size_, cache_size_);
+  getSdfParam<bool>(_sdf, "distanceField", distance_field_enabled_,
+                    distance_field_enabled_);
+  getSdfParam<std::string>(_sdf, "cacheDirectory", cache_directory_,
+                           cache_directory_);
+  if (occupancy_backend_ != "rays" && occupancy_backend_ != "collision") {
+    gzerr << "[gazebo_octomap_plugin] Unknown occupancyBackend \""
+          << occupancy_backend_ << "\", using \"rays\".\n";
+    occupancy_backend_ = "rays";
+  }
 
   gzlog << "Advertising service: " << service_name << std::endl;
   srv_ = node_handle_.advertiseService(
       service_name, &OctomapFromGazeboWorld::ServiceCallback, this);
   octomap_publisher_ =
       node_handle_.advertise<octomap_msgs::Octomap>(octomap_pub_topic, 1, true);
+  cancel_srv_ = node_handle_.advertiseService(
+      cancel_service_name, &OctomapFromGazeboWorld::CancelCallback, this);
+  progress_publisher_ = node_handle_.advertise<rotors_comm::OctomapProgress>(
+      progress_pub_topic, 10);
+  updates_publisher_ =
+      node_handle_.advertise<octomap_msgs::Octomap>(updates_pub_topic, 100);
+  point_cloud_publisher_ = node_handle_.advertise<sensor_msgs::PointCloud2>(
+      point_cloud_pub_topic, 1, true);
 }
 
 bool OctomapFromGazeboWorld::ServiceCallback(
@@ -62,27 +372,24 @@ bool OctomapFromGazeboWorld::ServiceCallback(
         << req.bounding_box_lengths.x << ", " << req.bounding_box_lengths.y
         << ", " << req.bounding_box_lengths.z
         << "), and leaf size: " << req.leaf_size << ".\n";
-  CreateOctomap(req);
-  if (req.filename != "") {
-    if (octomap_) {
-      std::string path = req.filename;
-      octomap_->writeBinary(path);
-      gzlog << std::endl << "Octree saved as " << path << std::endl;
-    } else {
-      ROS_ERROR("The octree is NULL. Will not save that.");
+  if (req.async) {
+    if (async_running_.exchange(true)) {
+      ROS_ERROR("An octomap is being built already.");
+      return false;
     }
-  }
-  common::Time now = world_->GetSimTime();
-  res.map.header.frame_id = "world";
-  res.map.header.stamp = ros::Time(now.sec, now.nsec);
-
-  if (!octomap_msgs::binaryMapToMsg(*octomap_, res.map)) {
-    ROS_ERROR("Error serializing OctoMap");
-  }
-
-  if (req.publish_octomap) {
-    gzlog << "Publishing Octomap." << std::endl;
-    octomap_publisher_.publish(res.map);
+    if (async_thread_.joinable()) {
+      async_thread_.join();
+    }
+    cancel_requested_ = false;
+    async_thread_ =
+        std::thread(&OctomapFromGazeboWorld::BuildOctomapAsync, this, req);
+  } else {
+    std::lock_guard<std::mutex> lock(octomap_mutex_);
+    cancel_requested_ = false;
+    if (!CreateOctomap(req)) {
+      return false;
+    }
+    PublishOctomap(req, &res.map);
   }
 
   common::SphericalCoordinatesPtr sphericalCoordinates = world_->GetSphericalCoordinates();
@@ -107,40 +414,206 @@ bool OctomapFromGazeboWorld::ServiceCallback(
 #endif
 }
 
-void OctomapFromGazeboWorld::FloodFill(
-    const math::Vector3& seed_point, const math::Vector3& bounding_box_origin,
-    const math::Vector3& bounding_box_lengths, const double leaf_size) {
-  octomap::OcTreeNode* seed =
-      octomap_->search(seed_point.x, seed_point.y, seed_point.z);
-  // do nothing if point occupied
-  if (seed != NULL && seed->getOccupancy()) return;
-
-  std::stack<octomath::Vector3> to_check;
-  to_check.push(octomath::Vector3(seed_point.x, seed_point.y, seed_point.z));
-
-  while (to_check.size() > 0) {
-    octomath::Vector3 p = to_check.top();
-
-    if ((p.x() > bounding_box_origin.x - bounding_box_lengths.x / 2) &&
-        (p.x() < bounding_box_origin.x + bounding_box_lengths.x / 2) &&
-        (p.y() > bounding_box_origin.y - bounding_box_lengths.y / 2) &&
-        (p.y() < bounding_box_origin.y + bounding_box_lengths.y / 2) &&
-        (p.z() > bounding_box_origin.z - bounding_box_lengths.z / 2) &&
-        (p.z() < bounding_box_origin.z + bounding_box_lengths.z / 2) &&
-        (!octomap_->search(p))) {
-      octomap_->setNodeValue(p, 0);
-      to_check.pop();
-      to_check.push(octomath::Vector3(p.x() + leaf_size, p.y(), p.z()));
-      to_check.push(octomath::Vector3(p.x() - leaf_size, p.y(), p.z()));
-      to_check.push(octomath::Vector3(p.x(), p.y() + leaf_size, p.z()));
-      to_check.push(octomath::Vector3(p.x(), p.y() - leaf_size, p.z()));
-      to_check.push(octomath::Vector3(p.x(), p.y(), p.z() + leaf_size));
-      to_check.push(octomath::Vector3(p.x(), p.y(), p.z() - leaf_size));
+bool OctomapFromGazeboWorld::CancelCallback(std_srvs::Empty::Request& req,
+                                            std_srvs::Empty::Response& res) {
+  gzlog << "Cancelling the octomap build." << std::endl;
+  cancel_requested_ = true;
+  return true;
+}
+
+void OctomapFromGazeboWorld::BuildOctomapAsync(
+    rotors_comm::Octomap::Request req) {
+  {
+    std::lock_guard<std::mutex> lock(octomap_mutex_);
+    publish_updates_ = true;
+    if (CreateOctomap(req)) {
+      // There is no response to return the octomap in.
+      req.publish_octomap = true;
+      octomap_msgs::Octomap map;
+      PublishOctomap(req, &map);
+    }
+    publish_updates_ = false;
+  }
+  async_running_ = false;
+}
+
+void OctomapFromGazeboWorld::PublishOctomap(
+    const rotors_comm::Octomap::Request& req, octomap_msgs::Octomap* map) {
+  if (req.filename != "") {
+    if (octomap_) {
+      std::string path = req.filename;
+      octomap_->writeBinary(path);
+      gzlog << std::endl << "Octree saved as " << path << std::endl;
+      if (distance_field_) {
+        const std::string distance_field_path = path + ".df";
+        if (distance_field_->Write(distance_field_path)) {
+          gzlog << "Distance field saved as " << distance_field_path
+                << std::endl;
+        } else {
+          ROS_ERROR("Could not save the distance field as %s.",
+                    distance_field_path.c_str());
+        }
+      }
+    } else {
+      ROS_ERROR("The octree is NULL. Will not save that.");
+    }
+  }
+  common::Time now = world_->GetSimTime();
+  map->header.frame_id = "world";
+  map->header.stamp = ros::Time(now.sec, now.nsec);
+
+  if (!octomap_msgs::binaryMapToMsg(*octomap_, *map)) {
+    ROS_ERROR("Error serializing OctoMap");
+  }
+
+  if (req.publish_octomap) {
+    gzlog << "Publishing Octomap." << std::endl;
+    octomap_publisher_.publish(*map);
+  }
+
+  if (octomap_ && (req.point_cloud_filename != "" ||
+                   req.mesh_filename != "" || req.publish_point_cloud)) {
+    ExportOccupiedCells(req);
+  }
+}
+
+void OctomapFromGazeboWorld::GetOccupiedCells(
+    double resolution, double* cell_size,
+    std::vector<Eigen::Vector3i>* cells) {
+  cells->clear();
+  const double leaf_size = octomap_->getResolution();
+  // Nodes above the leaves hold the maximum occupancy of their children, so
+  // a node of this depth is occupied if any leaf in it is.
+  unsigned int depth = octomap_->getTreeDepth();
+  *cell_size = leaf_size;
+  while (*cell_size < resolution * (1 - 1e-6) && depth > 1) {
+    *cell_size *= 2;
+    --depth;
+  }
+
+  for (octomap::OcTree::leaf_iterator it = octomap_->begin_leafs(depth),
+                                      end = octomap_->end_leafs();
+       it != end; ++it) {
+    if (!octomap_->isNodeOccupied(*it)) {
+      continue;
+    }
+    const int num_cells =
+        std::max(1, static_cast<int>(std::lround(it.getSize() / *cell_size)));
+    const octomap::point3d center = it.getCoordinate();
+    Eigen::Vector3i first;
+    for (int i = 0; i < 3; ++i) {
+      first[i] = static_cast<int>(
+          std::floor(center(i) / *cell_size - num_cells / 2.0 + 0.5));
+    }
+    for (int z = 0; z < num_cells; ++z) {
+      for (int y = 0; y < num_cells; ++y) {
+        for (int x = 0; x < num_cells; ++x) {
+          cells->push_back(first + Eigen::Vector3i(x, y, z));
+        }
+      }
+    }
+  }
+}
+
+void OctomapFromGazeboWorld::ExportOccupiedCells(
+    const rotors_comm::Octomap::Request& req) {
+  double cell_size;
+  std::vector<Eigen::Vector3i> cells;
+  GetOccupiedCells(req.point_cloud_resolution, &cell_size, &cells);
+  gzlog << cells.size() << " occupied cells of " << cell_size << " m"
+        << std::endl;
+
+  std::vector<Eigen::Vector3f> points;
+  points.reserve(cells.size());
+  for (const Eigen::Vector3i& cell : cells) {
+    points.push_back(
+        ((cell.cast<double>().array() + 0.5) * cell_size).matrix()
+            .cast<float>());
+  }
 
+  if (req.point_cloud_filename != "") {
+    if (WritePointCloud(req.point_cloud_filename, points)) {
+      gzlog << "Point cloud saved as " << req.point_cloud_filename
+            << std::endl;
     } else {
-      to_check.pop();
+      ROS_ERROR("Could not save the point cloud as %s, it needs to end in "
+                ".pcd or .ply.", req.point_cloud_filename.c_str());
     }
   }
+
+  if (req.mesh_filename != "") {
+    if (WriteVoxelMesh(req.mesh_filename, cells, cell_size)) {
+      gzlog << "Voxel mesh saved as " << req.mesh_filename << std::endl;
+    } else {
+      ROS_ERROR("Could not save the voxel mesh as %s, it needs to end in "
+                ".ply.", req.mesh_filename.c_str());
+    }
+  }
+
+  if (req.publish_point_cloud) {
+    sensor_msgs::PointCloud2 cloud;
+    common::Time now = world_->GetSimTime();
+    cloud.header.frame_id = "world";
+    cloud.header.stamp = ros::Time(now.sec, now.nsec);
+    sensor_msgs::PointCloud2Modifier modifier(cloud);
+    modifier.setPointCloud2FieldsByString(1, "xyz");
+    modifier.resize(points.size());
+    sensor_msgs::PointCloud2Iterator<float> iter_x(cloud, "x");
+    sensor_msgs::PointCloud2Iterator<float> iter_y(cloud, "y");
+    sensor_msgs::PointCloud2Iterator<float> iter_z(cloud, "z");
+    for (const Eigen::Vector3f& point : points) {
+      *iter_x = point.x();
+      *iter_y = point.y();
+      *iter_z = point.z();
+      ++iter_x;
+      ++iter_y;
+      ++iter_z;
+    }
+    gzlog << "Publishing point cloud." << std::endl;
+    point_cloud_publisher_.publish(cloud);
+  }
+}
+
+void OctomapFromGazeboWorld::PublishProgress(double progress, bool done,
+                                             bool cancelled) {
+  rotors_comm::OctomapProgress progress_msg;
+  common::Time now = world_->GetSimTime();
+  progress_msg.header.frame_id = "world";
+  progress_msg.header.stamp = ros::Time(now.sec, now.nsec);
+  progress_msg.progress = progress;
+  progress_msg.done = done;
+  progress_msg.cancelled = cancelled;
+  progress_publisher_.publish(progress_msg);
+}
+
+void OctomapFromGazeboWorld::PublishSlab(double progress,
+                                         const Eigen::Vector3i* cells,
+                                         size_t num_cells,
+                                         const VoxelGrid& grid) {
+  PublishProgress(progress, false, false);
+  if (!publish_updates_ || num_cells == 0) {
+    return;
+  }
+
+  // Only the occupied cells of the slab, the free space is known once all
+  // slabs are done.
+  octomap::OcTree update(grid.leaf_size());
+  const float occupied_log_odds = update.getClampingThresMaxLog();
+  for (size_t i = 0; i < num_cells; ++i) {
+    const Eigen::Vector3d center =
+        grid.CellCenter(cells[i].x(), cells[i].y(), cells[i].z());
+    update.setNodeValue(center.x(), center.y(), center.z(),
+                        occupied_log_odds, true);
+  }
+  update.updateInnerOccupancy();
+
+  octomap_msgs::Octomap update_msg;
+  common::Time now = world_->GetSimTime();
+  update_msg.header.frame_id = "world";
+  update_msg.header.stamp = ros::Time(now.sec, now.nsec);
+  if (octomap_msgs::binaryMapToMsg(update, update_msg)) {
+    updates_publisher_.publish(update_msg);
+  }
 }
 
 bool OctomapFromGazeboWorld::CheckIfInterest(const math::Vector3& central_point,
@@ -180,26 +653,12 @@ bool OctomapFromGazeboWorld::CheckIfInterest(const math::Vector3& central_point,
   return false;
 }
 
-void OctomapFromGazeboWorld::CreateOctomap(
-    const rotors_comm::Octomap::Request& msg) {
-  const double epsilon = 0.00001;
-  const int far_away = 100000;
-  math::Vector3 bounding_box_origin(msg.bounding_box_origin.x,
-                                    msg.bounding_box_origin.y,
-                                    msg.bounding_box_origin.z);
-  // epsilion prevents undefiened behaviour if a point is inserted exactly
-  // between two octomap cells
-  math::Vector3 bounding_box_lengths(msg.bounding_box_lengths.x + epsilon,
-                                     msg.bounding_box_lengths.y + epsilon,
-                                     msg.bounding_box_lengths.z + epsilon);
-  double leaf_size = msg.leaf_size;
-  octomap_ = new octomap::OcTree(leaf_size);
-  octomap_->clear();
-  octomap_->setProbHit(0.7);
-  octomap_->setProbMiss(0.4);
-  octomap_->setClampingThresMin(0.12);
-  octomap_->setClampingThresMax(0.97);
-  octomap_->setOccupancyThres(0.7);
+void OctomapFromGazeboWorld::RasterizeWithRays(const Eigen::Vector3i& first,
+                                               const Eigen::Vector3i& last,
+                                               VoxelGrid* occupied) {
+  const double leaf_size = occupied->leaf_size();
+  const int num_slabs = last.x() - first.x() + 1;
+  std::cout << "Rasterizing world and checking collisions" << std::endl;
 
   gazebo::physics::PhysicsEnginePtr engine = world_->GetPhysicsEngine();
   engine->InitForThread();
@@ -207,78 +666,704 @@ void OctomapFromGazeboWorld::CreateOctomap(
       boost::dynamic_pointer_cast<gazebo::physics::RayShape>(
           engine->CreateShape("ray", gazebo::physics::CollisionPtr()));
 
-  std::cout << "Rasterizing world and checking collisions" << std::endl;
+  // Physics must not move or modify the collision geometry while the rays
+  // are cast. The rays lock physics themselves and collide with the one
+  // shared collision space of the engine, so they are all cast from this
+  // thread. Physics is only held for short rounds, so that the simulation
+  // keeps stepping in between.
+  const std::chrono::milliseconds kRoundDuration(100);
+  std::vector<Eigen::Vector3i> cells;
+  int i = first.x();
+  while (i <= last.x() && !cancel_requested_) {
+    {
+      boost::recursive_mutex::scoped_lock lock(
+          *engine->GetPhysicsUpdateMutex());
+      const std::chrono::steady_clock::time_point deadline =
+          std::chrono::steady_clock::now() + kRoundDuration;
+      for (; i <= last.x() && std::chrono::steady_clock::now() < deadline &&
+             !cancel_requested_;
+           ++i) {
+        cells.clear();
+        for (int j = first.y(); j <= last.y(); ++j) {
+          for (int k = first.z(); k <= last.z(); ++k) {
+            const Eigen::Vector3d center = occupied->CellCenter(i, j, k);
+            math::Vector3 point(center.x(), center.y(), center.z());
+            if (CheckIfInterest(point, ray, leaf_size)) {
+              occupied->Set(i, j, k);
+              cells.push_back(Eigen::Vector3i(i, j, k));
+            }
+          }
+        }
+        const double progress =
+            static_cast<double>(i - first.x() + 1) / num_slabs;
+        PublishSlab(progress, cells.data(), cells.size(), *occupied);
+        std::cout << "\rPlacing model edges into octomap... "
+                  << round(100.0 * progress) << "%                 "
+                  << std::flush;
+      }
+    }
+    std::this_thread::yield();
+  }
+}
 
-  for (double x =
-           leaf_size / 2 + bounding_box_origin.x - bounding_box_lengths.x / 2;
-       x < bounding_box_origin.x + bounding_box_lengths.x / 2; x += leaf_size) {
-    int progress =
-        round(100 * (x + bounding_box_lengths.x / 2 - bounding_box_origin.x) /
-              bounding_box_lengths.x);
-    std::cout << "\rPlacing model edges into octomap... " << progress
-              << "%                 ";
-
-    for (double y =
-             leaf_size / 2 + bounding_box_origin.y - bounding_box_lengths.y / 2;
-         y < bounding_box_origin.y + bounding_box_lengths.y / 2;
-         y += leaf_size) {
-      for (double z = leaf_size / 2 + bounding_box_origin.z -
-                      bounding_box_lengths.z / 2;
-           z < bounding_box_origin.z + bounding_box_lengths.z / 2;
-           z += leaf_size) {
-        math::Vector3 point(x, y, z);
-        if (CheckIfInterest(point, ray, leaf_size)) {
-          octomap_->setNodeValue(x, y, z, 1);
+int OctomapFromGazeboWorld::RasterizeCollisionGeometry(
+    int num_threads, const Eigen::Vector3i& first, const Eigen::Vector3i& last,
+    VoxelGrid* occupied) {
+  std::vector<CollisionPrimitive> primitives;
+  {
+    // The geometry is only read under the lock, voxelizing runs without it.
+    boost::recursive_mutex::scoped_lock lock(
+        *world_->GetPhysicsEngine()->GetPhysicsUpdateMutex());
+    for (const physics::ModelPtr& model : world_->GetModels()) {
+      GetCollisionPrimitives(model, &primitives);
+    }
+  }
+
+  const int num_layers = last.z() - first.z() + 1;
+  num_threads = std::max(1, std::min(num_threads, num_layers));
+  std::cout << "Voxelizing " << primitives.size()
+            << " collision shapes with " << num_threads << " threads"
+            << std::endl;
+
+  std::atomic<int> completed_layers(0);
+  return VoxelizePrimitives(
+      primitives, first, last, coarse_to_fine_, num_threads, occupied,
+      [&](const Eigen::Vector3i& chunk_first,
+          const Eigen::Vector3i& chunk_last) {
+        std::vector<Eigen::Vector3i> cells;
+        if (publish_updates_) {
+          AppendSetCells(*occupied, chunk_first, chunk_last, &cells);
         }
+        completed_layers += chunk_last.z() - chunk_first.z() + 1;
+        PublishSlab(static_cast<double>(completed_layers) / num_layers,
+                    cells.data(), cells.size(), *occupied);
+        return !cancel_requested_;
+      });
+}
+
+void OctomapFromGazeboWorld::GetCollisionPrimitives(
+    const physics::BasePtr& entity,
+    std::vector<CollisionPrimitive>* primitives) {
+  if (entity->HasType(physics::Base::COLLISION)) {
+    physics::CollisionPtr collision =
+        boost::dynamic_pointer_cast<physics::Collision>(entity);
+    CollisionPrimitive primitive;
+    if (GetCollisionPrimitive(collision, &primitive)) {
+      primitives->push_back(primitive);
+    }
+    return;
+  }
+  for (unsigned int i = 0; i < entity->GetChildCount(); ++i) {
+    GetCollisionPrimitives(entity->GetChild(i), primitives);
+  }
+}
+
+bool OctomapFromGazeboWorld::GetCollisionPrimitive(
+    const physics::CollisionPtr& collision, CollisionPrimitive* primitive) {
+  const math::Pose pose = collision->GetWorldPose();
+  primitive->position =
+      Eigen::Vector3d(pose.pos.x, pose.pos.y, pose.pos.z);
+  primitive->rotation = Eigen::Quaterniond(pose.rot.w, pose.rot.x,
+                                           pose.rot.y, pose.rot.z)
+                            .toRotationMatrix();
+
+  physics::ShapePtr shape = collision->GetShape();
+  if (shape->HasType(physics::Base::BOX_SHAPE)) {
+    const math::Vector3 size =
+        boost::dynamic_pointer_cast<physics::BoxShape>(shape)->GetSize();
+    primitive->type = CollisionPrimitive::kBox;
+    primitive->half_extents = Eigen::Vector3d(size.x, size.y, size.z) / 2;
+  } else if (shape->HasType(physics::Base::SPHERE_SHAPE)) {
+    primitive->type = CollisionPrimitive::kSphere;
+    primitive->radius =
+        boost::dynamic_pointer_cast<physics::SphereShape>(shape)->GetRadius();
+  } else if (shape->HasType(physics::Base::CYLINDER_SHAPE)) {
+    physics::CylinderShapePtr cylinder =
+        boost::dynamic_pointer_cast<physics::CylinderShape>(shape);
+    primitive->type = CollisionPrimitive::kCylinder;
+    primitive->radius = cylinder->GetRadius();
+    primitive->half_length = cylinder->GetLength() / 2;
+  } else if (shape->HasType(physics::Base::PLANE_SHAPE)) {
+    const math::Vector3 normal =
+        boost::dynamic_pointer_cast<physics::PlaneShape>(shape)->GetNormal();
+    primitive->type = CollisionPrimitive::kPlane;
+    primitive->normal = (primitive->rotation *
+                         Eigen::Vector3d(normal.x, normal.y, normal.z))
+                            .normalized();
+  } else if (shape->HasType(physics::Base::MESH_SHAPE)) {
+    physics::MeshShapePtr mesh_shape =
+        boost::dynamic_pointer_cast<physics::MeshShape>(shape);
+    // MeshShape loaded the mesh already, either under its URI or under the
+    // resolved file name.
+    common::MeshManager* mesh_manager = common::MeshManager::Instance();
+    const std::string uri = mesh_shape->GetMeshURI();
+    const common::Mesh* mesh = mesh_manager->GetMesh(uri);
+    if (mesh == NULL) {
+      mesh = mesh_manager->Load(common::find_file(uri));
+    }
+    if (mesh == NULL) {
+      gzerr << "[gazebo_octomap_plugin] Could not load mesh " << uri
+            << ".\n";
+      return false;
+    }
+
+    std::string submesh_name;
+    bool center_submesh = false;
+    sdf::ElementPtr sdf = mesh_shape->GetSDF();
+    if (sdf->HasElement("submesh")) {
+      sdf::ElementPtr submesh_sdf = sdf->GetElement("submesh");
+      submesh_name = submesh_sdf->Get<std::string>("name");
+      center_submesh = submesh_sdf->Get<bool>("center");
+    }
+
+    const math::Vector3 scale = mesh_shape->GetSize();
+    primitive->type = CollisionPrimitive::kMesh;
+    for (unsigned int i = 0; i < mesh->GetSubMeshCount(); ++i) {
+      const common::SubMesh* submesh = mesh->GetSubMesh(i);
+      if ((!submesh_name.empty() && submesh->GetName() != submesh_name) ||
+          submesh->GetPrimitiveType() != common::SubMesh::TRIANGLES) {
+        continue;
+      }
+      Eigen::Vector3d offset = Eigen::Vector3d::Zero();
+      if (center_submesh) {
+        const math::Vector3 min = submesh->GetMin();
+        const math::Vector3 max = submesh->GetMax();
+        offset = -Eigen::Vector3d(min.x + max.x, min.y + max.y,
+                                  min.z + max.z) / 2;
       }
+      for (unsigned int j = 0; j < submesh->GetIndexCount(); ++j) {
+        const math::Vector3 vertex =
+            submesh->GetVertex(submesh->GetIndex(j));
+        const Eigen::Vector3d vertex_scaled =
+            (Eigen::Vector3d(vertex.x, vertex.y, vertex.z) + offset)
+                .cwiseProduct(Eigen::Vector3d(scale.x, scale.y, scale.z));
+        primitive->triangle_vertices.push_back(
+            primitive->position + primitive->rotation * vertex_scaled);
+      }
+    }
+  } else {
+    if (!shape->HasType(physics::Base::RAY_SHAPE)) {
+      gzwarn << "[gazebo_octomap_plugin] Shape of collision "
+             << collision->GetScopedName()
+             << " is not supported by the collision backend, ignoring it.\n";
     }
+    return false;
   }
-  octomap_->prune();
-  octomap_->updateInnerOccupancy();
+  return true;
+}
 
-  // flood fill from top and bottom
-  std::cout << "\rFlood filling freespace...                                  ";
-  FloodFill(math::Vector3(bounding_box_origin.x + leaf_size / 2,
-                          bounding_box_origin.y + leaf_size / 2,
-                          bounding_box_origin.z + bounding_box_lengths.z / 2 -
-                              leaf_size / 2),
-            bounding_box_origin, bounding_box_lengths, leaf_size);
-  FloodFill(math::Vector3(bounding_box_origin.x + leaf_size / 2,
-                          bounding_box_origin.y + leaf_size / 2,
-                          bounding_box_origin.z - bounding_box_lengths.z / 2 +
-                              leaf_size / 2),
-            bounding_box_origin, bounding_box_lengths, leaf_size);
+void OctomapFromGazeboWorld::HashCollisions(
+    const physics::BasePtr& entity,
+    std::vector<std::pair<std::string, uint64_t> >* hashes) {
+  if (entity->HasType(physics::Base::COLLISION)) {
+    physics::CollisionPtr collision =
+        boost::dynamic_pointer_cast<physics::Collision>(entity);
+    // The SDF holds the shape with its size or mesh URI, the world pose
+    // where the collision is now.
+    uint64_t hash = kHashOffsetBasis;
+    HashString(collision->GetSDF()->ToString(""), &hash);
+    const math::Pose pose = collision->GetWorldPose();
+    const double pose_values[7] = {pose.pos.x, pose.pos.y, pose.pos.z,
+                                   pose.rot.w, pose.rot.x, pose.rot.y,
+                                   pose.rot.z};
+    for (double value : pose_values) {
+      HashValue(QuantizePose(value), &hash);
+    }
+    hashes->push_back(std::make_pair(collision->GetScopedName(), hash));
+    return;
+  }
+  for (unsigned int i = 0; i < entity->GetChildCount(); ++i) {
+    HashCollisions(entity->GetChild(i), hashes);
+  }
+}
 
-  octomap_->prune();
+uint64_t OctomapFromGazeboWorld::HashWorldGeometry(
+    const rotors_comm::Octomap::Request& msg) {
+  std::vector<std::pair<std::string, uint64_t> > collision_hashes;
+  {
+    boost::recursive_mutex::scoped_lock lock(
+        *world_->GetPhysicsEngine()->GetPhysicsUpdateMutex());
+    // Vehicles and other dynamic models move all the time, the spinning
+    // rotors alone would change the hash of every request.
+    for (const physics::ModelPtr& model : world_->GetModels()) {
+      if (model->IsStatic()) {
+        HashCollisions(model, &collision_hashes);
+      }
+    }
+  }
+  // Sorted, the order of the models does not change the world.
+  std::sort(collision_hashes.begin(), collision_hashes.end());
+
+  uint64_t hash = kHashOffsetBasis;
+  HashString(occupancy_backend_, &hash);
+  const double request_values[7] = {
+      msg.bounding_box_origin.x,  msg.bounding_box_origin.y,
+      msg.bounding_box_origin.z,  msg.bounding_box_lengths.x,
+      msg.bounding_box_lengths.y, msg.bounding_box_lengths.z,
+      msg.leaf_size};
+  for (double value : request_values) {
+    HashValue(value, &hash);
+  }
+  for (const std::pair<std::string, uint64_t>& collision_hash :
+       collision_hashes) {
+    HashString(collision_hash.first, &hash);
+    HashValue(collision_hash.second, &hash);
+  }
+  return hash;
+}
+
+std::string OctomapFromGazeboWorld::CachePath(uint64_t hash) const {
+  std::ostringstream path;
+  path << cache_directory_ << "/octomap_" << std::hex << std::setw(16)
+       << std::setfill('0') << hash << ".bt";
+  return path.str();
+}
+
+bool OctomapFromGazeboWorld::GetCachedOctomap(
+    uint64_t hash, const std::map<std::string, ModelState>& model_states) {
+  // Models that moved since the current octomap was built.
+  std::vector<math::Box> changed_boxes;
+  bool current_models_moved = false;
+  if (octomap_ && hash == octomap_hash_) {
+    GetChangedModelBoxes(model_states_, model_states, &changed_boxes);
+    current_models_moved = !changed_boxes.empty();
+    if (cache_size_ > 0 && !current_models_moved) {
+      gzlog << "The current octomap matches the world." << std::endl;
+      return true;
+    }
+  }
+
+  for (std::list<CachedOctomap>::iterator it = octomap_cache_.begin();
+       it != octomap_cache_.end(); ++it) {
+    if (it->hash != hash) {
+      continue;
+    }
+    changed_boxes.clear();
+    GetChangedModelBoxes(it->model_states, model_states, &changed_boxes);
+    if (changed_boxes.empty()) {
+      octomap_ = it->octomap;
+      distance_field_ = it->distance_field;
+      model_states_ = it->model_states;
+      octomap_hash_ = hash;
+      can_update_ = false;
+      // Most recently used first.
+      octomap_cache_.splice(octomap_cache_.begin(), octomap_cache_, it);
+      gzlog << "Octomap found in the memory cache." << std::endl;
+      return true;
+    }
+  }
+
+  // The file would show the models where they were when it was written,
+  // updating the current octomap brings them to where they are now.
+  if (cache_directory_.empty() || current_models_moved) {
+    return false;
+  }
+  const std::string path = CachePath(hash);
+  if (!std::ifstream(path.c_str()).good()) {
+    return false;
+  }
+  octomap::OcTree* octomap = NewOctomap(1.0);
+  if (!octomap->readBinary(path)) {
+    gzwarn << "[gazebo_octomap_plugin] Could not read the cached octomap "
+           << path << ", building it again.\n";
+    delete octomap;
+    return false;
+  }
+  octomap_.reset(octomap);
+  octomap_hash_ = hash;
+  can_update_ = false;
+  model_states_ = model_states;
+  distance_field_.reset();
+  if (distance_field_enabled_) {
+    gzwarn << "[gazebo_octomap_plugin] Octomaps read from cacheDirectory "
+           << "have no distance field.\n";
+  }
+  CacheOctomap(hash, false);
+  gzlog << "Octomap read from " << path << std::endl;
+  return true;
+}
+
+void OctomapFromGazeboWorld::CacheOctomap(uint64_t hash, bool write_file) {
+  if (cache_size_ > 0) {
+    CachedOctomap cached_octomap;
+    cached_octomap.hash = hash;
+    cached_octomap.octomap = octomap_;
+    cached_octomap.distance_field = distance_field_;
+    cached_octomap.model_states = model_states_;
+    octomap_cache_.push_front(cached_octomap);
+    while (static_cast<int>(octomap_cache_.size()) > cache_size_) {
+      octomap_cache_.pop_back();
+    }
+  }
+  if (write_file && !cache_directory_.empty()) {
+    const std::string path = CachePath(hash);
+    if (octomap_->writeBinary(path)) {
+      gzlog << "Octomap cached as " << path << std::endl;
+    } else {
+      gzwarn << "[gazebo_octomap_plugin] Could not write the octomap cache "
+             << path << ".\n";
+    }
+  }
+}
+
+void OctomapFromGazeboWorld::GetModelStates(
+    std::map<std::string, ModelState>* model_states) {
+  boost::recursive_mutex::scoped_lock lock(
+      *world_->GetPhysicsEngine()->GetPhysicsUpdateMutex());
+  model_states->clear();
+  for (const physics::ModelPtr& model : world_->GetModels()) {
+    ModelState& model_state = (*model_states)[model->GetScopedName()];
+    model_state.pose = model->GetWorldPose();
+    model_state.bounding_box = model->GetBoundingBox();
+  }
+}
+
+void OctomapFromGazeboWorld::GetChangedModelBoxes(
+    const std::map<std::string, ModelState>& before_states,
+    const std::map<std::string, ModelState>& model_states,
+    std::vector<math::Box>* changed_boxes) {
+  for (const std::pair<const std::string, ModelState>& entry : model_states) {
+    std::map<std::string, ModelState>::const_iterator last_entry =
+        before_states.find(entry.first);
+    if (last_entry == before_states.end()) {
+      changed_boxes->push_back(entry.second.bounding_box);
+      continue;
+    }
+    const ModelState& now = entry.second;
+    const ModelState& before = last_entry->second;
+    const double rotation_cosine =
+        std::abs(now.pose.rot.w * before.pose.rot.w +
+                 now.pose.rot.x * before.pose.rot.x +
+                 now.pose.rot.y * before.pose.rot.y +
+                 now.pose.rot.z * before.pose.rot.z);
+    if (now.pose.pos.Distance(before.pose.pos) > kModelMovedTolerance ||
+        2.0 * acos(std::min(1.0, rotation_cosine)) > kModelMovedTolerance ||
+        now.bounding_box.min.Distance(before.bounding_box.min) >
+            kModelMovedTolerance ||
+        now.bounding_box.max.Distance(before.bounding_box.max) >
+            kModelMovedTolerance) {
+      // One box over both, the old and new cells are flooded together.
+      math::Box box = before.bounding_box;
+      box.min.SetToMin(now.bounding_box.min);
+      box.max.SetToMax(now.bounding_box.max);
+      changed_boxes->push_back(box);
+    }
+  }
+  for (const std::pair<const std::string, ModelState>& entry : before_states) {
+    if (model_states.find(entry.first) == model_states.end()) {
+      changed_boxes->push_back(entry.second.bounding_box);
+    }
+  }
+}
+
+bool OctomapFromGazeboWorld::UpdateOctomap(int num_threads) {
+  std::map<std::string, ModelState> model_states;
+  GetModelStates(&model_states);
+
+  // Bounding boxes of the models that changed, before and after.
+  std::vector<math::Box> changed_boxes;
+  GetChangedModelBoxes(model_states_, model_states, &changed_boxes);
+
+  // Cells of the boxes and one more around them.
+  const Eigen::Vector3d margin =
+      Eigen::Vector3d::Constant(occupied_.leaf_size());
+  std::vector<std::pair<Eigen::Vector3i, Eigen::Vector3i> > regions;
+  double num_region_cells = 0.0;
+  for (const math::Box& box : changed_boxes) {
+    Eigen::Vector3i first;
+    Eigen::Vector3i last;
+    if (occupied_.CellRange(
+            Eigen::Vector3d(box.min.x, box.min.y, box.min.z) - margin,
+            Eigen::Vector3d(box.max.x, box.max.y, box.max.z) + margin, &first,
+            &last)) {
+      regions.push_back(std::make_pair(first, last));
+      num_region_cells +=
+          (last - first + Eigen::Vector3i::Ones()).cast<double>().prod();
+    }
+  }
+  const double num_cells = static_cast<double>(occupied_.size_x()) *
+                           occupied_.size_y() * occupied_.size_z();
+  if (num_region_cells > kMaxIncrementalUpdateFraction * num_cells) {
+    return false;
+  }
+
+  // The tree is updated in place, so the cache must not keep it under the
+  // hash of the old geometry.
+  octomap_cache_.remove_if([this](const CachedOctomap& cached_octomap) {
+    return cached_octomap.octomap == octomap_;
+  });
+
+  std::cout << "Updating " << regions.size() << " regions of "
+            << changed_boxes.size() << " changed model bounding boxes"
+            << std::endl;
+  for (const std::pair<Eigen::Vector3i, Eigen::Vector3i>& region : regions) {
+    if (cancel_requested_) {
+      return true;
+    }
+    occupied_.ClearBox(region.first, region.second);
+    if (occupancy_backend_ == "collision") {
+      RasterizeCollisionGeometry(num_threads, region.first, region.second,
+                                 &occupied_);
+    } else {
+      RasterizeWithRays(region.first, region.second, &occupied_);
+    }
+    UpdateRegion(region.first, region.second, num_threads);
+  }
   octomap_->updateInnerOccupancy();
+  octomap_->prune();
+  model_states_ = model_states;
+  return true;
+}
 
-  // set unknown to filled
-  for (double x =
-           leaf_size / 2 + bounding_box_origin.x - bounding_box_lengths.x / 2;
-       x < bounding_box_origin.x + bounding_box_lengths.x / 2; x += leaf_size) {
-    int progress =
-        round(100 * (x + bounding_box_lengths.x / 2 - bounding_box_origin.x) /
-              bounding_box_lengths.x);
-    std::cout << "\rFilling closed spaces... " << progress << "%              ";
-
-    for (double y =
-             leaf_size / 2 + bounding_box_origin.y - bounding_box_lengths.y / 2;
-         y < bounding_box_origin.y + bounding_box_lengths.y / 2;
-         y += leaf_size) {
-      for (double z = leaf_size / 2 + bounding_box_origin.z -
-                      bounding_box_lengths.z / 2;
-           z < bounding_box_origin.z + bounding_box_lengths.z / 2;
-           z += leaf_size) {
-        octomap::OcTreeNode* seed = octomap_->search(x, y, z);
-        if (!seed) octomap_->setNodeValue(x, y, z, 1);
+void OctomapFromGazeboWorld::UpdateRegion(const Eigen::Vector3i& first,
+                                          const Eigen::Vector3i& last,
+                                          int num_threads) {
+  const Eigen::Vector3i grid_size(occupied_.size_x(), occupied_.size_y(),
+                                  occupied_.size_z());
+  auto in_region = [&](const Eigen::Vector3i& cell) {
+    return (cell.array() >= first.array()).all() &&
+           (cell.array() <= last.array()).all();
+  };
+  const Eigen::Vector3i neighbors[6] = {
+      Eigen::Vector3i(1, 0, 0),  Eigen::Vector3i(-1, 0, 0),
+      Eigen::Vector3i(0, 1, 0),  Eigen::Vector3i(0, -1, 0),
+      Eigen::Vector3i(0, 0, 1),  Eigen::Vector3i(0, 0, -1)};
+
+  // Flood the region from the seeds of a full build and from the free cells
+  // next to it. The flood may leave the region through space that was
+  // enclosed before the change.
+  free_.ClearBox(first, last);
+  std::vector<Eigen::Vector3i> seeds;
+  for (const Eigen::Vector3i& seed : FloodFillSeeds(last_request_, free_)) {
+    if (in_region(seed)) {
+      seeds.push_back(seed);
+    }
+  }
+  for (int z = first.z(); z <= last.z(); ++z) {
+    for (int y = first.y(); y <= last.y(); ++y) {
+      for (int x = first.x(); x <= last.x(); ++x) {
+        const Eigen::Vector3i cell(x, y, z);
+        for (const Eigen::Vector3i& neighbor : neighbors) {
+          const Eigen::Vector3i outside = cell + neighbor;
+          if ((outside.array() >= 0).all() &&
+              (outside.array() < grid_size.array()).all() &&
+              !in_region(outside) &&
+              free_.IsSet(outside.x(), outside.y(), outside.z())) {
+            seeds.push_back(cell);
+            break;
+          }
+        }
       }
     }
   }
+  VoxelGrid opened(free_.first_cell_center(), free_.leaf_size(),
+                   grid_size.x(), grid_size.y(), grid_size.z());
+  FloodFill(occupied_, seeds, num_threads, &free_, &opened);
 
-  octomap_->prune();
+  // Same values as a full build.
+  const float free_log_odds = octomap_->getClampingThresMinLog();
+  const float occupied_log_odds = octomap_->getClampingThresMaxLog();
+  for (int z = first.z(); z <= last.z(); ++z) {
+    for (int y = first.y(); y <= last.y(); ++y) {
+      for (int x = first.x(); x <= last.x(); ++x) {
+        const Eigen::Vector3d center = free_.CellCenter(x, y, z);
+        octomap_->setNodeValue(
+            center.x(), center.y(), center.z(),
+            free_.IsSet(x, y, z) ? free_log_odds : occupied_log_odds, true);
+      }
+    }
+  }
+  opened.ForEachSet([&](int x, int y, int z) {
+    if (!in_region(Eigen::Vector3i(x, y, z))) {
+      const Eigen::Vector3d center = free_.CellCenter(x, y, z);
+      octomap_->setNodeValue(center.x(), center.y(), center.z(),
+                             free_log_odds, true);
+    }
+  });
+}
+
+void OctomapFromGazeboWorld::BuildOctomapFromGrid(const VoxelGrid& free_space) {
+  const Eigen::Vector3d& first_cell_center = free_space.first_cell_center();
+  const Eigen::Vector3d last_cell_center = free_space.CellCenter(
+      free_space.size_x() - 1, free_space.size_y() - 1,
+      free_space.size_z() - 1);
+  octomap::OcTreeKey first_key;
+  octomap::OcTreeKey last_key;
+  if (!octomap_->coordToKeyChecked(first_cell_center.x(),
+                                   first_cell_center.y(),
+                                   first_cell_center.z(), first_key) ||
+      !octomap_->coordToKeyChecked(last_cell_center.x(), last_cell_center.y(),
+                                   last_cell_center.z(), last_key)) {
+    ROS_ERROR("The bounding box does not fit into an octree of this leaf "
+              "size.");
+    return;
+  }
+
+  // The whole tree is written in one pass as a binary octomap, with every
+  // block of free or occupied cells that fills an octree node becoming a
+  // single leaf, and read at once.
+  std::string data;
+  const Eigen::Vector3i grid_size(free_space.size_x(), free_space.size_y(),
+                                  free_space.size_z());
+  if ((grid_size.array() > 0).all()) {
+    AppendBinaryNode(
+        [&](int x, int y, int z) {
+          return free_space.IsSet(x, y, z) ? kFree : kOccupied;
+        },
+        Eigen::Vector3i(first_key[0], first_key[1], first_key[2]),
+        grid_size, 0, octomap_->getTreeDepth(), Eigen::Vector3i::Zero(),
+        &data);
+  }
+  octomap_->clear();
+  if (!data.empty()) {
+    std::istringstream stream(data);
+    octomap_->readBinaryData(stream);
+  }
+}
+
+bool OctomapFromGazeboWorld::CreateOctomap(
+    const rotors_comm::Octomap::Request& msg) {
+  int num_threads = msg.num_threads > 0 ? msg.num_threads : num_threads_;
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  const std::chrono::steady_clock::time_point start_time =
+      std::chrono::steady_clock::now();
+  const uint64_t geometry_hash = HashWorldGeometry(msg);
+  std::map<std::string, ModelState> model_states;
+  GetModelStates(&model_states);
+  if (GetCachedOctomap(geometry_hash, model_states)) {
+    ++cache_hits_;
+    std::cout << "Octomap " << std::hex << geometry_hash << std::dec
+              << " served from cache in "
+              << std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start_time).count()
+              << " s (" << cache_hits_ << " hits, " << cache_misses_
+              << " misses)" << std::endl;
+    PublishProgress(1.0, true, false);
+    return true;
+  }
+  ++cache_misses_;
+
+  bool updated = false;
+  if (incremental_updates_ && can_update_ &&
+      SameBoundingBox(msg, last_request_)) {
+    updated = UpdateOctomap(num_threads);
+    if (!updated) {
+      std::cout << "Too much of the world changed, building a new octomap"
+                << std::endl;
+    }
+  }
+  if (!updated) {
+    BuildOctomap(msg, num_threads);
+  }
+  if (cancel_requested_) {
+    // The octree and the grids are incomplete.
+    octomap_->clear();
+    octomap_hash_ = 0;
+    can_update_ = false;
+    std::cout << "\rOctomap generation cancelled" << std::endl;
+    PublishProgress(0.0, false, true);
+    return false;
+  }
+  octomap_hash_ = geometry_hash;
+  can_update_ = true;
+
+  distance_field_.reset();
+  if (distance_field_enabled_) {
+    const std::chrono::steady_clock::time_point distance_field_start_time =
+        std::chrono::steady_clock::now();
+    std::shared_ptr<DistanceField> distance_field(new DistanceField);
+    ComputeDistanceField(free_, num_threads, distance_field.get());
+    distance_field_ = distance_field;
+    std::cout << "\rDistance field computed in "
+              << std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() -
+                     distance_field_start_time).count()
+              << " s" << std::endl;
+  }
+  CacheOctomap(geometry_hash, true);
+
+  std::cout << "\rOctomap " << std::hex << geometry_hash << std::dec
+            << (updated ? " update" : " generation") << " completed in "
+            << std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - start_time).count()
+            << " s (" << cache_hits_ << " cache hits, " << cache_misses_
+            << " misses)" << std::endl;
+  PublishProgress(1.0, true, false);
+  return true;
+}
+
+void OctomapFromGazeboWorld::BuildOctomap(
+    const rotors_comm::Octomap::Request& msg, int num_threads) {
+  const double epsilon = 0.00001;
+  math::Vector3 bounding_box_origin(msg.bounding_box_origin.x,
+                                    msg.bounding_box_origin.y,
+                                    msg.bounding_box_origin.z);
+  // epsilion prevents undefiened behaviour if a point is inserted exactly
+  // between two octomap cells
+  math::Vector3 bounding_box_lengths(msg.bounding_box_lengths.x + epsilon,
+                                     msg.bounding_box_lengths.y + epsilon,
+                                     msg.bounding_box_lengths.z + epsilon);
+  double leaf_size = msg.leaf_size;
+
+  const std::chrono::steady_clock::time_point start_time =
+      std::chrono::steady_clock::now();
+  octomap_.reset(NewOctomap(leaf_size));
+
+  // Cell centers of the bounding box, the same cells as the loops below.
+  const Eigen::Vector3d first_cell_center(
+      leaf_size / 2 + bounding_box_origin.x - bounding_box_lengths.x / 2,
+      leaf_size / 2 + bounding_box_origin.y - bounding_box_lengths.y / 2,
+      leaf_size / 2 + bounding_box_origin.z - bounding_box_lengths.z / 2);
+  const int num_cells_x = std::max(
+      0, static_cast<int>(ceil((bounding_box_lengths.x - leaf_size / 2) /
+                               leaf_size)));
+  const int num_cells_y = std::max(
+      0, static_cast<int>(ceil((bounding_box_lengths.y - leaf_size / 2) /
+                               leaf_size)));
+  const int num_cells_z = std::max(
+      0, static_cast<int>(ceil((bounding_box_lengths.z - leaf_size / 2) /
+                               leaf_size)));
+  occupied_.Reset(first_cell_center, leaf_size, num_cells_x, num_cells_y,
+                  num_cells_z);
+  last_request_ = msg;
+  GetModelStates(&model_states_);
+
+  const Eigen::Vector3i first_cell = Eigen::Vector3i::Zero();
+  const Eigen::Vector3i last_cell(num_cells_x - 1, num_cells_y - 1,
+                                  num_cells_z - 1);
+  const bool use_collision_geometry = occupancy_backend_ == "collision";
+  int rasterize_threads = 1;
+  if (use_collision_geometry) {
+    rasterize_threads = RasterizeCollisionGeometry(num_threads, first_cell,
+                                                   last_cell, &occupied_);
+  } else {
+    RasterizeWithRays(first_cell, last_cell, &occupied_);
+  }
+  const double rasterize_duration = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start_time).count();
+  if (cancel_requested_) {
+    return;
+  }
+
+  // Everything that the free space around the top and bottom of the
+  // bounding box does not reach is occupied.
+  std::cout << "\rFlood filling freespace...                                  ";
+  free_.Reset(first_cell_center, leaf_size, num_cells_x, num_cells_y,
+              num_cells_z);
+  FloodFill(occupied_, FloodFillSeeds(msg, free_), num_threads, &free_, NULL);
+
+  BuildOctomapFromGrid(free_);
   octomap_->updateInnerOccupancy();
 
-  std::cout << "\rOctomap generation completed                  " << std::endl;
+  std::cout << "\r" << (use_collision_geometry ? "Voxelizing" : "Ray casting")
+            << " with " << rasterize_threads << " threads took "
+            << rasterize_duration << " s, the whole build "
+            << std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - start_time).count()
+            << " s" << std::endl;
 }
 
 // Register this plugin with the simulator
@@ -54,6 +54,8 @@ void GazeboOdometryPlugin::Load(physics::ModelPtr _model,
 
   // Store the pointer to the model
   model_ = _model;
+  profiler_entry_ = PluginProfiler::Instance().GetEntry(
+      "GazeboOdometryPlugin", model_->GetName());
   world_ = model_->GetWorld();
 
   SdfVector3 noise_normal_position;
@@ -235,6 +237,7 @@ void GazeboOdometryPlugin::Load(physics::ModelPtr _model,
 
 // This gets called by the world update start event.
 void GazeboOdometryPlugin::OnUpdate(const common::UpdateInfo& _info) {
+  ROTORS_PROFILE_SCOPE(profiler_entry_);
   if (kPrintOnUpdates) {
     gzdbg << __FUNCTION__ << "() called." << std::endl;
   }
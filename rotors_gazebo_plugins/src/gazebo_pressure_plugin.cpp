@@ -25,7 +25,8 @@ namespace gazebo {
 GazeboPressurePlugin::GazeboPressurePlugin()
     : ModelPlugin(),
       node_handle_(0),
-      pubs_and_subs_created_(false) {
+      pubs_and_subs_created_(false),
+      profiler_entry_(nullptr) {
 }
 
 GazeboPressurePlugin::~GazeboPressurePlugin() {
@@ -41,6 +42,8 @@ void GazeboPressurePlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf)
 
   // Store the pointer to the model and the world.
   model_ = _model;
+  profiler_entry_ = PluginProfiler::Instance().GetEntry(
+      "GazeboPressurePlugin", model_->GetName());
   world_ = model_->GetWorld();
 
   //==============================================//
@@ -90,6 +93,7 @@ void GazeboPressurePlugin::Load(physics::ModelPtr _model, sdf::ElementPtr _sdf)
 }
 
 void GazeboPressurePlugin::OnUpdate(const common::UpdateInfo& _info) {
+  ROTORS_PROFILE_SCOPE(profiler_entry_);
   if (kPrintOnUpdates) {
     gzdbg << __FUNCTION__ << "() called." << std::endl;
   }
@@ -0,0 +1,161 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// MODULE
+#include "rotors_gazebo_plugins/gazebo_profiler_plugin.h"
+
+// SYSTEM
+#include <algorithm>
+#include <fstream>
+
+namespace gazebo {
+
+static std::vector<PluginProfilerStatistics> GetSortedStatistics() {
+  std::vector<PluginProfilerStatistics> statistics =
+      PluginProfiler::Instance().GetStatistics();
+  std::sort(statistics.begin(), statistics.end(),
+            [](const PluginProfilerStatistics& a,
+               const PluginProfilerStatistics& b) {
+              return a.total_ns > b.total_ns;
+            });
+  return statistics;
+}
+
+GazeboProfilerPlugin::~GazeboProfilerPlugin() {
+  event::Events::DisconnectWorldUpdateBegin(update_connection_);
+
+  if (!kPluginProfilingEnabled) {
+    return;
+  }
+
+  // Print a summary of every profiled plugin, most expensive first.
+  const std::vector<PluginProfilerStatistics> statistics = GetSortedStatistics();
+  WriteSummary(statistics);
+  for (const PluginProfilerStatistics& entry : statistics) {
+    gzmsg << "[gazebo_profiler_plugin] " << entry.plugin_name << " on "
+          << entry.model_name << ": " << entry.calls << " calls, "
+          << "total " << entry.total_ns * 1e-6 << " ms, "
+          << "mean " << entry.mean_ns * 1e-3 << " us, "
+          << "p99 " << entry.p99_ns * 1e-3 << " us, "
+          << "max " << entry.max_ns * 1e-3 << " us.\n";
+  }
+}
+
+void GazeboProfilerPlugin::Load(physics::WorldPtr _world, sdf::ElementPtr _sdf) {
+  if (kPrintOnPluginLoad) {
+    gzdbg << __FUNCTION__ << "() called." << std::endl;
+  }
+
+  world_ = _world;
+
+  //==============================================//
+  //========== READ IN PARAMS FROM SDF ===========//
+  //==============================================//
+
+  getSdfParam<std::string>(_sdf, "statsPubTopic", stats_pub_topic_,
+                           stats_pub_topic_);
+  getSdfParam<double>(_sdf, "statsInterval", stats_interval_, stats_interval_);
+  getSdfParam<std::string>(_sdf, "summaryFile", summary_file_, summary_file_);
+
+  if (!kPluginProfilingEnabled) {
+    gzwarn << "[gazebo_profiler_plugin] rotors_gazebo_plugins was built "
+              "without PLUGIN_PROFILING, no plugin is timed.\n";
+    return;
+  }
+
+  node_handle_ = transport::NodePtr(new transport::Node());
+  node_handle_->Init();
+  stats_pub_ = node_handle_->Advertise<gz_mav_msgs::PluginProfilerStats>(
+      "~/" + stats_pub_topic_, 1);
+
+  last_stats_time_ = common::Time::GetWallTime();
+
+  // Listen to the update event. This event is broadcast every
+  // simulation iteration.
+  update_connection_ = event::Events::ConnectWorldUpdateBegin(
+      boost::bind(&GazeboProfilerPlugin::OnUpdate, this, _1));
+}
+
+void GazeboProfilerPlugin::OnUpdate(const common::UpdateInfo& /*_info*/) {
+  if (kPrintOnUpdates) {
+    gzdbg << __FUNCTION__ << "() called." << std::endl;
+  }
+
+  common::Time now = common::Time::GetWallTime();
+  if ((now - last_stats_time_).Double() >= stats_interval_) {
+    PublishStats(now);
+  }
+}
+
+void GazeboProfilerPlugin::PublishStats(const common::Time& now) {
+  const double dt = (now - last_stats_time_).Double();
+  last_stats_time_ = now;
+
+  common::Time sim_time = world_->GetSimTime();
+  stats_msg_.mutable_header()->mutable_stamp()->set_sec(sim_time.sec);
+  stats_msg_.mutable_header()->mutable_stamp()->set_nsec(sim_time.nsec);
+  stats_msg_.clear_scopes();
+
+  const std::vector<PluginProfilerStatistics> statistics = GetSortedStatistics();
+  for (const PluginProfilerStatistics& entry : statistics) {
+    uint64_t& last_total_ns =
+        last_total_ns_[std::make_pair(entry.plugin_name, entry.model_name)];
+
+    gz_mav_msgs::PluginProfilerScope* scope = stats_msg_.add_scopes();
+    scope->set_plugin(entry.plugin_name);
+    scope->set_model(entry.model_name);
+    scope->set_calls(entry.calls);
+    scope->set_mean_us(entry.mean_ns * 1e-3);
+    scope->set_p99_us(entry.p99_ns * 1e-3);
+    scope->set_max_us(entry.max_ns * 1e-3);
+    scope->set_total_ms(entry.total_ns * 1e-6);
+    scope->set_load((entry.total_ns - last_total_ns) * 1e-9 / dt);
+
+    last_total_ns = entry.total_ns;
+  }
+
+  stats_pub_->Publish(stats_msg_);
+
+  WriteSummary(statistics);
+}
+
+void GazeboProfilerPlugin::WriteSummary(
+    const std::vector<PluginProfilerStatistics>& statistics) const {
+  if (summary_file_.empty()) {
+    return;
+  }
+  std::ofstream file(summary_file_.c_str(), std::ios::trunc);
+  if (!file) {
+    gzerr << "[gazebo_profiler_plugin] Could not write " << summary_file_
+          << ".\n";
+    return;
+  }
+  file << "plugin,model,calls,total_ms,mean_us,p99_us,max_us\n";
+  for (const PluginProfilerStatistics& entry : statistics) {
+    file << entry.plugin_name << "," << entry.model_name << ","
+         << entry.calls << "," << entry.total_ns * 1e-6 << ","
+         << entry.mean_ns * 1e-3 << "," << entry.p99_ns * 1e-3 << ","
+         << entry.max_ns * 1e-3 << "\n";
+  }
+}
+
+GZ_REGISTER_WORLD_PLUGIN(GazeboProfilerPlugin);
+
+}
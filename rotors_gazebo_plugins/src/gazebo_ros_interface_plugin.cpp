@@ -32,7 +32,10 @@
 namespace gazebo {
 
 GazeboRosInterfacePlugin::GazeboRosInterfacePlugin()
-    : WorldPlugin(), gz_node_handle_(0), ros_node_handle_(0) {}
+    : WorldPlugin(),
+      gz_node_handle_(0),
+      ros_node_handle_(0),
+      profiler_entry_(nullptr) {}
 
 GazeboRosInterfacePlugin::~GazeboRosInterfacePlugin() {
   event::Events::DisconnectWorldUpdateBegin(updateConnection_);
@@ -53,6 +56,8 @@ void GazeboRosInterfacePlugin::Load(physics::WorldPtr _world,
   fprintf(stderr, "22222222222222\n" );
   /// \brief    Store the pointer to the model.
   world_ = _world;
+  profiler_entry_ = PluginProfiler::Instance().GetEntry(
+      "GazeboRosInterfacePlugin", world_->GetName());
 
   // namespace_.clear();
 
@@ -106,6 +111,7 @@ void GazeboRosInterfacePlugin::Load(physics::WorldPtr _world,
 }
 
 void GazeboRosInterfacePlugin::OnUpdate(const common::UpdateInfo& _info) {
+  ROTORS_PROFILE_SCOPE(profiler_entry_);
   // Do nothing
   // This plugins actions are all executed through message callbacks.
 }
@@ -163,7 +163,32 @@ void LiftDragPlugin::OnUpdate()
   GZ_ASSERT(this->link, "Link was NULL");
   // get linear velocity at cp in inertial frame
   math::Vector3 vel = this->link->GetWorldLinearVel(this->cp);
-  math::Vector3 velI = vel;
+
+  // pose of body
+  math::Pose pose = this->link->GetWorldPose();
+
+  double controlAngle = 0.0;
+  if (this->controlJoint)
+    controlAngle = this->controlJoint->GetAngle(0).Radian();
+
+  math::Vector3 force;
+  math::Vector3 torque;
+  if (!this->ComputeForces(vel, pose.rot, controlAngle, force, torque))
+    return;
+
+  // apply forces at cg (with torques for position shift)
+  this->link->AddForceAtRelativePosition(force, this->cp);
+  this->link->AddTorque(torque);
+}
+
+/////////////////////////////////////////////////
+bool LiftDragPlugin::ComputeForces(const math::Vector3 &_vel,
+                                   const math::Quaternion &_rot,
+                                   double _controlAngle,
+                                   math::Vector3 &_force,
+                                   math::Vector3 &_torque)
+{
+  math::Vector3 velI = _vel;
   velI.Normalize();
 
   // smoothing
@@ -171,14 +196,11 @@ void LiftDragPlugin::OnUpdate()
   // this->velSmooth = e*vel + (1.0 - e)*velSmooth;
   // vel = this->velSmooth;
 
-  if (vel.GetLength() <= 0.01)
-    return;
-
-  // pose of body
-  math::Pose pose = this->link->GetWorldPose();
+  if (_vel.GetLength() <= 0.01)
+    return false;
 
   // rotate forward and upward vectors into inertial frame
-  math::Vector3 forwardI = pose.rot.RotateVector(this->forward);
+  math::Vector3 forwardI = _rot.RotateVector(this->forward);
 
   math::Vector3 upwardI;
   if (this->radialSymmetry)
@@ -190,7 +212,7 @@ void LiftDragPlugin::OnUpdate()
   }
   else
   {
-    upwardI = pose.rot.RotateVector(this->upward);
+    upwardI = _rot.RotateVector(this->upward);
   }
 
   // spanwiseI: a vector normal to lift-drag-plane described in inertial frame
@@ -220,7 +242,7 @@ void LiftDragPlugin::OnUpdate()
   //
   // so,
   // removing spanwise velocity from vel
-  math::Vector3 velInLDPlane = vel - vel.Dot(spanwiseI)*velI;
+  math::Vector3 velInLDPlane = _vel - _vel.Dot(spanwiseI)*velI;
 
   // get direction of drag
   math::Vector3 dragDirection = -velInLDPlane;
@@ -280,12 +302,8 @@ void LiftDragPlugin::OnUpdate()
     cl = this->cla * this->alpha * cosSweepAngle;
 
   // modify cl per control joint value
-  if (this->controlJoint)
-  {
-    double controlAngle = this->controlJoint->GetAngle(0).Radian();
-    cl = cl + this->controlJointRadToCL * controlAngle;
-    /// \TODO: also change cm and cd
-  }
+  cl = cl + this->controlJointRadToCL * _controlAngle;
+  /// \TODO: also change cm and cd
 
   // compute lift force at cp
   math::Vector3 lift = cl * q * this->area * liftI;
@@ -341,56 +359,17 @@ void LiftDragPlugin::OnUpdate()
   // compute moment (torque) at cp
   math::Vector3 moment = cm * q * this->area * momentDirection;
 
-  // moment arm from cg to cp in inertial plane
-  math::Vector3 momentArm = pose.rot.RotateVector(
-    this->cp - this->link->GetInertial()->GetCoG());
-  // gzerr << this->cp << " : " << this->link->GetInertial()->GetCoG() << "\n";
-
   // force and torque about cg in inertial frame
-  math::Vector3 force = lift + drag;
+  _force = lift + drag;
   // + moment.Cross(momentArm);
 
-  math::Vector3 torque = moment;
+  _torque = moment;
   // - lift.Cross(momentArm) - drag.Cross(momentArm);
 
-  // debug
-  //
-  // if ((this->link->GetName() == "wing_1" ||
-  //      this->link->GetName() == "wing_2") &&
-  //     (vel.GetLength() > 50.0 &&
-  //      vel.GetLength() < 50.0))
-  if (0)
-  {
-    gzdbg << "=============================\n";
-    gzdbg << "sensor: [" << this->GetHandle() << "]\n";
-    gzdbg << "Link: [" << this->link->GetName()
-          << "] pose: [" << pose
-          << "] dynamic pressure: [" << q << "]\n";
-    gzdbg << "spd: [" << vel.GetLength()
-          << "] vel: [" << vel << "]\n";
-    gzdbg << "LD plane spd: [" << velInLDPlane.GetLength()
-          << "] vel : [" << velInLDPlane << "]\n";
-    gzdbg << "forward (inertial): " << forwardI << "\n";
-    gzdbg << "upward (inertial): " << upwardI << "\n";
-    gzdbg << "lift dir (inertial): " << liftI << "\n";
-    gzdbg << "Span direction (normal to LD plane): " << spanwiseI << "\n";
-    gzdbg << "sweep: " << this->sweep << "\n";
-    gzdbg << "alpha: " << this->alpha << "\n";
-    gzdbg << "lift: " << lift << "\n";
-    gzdbg << "drag: " << drag << " cd: "
-          << cd << " cda: " << this->cda << "\n";
-    gzdbg << "moment: " << moment << "\n";
-    gzdbg << "cp momentArm: " << momentArm << "\n";
-    gzdbg << "force: " << force << "\n";
-    gzdbg << "torque: " << torque << "\n";
-  }
-
   // Correct for nan or inf
-  force.Correct();
+  _force.Correct();
   this->cp.Correct();
-  torque.Correct();
+  _torque.Correct();
 
-  // apply forces at cg (with torques for position shift)
-  this->link->AddForceAtRelativePosition(force, this->cp);
-  this->link->AddTorque(torque);
+  return true;
 }
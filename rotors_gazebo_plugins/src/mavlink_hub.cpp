@@ -0,0 +1,416 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// MODULE
+#include "rotors_gazebo_plugins/mavlink_hub.h"
+
+// SYSTEM
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// 3RD PARTY
+#include <gazebo/common/Console.hh>
+
+namespace gazebo {
+
+static const uint8_t kMavlinkMessageLengths[256] = MAVLINK_MESSAGE_LENGTHS;
+static const uint8_t kMavlinkMessageCrcs[256] = MAVLINK_MESSAGE_CRCS;
+
+// Largest step of the 8 bit sequence number that still counts as a gap.
+static const uint8_t kMaxSequenceGap = 128;
+
+static const int kMaxEpollEvents = 64;
+static const int kEpollTimeoutMs = 100;
+
+static int64_t GetMonotonicTimeNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//===============================================================================================//
+//======================================= MAVLINK HUB LINK ======================================//
+//===============================================================================================//
+
+MavlinkHubLink::MavlinkHubLink(const std::string& name, unsigned vehicle_index,
+                               int fd, const sockaddr_in& remote_addr)
+    : name_(name),
+      vehicle_index_(vehicle_index),
+      remote_port_(ntohs(remote_addr.sin_port)),
+      fd_(fd),
+      remote_addr_(remote_addr),
+      tx_sequence_(0) {}
+
+MavlinkHubLink::~MavlinkHubLink() {
+  close(fd_);
+}
+
+bool MavlinkHubLink::Send(uint8_t msgid, const void* msg, uint8_t component_id) {
+  uint8_t payload_len = kMavlinkMessageLengths[msgid];
+  unsigned packet_len = payload_len + MAVLINK_NUM_NON_PAYLOAD_BYTES;
+
+  uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+  sockaddr_in remote_addr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buf[2] = tx_sequence_++;
+    remote_addr = remote_addr_;
+  }
+
+  // Header
+  buf[0] = MAVLINK_STX;
+  buf[1] = payload_len;
+  buf[3] = 0;
+  buf[4] = component_id;
+  buf[5] = msgid;
+
+  // Payload
+  memcpy(&buf[MAVLINK_NUM_HEADER_BYTES], msg, payload_len);
+
+  // Checksum
+  uint16_t checksum;
+  crc_init(&checksum);
+  crc_accumulate_buffer(&checksum, (const char *) &buf[1], MAVLINK_CORE_HEADER_LEN + payload_len);
+  crc_accumulate(kMavlinkMessageCrcs[msgid], &checksum);
+
+  buf[MAVLINK_NUM_HEADER_BYTES + payload_len] = (uint8_t)(checksum & 0xFF);
+  buf[MAVLINK_NUM_HEADER_BYTES + payload_len + 1] = (uint8_t)(checksum >> 8);
+
+  ssize_t len = sendto(fd_, buf, packet_len, 0, (struct sockaddr *)&remote_addr,
+                       sizeof(remote_addr));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (len <= 0) {
+    ++counters_.tx_errors;
+    return false;
+  }
+  ++counters_.tx_messages;
+  counters_.tx_bytes += len;
+  return true;
+}
+
+void MavlinkHubLink::Receive(std::vector<mavlink_message_t>* messages) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  messages->insert(messages->end(), rx_queue_.begin(), rx_queue_.end());
+  rx_queue_.clear();
+}
+
+MavlinkLinkCounters MavlinkHubLink::GetCounters() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return counters_;
+}
+
+void MavlinkHubLink::OnReadable() {
+  while (true) {
+    sockaddr_in src_addr;
+    socklen_t addrlen = sizeof(src_addr);
+    ssize_t len = recvfrom(fd_, rx_buffer_, sizeof(rx_buffer_), MSG_DONTWAIT,
+                           (struct sockaddr *)&src_addr, &addrlen);
+    if (len <= 0) {
+      if (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        gzerr << "[mavlink_hub] recvfrom failed on link \"" << name_ << "\": "
+              << strerror(errno) << std::endl;
+      }
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      remote_addr_ = src_addr;
+    }
+    ParseDatagram(rx_buffer_, len);
+  }
+}
+
+void MavlinkHubLink::ParseDatagram(const uint8_t* data, size_t len) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  counters_.rx_bytes += len;
+
+  size_t i = 0;
+  while (i < len) {
+    if (data[i] != MAVLINK_STX) {
+      // Skip to the next start byte, counting the garbage once.
+      ++counters_.parse_errors;
+      while (i < len && data[i] != MAVLINK_STX) {
+        ++i;
+      }
+      continue;
+    }
+
+    if (len - i < MAVLINK_NUM_NON_PAYLOAD_BYTES ||
+        len - i < data[i + 1] + MAVLINK_NUM_NON_PAYLOAD_BYTES) {
+      // Truncated frame, UDP datagrams never continue a frame.
+      ++counters_.parse_errors;
+      return;
+    }
+
+    const uint8_t payload_len = data[i + 1];
+    const uint8_t msgid = data[i + 5];
+
+    uint16_t checksum;
+    crc_init(&checksum);
+    crc_accumulate_buffer(&checksum, (const char *) &data[i + 1], MAVLINK_CORE_HEADER_LEN + payload_len);
+    crc_accumulate(kMavlinkMessageCrcs[msgid], &checksum);
+
+    const size_t crc_offset = i + MAVLINK_NUM_HEADER_BYTES + payload_len;
+    if ((checksum & 0xFF) != data[crc_offset] || (checksum >> 8) != data[crc_offset + 1]) {
+      ++counters_.parse_errors;
+      ++i;
+      continue;
+    }
+
+    mavlink_message_t msg;
+    msg.magic = MAVLINK_STX;
+    msg.len = payload_len;
+    msg.seq = data[i + 2];
+    msg.sysid = data[i + 3];
+    msg.compid = data[i + 4];
+    msg.msgid = msgid;
+    msg.checksum = checksum;
+    memset(msg.payload64, 0, sizeof(msg.payload64));
+    memcpy(_MAV_PAYLOAD_NON_CONST(&msg), &data[i + MAVLINK_NUM_HEADER_BYTES], payload_len);
+
+    const uint16_t sender = (msg.sysid << 8) | msg.compid;
+    auto last_sequence = last_rx_sequences_.find(sender);
+    if (last_sequence == last_rx_sequences_.end()) {
+      last_rx_sequences_[sender] = msg.seq;
+    } else {
+      // Only a step of less than half the sequence range forward is a gap,
+      // anything else is a duplicate, a reordered frame or a restart.
+      const uint8_t delta = msg.seq - last_sequence->second;
+      if (delta == 0 || delta >= kMaxSequenceGap) {
+        ++counters_.sequence_reordered;
+      } else {
+        counters_.sequence_gaps += delta - 1;
+      }
+      last_sequence->second = msg.seq;
+    }
+    ++counters_.rx_messages;
+
+    if (msgid == MAVLINK_MSG_ID_TIMESYNC) {
+      HandleTimesync(msg);
+    } else {
+      rx_queue_.push_back(msg);
+    }
+
+    i += payload_len + MAVLINK_NUM_NON_PAYLOAD_BYTES;
+  }
+}
+
+void MavlinkHubLink::HandleTimesync(const mavlink_message_t& msg) {
+  mavlink_timesync_t timesync;
+  mavlink_msg_timesync_decode(&msg, &timesync);
+
+  // Only responses (tc1 != 0) to our own requests carry a round-trip time.
+  if (timesync.tc1 == 0) {
+    return;
+  }
+  double rtt_ms = (GetMonotonicTimeNs() - timesync.ts1) * 1e-6;
+  if (rtt_ms < 0.0 || rtt_ms > 1e4) {
+    return;
+  }
+  ++counters_.rtt_samples;
+  counters_.rtt_sum_ms += rtt_ms;
+  counters_.rtt_max_ms = std::max(counters_.rtt_max_ms, rtt_ms);
+}
+
+//===============================================================================================//
+//========================================= MAVLINK HUB =========================================//
+//===============================================================================================//
+
+MavlinkHub& MavlinkHub::Instance() {
+  static MavlinkHub instance;
+  return instance;
+}
+
+MavlinkHub::MavlinkHub()
+    : running_(false),
+      epoll_fd_(-1),
+      base_port_(kDefaultMavlinkHubBasePort),
+      remote_addr_(htonl(INADDR_ANY)) {}
+
+MavlinkHub::~MavlinkHub() {
+  Stop();
+}
+
+bool MavlinkHub::Start(int base_port, in_addr_t remote_addr) {
+  if (running_) {
+    gzwarn << "[mavlink_hub] Already running, ignoring second start request.\n";
+    return true;
+  }
+
+  epoll_fd_ = epoll_create1(0);
+  if (epoll_fd_ < 0) {
+    gzerr << "[mavlink_hub] epoll_create1 failed: " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  base_port_ = base_port;
+  remote_addr_ = remote_addr;
+  running_ = true;
+  thread_ = std::thread(&MavlinkHub::Run, this);
+  return true;
+}
+
+void MavlinkHub::Stop() {
+  if (!running_) {
+    return;
+  }
+  running_ = false;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  links_.clear();
+  close(epoll_fd_);
+  epoll_fd_ = -1;
+}
+
+std::shared_ptr<MavlinkHubLink> MavlinkHub::Register(const std::string& name,
+                                                     int vehicle_index) {
+  if (!running_) {
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (vehicle_index < 0) {
+    vehicle_index = 0;
+    while (links_.count(vehicle_index)) {
+      ++vehicle_index;
+    }
+  } else if (links_.count(vehicle_index)) {
+    gzerr << "[mavlink_hub] Vehicle index " << vehicle_index << " requested by \""
+          << name << "\" is already taken by \"" << links_[vehicle_index]->GetName()
+          << "\".\n";
+    return nullptr;
+  }
+
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    gzerr << "[mavlink_hub] create socket failed: " << strerror(errno) << std::endl;
+    return nullptr;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+  sockaddr_in local_addr;
+  memset((char *)&local_addr, 0, sizeof(local_addr));
+  local_addr.sin_family = AF_INET;
+  local_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  // Let the OS pick the port
+  local_addr.sin_port = htons(0);
+  if (bind(fd, (struct sockaddr *)&local_addr, sizeof(local_addr)) < 0) {
+    gzerr << "[mavlink_hub] bind failed: " << strerror(errno) << std::endl;
+    close(fd);
+    return nullptr;
+  }
+
+  sockaddr_in remote_addr;
+  memset((char *)&remote_addr, 0, sizeof(remote_addr));
+  remote_addr.sin_family = AF_INET;
+  remote_addr.sin_addr.s_addr = remote_addr_;
+  remote_addr.sin_port = htons(base_port_ + vehicle_index);
+
+  std::shared_ptr<MavlinkHubLink> link(
+      new MavlinkHubLink(name, vehicle_index, fd, remote_addr));
+
+  epoll_event event;
+  event.events = EPOLLIN;
+  event.data.u64 = vehicle_index;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+    gzerr << "[mavlink_hub] epoll_ctl failed: " << strerror(errno) << std::endl;
+    return nullptr;
+  }
+
+  links_[vehicle_index] = link;
+  gzmsg << "[mavlink_hub] Vehicle \"" << name << "\" registered with index "
+        << vehicle_index << ", autopilot port " << link->GetRemotePort() << ".\n";
+  return link;
+}
+
+void MavlinkHub::Unregister(const std::shared_ptr<MavlinkHubLink>& link) {
+  if (!link) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = links_.find(link->GetVehicleIndex());
+  if (it == links_.end() || it->second != link) {
+    return;
+  }
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, link->fd_, nullptr);
+  links_.erase(it);
+}
+
+std::vector<std::shared_ptr<MavlinkHubLink> > MavlinkHub::GetLinks() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<std::shared_ptr<MavlinkHubLink> > links;
+  links.reserve(links_.size());
+  for (const auto& entry : links_) {
+    links.push_back(entry.second);
+  }
+  return links;
+}
+
+void MavlinkHub::SendTimesyncRequests() {
+  mavlink_timesync_t timesync;
+  timesync.tc1 = 0;
+  timesync.ts1 = GetMonotonicTimeNs();
+  for (const auto& link : GetLinks()) {
+    link->Send(MAVLINK_MSG_ID_TIMESYNC, &timesync, 0);
+  }
+}
+
+void MavlinkHub::Run() {
+  epoll_event events[kMaxEpollEvents];
+
+  while (running_) {
+    int n = epoll_wait(epoll_fd_, events, kMaxEpollEvents, kEpollTimeoutMs);
+    if (n < 0) {
+      if (errno != EINTR) {
+        gzerr << "[mavlink_hub] epoll_wait failed: " << strerror(errno) << std::endl;
+      }
+      continue;
+    }
+
+    for (int i = 0; i < n; ++i) {
+      // Look the link up by index, it may have been unregistered since
+      // epoll_wait() returned.
+      std::shared_ptr<MavlinkHubLink> link;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = links_.find(static_cast<unsigned>(events[i].data.u64));
+        if (it != links_.end()) {
+          link = it->second;
+        }
+      }
+      if (link) {
+        link->OnReadable();
+      }
+    }
+  }
+}
+
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// MODULE
+#include "rotors_gazebo_plugins/mavlink_log.h"
+
+// SYSTEM
+#include <cstring>
+
+namespace gazebo {
+
+static const char kMavlinkLogMagic[8] = {'R', 'M', 'A', 'V', 'L', 'O', 'G', '\0'};
+static const uint32_t kMavlinkLogVersion = 1;
+
+// sim_time_usec, direction, msgid, payload_len
+static const size_t kMavlinkLogRecordHeaderSize = 8 + 1 + 1 + 1;
+
+bool MavlinkLogWriter::Open(const std::string& path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (file_) {
+    fclose(file_);
+  }
+  file_ = fopen(path.c_str(), "wb");
+  if (!file_) {
+    return false;
+  }
+  fwrite(kMavlinkLogMagic, 1, sizeof(kMavlinkLogMagic), file_);
+  fwrite(&kMavlinkLogVersion, sizeof(kMavlinkLogVersion), 1, file_);
+  return true;
+}
+
+void MavlinkLogWriter::Close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (file_) {
+    fclose(file_);
+    file_ = NULL;
+  }
+}
+
+void MavlinkLogWriter::Write(uint64_t sim_time_usec, MavlinkLogDirection direction,
+                             uint8_t msgid, const void* payload, uint8_t payload_len) {
+  uint8_t header[kMavlinkLogRecordHeaderSize];
+  memcpy(&header[0], &sim_time_usec, sizeof(sim_time_usec));
+  header[8] = static_cast<uint8_t>(direction);
+  header[9] = msgid;
+  header[10] = payload_len;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!file_) {
+    return;
+  }
+  // Written through the stdio buffer, so this does not hit the disk per message.
+  fwrite(header, 1, sizeof(header), file_);
+  fwrite(payload, 1, payload_len, file_);
+}
+
+bool MavlinkLogReader::ReadAll(const std::string& path,
+                               std::vector<MavlinkLogRecord>* records) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+
+  char magic[sizeof(kMavlinkLogMagic)];
+  uint32_t version = 0;
+  if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+      memcmp(magic, kMavlinkLogMagic, sizeof(magic)) != 0 ||
+      fread(&version, sizeof(version), 1, file) != 1 ||
+      version != kMavlinkLogVersion) {
+    fclose(file);
+    return false;
+  }
+
+  uint8_t header[kMavlinkLogRecordHeaderSize];
+  while (fread(header, 1, sizeof(header), file) == sizeof(header)) {
+    MavlinkLogRecord record;
+    memcpy(&record.sim_time_usec, &header[0], sizeof(record.sim_time_usec));
+    record.direction = static_cast<MavlinkLogDirection>(header[8]);
+    record.msgid = header[9];
+    record.payload.resize(header[10]);
+    if (fread(record.payload.data(), 1, record.payload.size(), file) !=
+        record.payload.size()) {
+      // Truncated last record, e.g. the simulation was killed.
+      break;
+    }
+    records->push_back(record);
+  }
+
+  fclose(file);
+  return true;
+}
+
+void MavlinkLogReader::ToMessage(const MavlinkLogRecord& record, mavlink_message_t* msg) {
+  memset(msg, 0, sizeof(*msg));
+  msg->magic = MAVLINK_STX;
+  msg->len = record.payload.size();
+  msg->msgid = record.msgid;
+  memcpy(_MAV_PAYLOAD_NON_CONST(msg), record.payload.data(), record.payload.size());
+}
+
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// MODULE
+#include "rotors_gazebo_plugins/plugin_profiler.h"
+
+// SYSTEM
+#include <algorithm>
+
+namespace gazebo {
+
+// Bin b >= 4 covers [(4 + b % 4), (5 + b % 4)) * 2^(b / 4 - 1) ns.
+static unsigned int HistogramBin(uint64_t duration_ns) {
+  if (duration_ns < 4) {
+    return duration_ns;
+  }
+  const unsigned int msb = 63 - __builtin_clzll(duration_ns);
+  return (msb - 1) * 4 + ((duration_ns >> (msb - 2)) & 3);
+}
+
+static uint64_t HistogramBinLowerBound(unsigned int bin) {
+  if (bin < 4) {
+    return bin;
+  }
+  return static_cast<uint64_t>(4 + bin % 4) << (bin / 4 - 1);
+}
+
+PluginProfilerEntry::PluginProfilerEntry(const std::string& plugin_name,
+                                         const std::string& model_name)
+    : plugin_name_(plugin_name),
+      model_name_(model_name),
+      total_ns_(0),
+      max_ns_(0) {
+  for (unsigned int bin = 0; bin < kProfilerHistogramBins; ++bin) {
+    histogram_[bin].store(0, std::memory_order_relaxed);
+  }
+}
+
+void PluginProfilerEntry::AddSample(uint64_t duration_ns) {
+  total_ns_.fetch_add(duration_ns, std::memory_order_relaxed);
+  histogram_[HistogramBin(duration_ns)].fetch_add(1, std::memory_order_relaxed);
+  // The maximum rarely changes, so this is usually a single load.
+  uint64_t max_ns = max_ns_.load(std::memory_order_relaxed);
+  while (duration_ns > max_ns &&
+         !max_ns_.compare_exchange_weak(max_ns, duration_ns,
+                                        std::memory_order_relaxed)) {
+  }
+}
+
+PluginProfilerStatistics PluginProfilerEntry::GetStatistics() const {
+  PluginProfilerStatistics statistics;
+  statistics.plugin_name = plugin_name_;
+  statistics.model_name = model_name_;
+
+  // Copy the histogram first, so that the percentile is computed from one
+  // consistent set of counts.
+  uint64_t histogram[kProfilerHistogramBins];
+  uint64_t calls = 0;
+  for (unsigned int bin = 0; bin < kProfilerHistogramBins; ++bin) {
+    histogram[bin] = histogram_[bin].load(std::memory_order_relaxed);
+    calls += histogram[bin];
+  }
+  const uint64_t total_ns = total_ns_.load(std::memory_order_relaxed);
+  const uint64_t max_ns = max_ns_.load(std::memory_order_relaxed);
+
+  statistics.calls = calls;
+  statistics.total_ns = total_ns;
+  statistics.mean_ns = calls ? static_cast<double>(total_ns) / calls : 0.0;
+  statistics.max_ns = max_ns;
+
+  // Upper edge of the bin that contains the 99th percentile.
+  statistics.p99_ns = 0;
+  const uint64_t rank = (calls * 99 + 99) / 100;
+  uint64_t cumulative = 0;
+  for (unsigned int bin = 0; bin < kProfilerHistogramBins && calls > 0; ++bin) {
+    cumulative += histogram[bin];
+    if (cumulative >= rank) {
+      statistics.p99_ns = std::min(HistogramBinLowerBound(bin + 1), max_ns);
+      break;
+    }
+  }
+  return statistics;
+}
+
+PluginProfiler& PluginProfiler::Instance() {
+  static PluginProfiler instance;
+  return instance;
+}
+
+PluginProfilerEntry* PluginProfiler::GetEntry(const std::string& plugin_name,
+                                              const std::string& model_name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unique_ptr<PluginProfilerEntry>& entry =
+      entries_[std::make_pair(plugin_name, model_name)];
+  if (!entry) {
+    entry.reset(new PluginProfilerEntry(plugin_name, model_name));
+  }
+  return entry.get();
+}
+
+std::vector<PluginProfilerStatistics> PluginProfiler::GetStatistics() const {
+  std::vector<PluginProfilerStatistics> statistics;
+  std::lock_guard<std::mutex> lock(mutex_);
+  statistics.reserve(entries_.size());
+  for (const auto& entry : entries_) {
+    statistics.push_back(entry.second->GetStatistics());
+  }
+  return statistics;
+}
+
+}
@@ -0,0 +1,363 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rotors_gazebo_plugins/voxel_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <thread>
+
+namespace gazebo {
+
+namespace {
+
+// Occluded fills of the seed bits of gen through the bits of pro, towards
+// the higher and the lower bits of a word.
+uint64_t FillUp(uint64_t gen, uint64_t pro) {
+  gen |= pro & (gen << 1);
+  pro &= pro << 1;
+  gen |= pro & (gen << 2);
+  pro &= pro << 2;
+  gen |= pro & (gen << 4);
+  pro &= pro << 4;
+  gen |= pro & (gen << 8);
+  pro &= pro << 8;
+  gen |= pro & (gen << 16);
+  pro &= pro << 16;
+  return gen | (pro & (gen << 32));
+}
+
+uint64_t FillDown(uint64_t gen, uint64_t pro) {
+  gen |= pro & (gen >> 1);
+  pro &= pro >> 1;
+  gen |= pro & (gen >> 2);
+  pro &= pro >> 2;
+  gen |= pro & (gen >> 4);
+  pro &= pro >> 4;
+  gen |= pro & (gen >> 8);
+  pro &= pro >> 8;
+  gen |= pro & (gen >> 16);
+  pro &= pro >> 16;
+  return gen | (pro & (gen >> 32));
+}
+
+// Fills the runs of passable bits of a row that contain a seed bit, in
+// place. One pass up and one down carry the fill across the words.
+void FillRow(const uint64_t* passable, int num_words, uint64_t* row) {
+  uint64_t carry = 0;
+  for (int i = 0; i < num_words; ++i) {
+    row[i] = FillUp(row[i] | (carry & passable[i]), passable[i]);
+    carry = row[i] >> 63;
+  }
+  carry = 0;
+  for (int i = num_words - 1; i >= 0; --i) {
+    row[i] = FillDown(row[i] | ((carry << 63) & passable[i]), passable[i]);
+    carry = row[i] & 1;
+  }
+}
+
+// Calls function(begin, end) on num_threads parts of [0, count).
+template <typename Function>
+void ParallelFor(int num_threads, int count, const Function& function) {
+  // Small steps are not worth starting threads for.
+  const int kMinCountPerThread = 64;
+  num_threads = std::max(1, std::min(num_threads, count / kMinCountPerThread));
+  auto part_begin = [&](int part) {
+    return static_cast<int>(static_cast<int64_t>(count) * part / num_threads);
+  };
+  std::vector<std::thread> threads;
+  for (int i = 1; i < num_threads; ++i) {
+    threads.push_back(std::thread(function, part_begin(i), part_begin(i + 1)));
+  }
+  function(0, part_begin(1));
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+// Squared distance transform of one line of samples f with the given
+// stride, in place: f[q] = min over p of (q - p)^2 + f[p]. The buffers hold
+// the line, the parabolas of the lower envelope and their boundaries.
+void DistanceTransformLine(float* f, size_t stride, int n,
+                           std::vector<float>* line,
+                           std::vector<int>* parabolas,
+                           std::vector<float>* boundaries) {
+  const float kInfinity = std::numeric_limits<float>::infinity();
+  line->resize(n);
+  parabolas->resize(n);
+  boundaries->resize(n + 1);
+  float* d = line->data();
+  int* v = parabolas->data();
+  float* z = boundaries->data();
+  for (int q = 0; q < n; ++q) {
+    d[q] = f[q * stride];
+  }
+
+  int k = -1;
+  for (int q = 0; q < n; ++q) {
+    if (d[q] == kInfinity) {
+      continue;
+    }
+    // Intersection with the last parabola, which is removed while it lies
+    // above the new one everywhere to its right.
+    float s = -kInfinity;
+    while (k >= 0) {
+      s = ((d[q] + q * q) - (d[v[k]] + v[k] * v[k])) / (2.0f * (q - v[k]));
+      if (s > z[k]) {
+        break;
+      }
+      --k;
+    }
+    ++k;
+    v[k] = q;
+    z[k] = k == 0 ? -kInfinity : s;
+    z[k + 1] = kInfinity;
+  }
+
+  if (k < 0) {
+    return;
+  }
+  int j = 0;
+  for (int q = 0; q < n; ++q) {
+    while (z[j + 1] < q) {
+      ++j;
+    }
+    f[q * stride] = (q - v[j]) * (q - v[j]) + d[v[j]];
+  }
+}
+
+// Squared distances [cells] of all voxels to the nearest voxel with a zero
+// in f, which holds 0 for these and infinity for the others.
+void DistanceTransform(const Eigen::Vector3i& size, int num_threads,
+                       std::vector<float>* f) {
+  const size_t strides[3] = {1, static_cast<size_t>(size.x()),
+                             static_cast<size_t>(size.x()) * size.y()};
+  for (int axis = 0; axis < 3; ++axis) {
+    // The lines along the axis, indexed by the other two coordinates.
+    const int other_axis0 = axis == 0 ? 1 : 0;
+    const int other_axis1 = axis == 2 ? 1 : 2;
+    const int num_lines = size[other_axis0] * size[other_axis1];
+    ParallelFor(num_threads, num_lines, [&](int begin, int end) {
+      std::vector<float> line;
+      std::vector<int> parabolas;
+      std::vector<float> boundaries;
+      for (int i = begin; i < end; ++i) {
+        const size_t offset = (i % size[other_axis0]) * strides[other_axis0] +
+                              (i / size[other_axis0]) * strides[other_axis1];
+        DistanceTransformLine(f->data() + offset, strides[axis], size[axis],
+                              &line, &parabolas, &boundaries);
+      }
+    });
+  }
+}
+
+}
+
+void WriteLittleEndian32(const void* data, size_t count, std::ostream* file) {
+  const uint32_t kByteOrderProbe = 1;
+  uint8_t first_byte;
+  memcpy(&first_byte, &kByteOrderProbe, 1);
+  if (first_byte == 1) {
+    file->write(static_cast<const char*>(data), count * sizeof(uint32_t));
+    return;
+  }
+
+  // Big endian host, swap the bytes in chunks.
+  const char* bytes = static_cast<const char*>(data);
+  std::vector<uint32_t> chunk;
+  const size_t kChunkSize = 4096;
+  for (size_t begin = 0; begin < count; begin += kChunkSize) {
+    const size_t chunk_count = std::min(kChunkSize, count - begin);
+    chunk.resize(chunk_count);
+    memcpy(chunk.data(), bytes + begin * sizeof(uint32_t),
+           chunk_count * sizeof(uint32_t));
+    for (uint32_t& value : chunk) {
+      value = (value >> 24) | ((value >> 8) & 0xff00) |
+              ((value << 8) & 0xff0000) | (value << 24);
+    }
+    file->write(reinterpret_cast<const char*>(chunk.data()),
+                chunk_count * sizeof(uint32_t));
+  }
+}
+
+bool DistanceField::Write(const std::string& filename) const {
+  std::ofstream file(filename.c_str(), std::ios::binary);
+  file << "# distance field\n"
+       << "format float32 little_endian\n"
+       << "size " << size.x() << " " << size.y() << " " << size.z() << "\n"
+       << "first_cell_center " << first_cell_center.x() << " "
+       << first_cell_center.y() << " " << first_cell_center.z() << "\n"
+       << "leaf_size " << leaf_size << "\n"
+       << "data\n";
+
+  static_assert(sizeof(float) == sizeof(uint32_t), "float is not 32 bit.");
+  WriteLittleEndian32(distances.data(), distances.size(), &file);
+  return file.good();
+}
+
+void ComputeDistanceField(const VoxelGrid& free_space, int num_threads,
+                          DistanceField* field) {
+  const float kInfinity = std::numeric_limits<float>::infinity();
+  field->first_cell_center = free_space.first_cell_center();
+  field->leaf_size = free_space.leaf_size();
+  field->size = Eigen::Vector3i(free_space.size_x(), free_space.size_y(),
+                                free_space.size_z());
+  const size_t num_cells =
+      static_cast<size_t>(field->size.x()) * field->size.y() * field->size.z();
+
+  // Distances of the free voxels to the occupied ones and the other way
+  // round, each is zero on the voxels of the other kind.
+  std::vector<float>& outside = field->distances;
+  std::vector<float> inside(num_cells);
+  outside.resize(num_cells);
+  size_t index = 0;
+  for (int z = 0; z < field->size.z(); ++z) {
+    for (int y = 0; y < field->size.y(); ++y) {
+      for (int x = 0; x < field->size.x(); ++x, ++index) {
+        const bool is_free = free_space.IsSet(x, y, z);
+        outside[index] = is_free ? kInfinity : 0.0f;
+        inside[index] = is_free ? 0.0f : kInfinity;
+      }
+    }
+  }
+  DistanceTransform(field->size, num_threads, &outside);
+  DistanceTransform(field->size, num_threads, &inside);
+
+  const float leaf_size = static_cast<float>(field->leaf_size);
+  for (size_t i = 0; i < num_cells; ++i) {
+    outside[i] = outside[i] > 0.0f ? leaf_size * std::sqrt(outside[i])
+                                   : -leaf_size * std::sqrt(inside[i]);
+  }
+}
+
+void FloodFill(const VoxelGrid& occupied,
+               const std::vector<Eigen::Vector3i>& seeds, int num_threads,
+               VoxelGrid* reached, VoxelGrid* newly_reached) {
+  const int size_y = reached->size_y();
+  const int size_z = reached->size_z();
+  const int num_words = reached->words_per_row();
+  std::vector<uint64_t> word_masks(num_words);
+  for (int i = 0; i < num_words; ++i) {
+    word_masks[i] = reached->WordMask(i);
+  }
+
+  // Seed bits that still have to be filled into each row, and whether the
+  // row is in the next step. Both are set concurrently by neighbouring rows.
+  VoxelGrid pending(reached->first_cell_center(), reached->leaf_size(),
+                    reached->size_x(), size_y, size_z);
+  std::vector<char> queued(static_cast<size_t>(size_y) * size_z, 0);
+  std::vector<Eigen::Vector2i> step;
+  for (const Eigen::Vector3i& seed : seeds) {
+    if (occupied.IsSet(seed.x(), seed.y(), seed.z()) ||
+        reached->IsSet(seed.x(), seed.y(), seed.z())) {
+      continue;
+    }
+    pending.Set(seed.x(), seed.y(), seed.z());
+    char& is_queued = queued[static_cast<size_t>(seed.z()) * size_y + seed.y()];
+    if (!is_queued) {
+      is_queued = 1;
+      step.push_back(Eigen::Vector2i(seed.y(), seed.z()));
+    }
+  }
+
+  const Eigen::Vector2i neighbors[4] = {
+      Eigen::Vector2i(1, 0), Eigen::Vector2i(-1, 0), Eigen::Vector2i(0, 1),
+      Eigen::Vector2i(0, -1)};
+  std::vector<uint64_t> new_words;
+  while (!step.empty()) {
+    const int step_size = static_cast<int>(step.size());
+    new_words.assign(static_cast<size_t>(step_size) * num_words, 0);
+
+    // Fill every row of the step, each row is written by one thread.
+    ParallelFor(num_threads, step_size, [&](int begin, int end) {
+      std::vector<uint64_t> passable(num_words);
+      for (int i = begin; i < end; ++i) {
+        const int y = step[i].x();
+        const int z = step[i].y();
+        queued[static_cast<size_t>(z) * size_y + y] = 0;
+        const uint64_t* occupied_row = occupied.Row(y, z);
+        uint64_t* pending_row = pending.Row(y, z);
+        uint64_t* reached_row = reached->Row(y, z);
+        uint64_t* new_row = &new_words[static_cast<size_t>(i) * num_words];
+        for (int j = 0; j < num_words; ++j) {
+          passable[j] = ~occupied_row[j] & ~reached_row[j] & word_masks[j];
+          new_row[j] = pending_row[j] & passable[j];
+          pending_row[j] = 0;
+        }
+        FillRow(passable.data(), num_words, new_row);
+        for (int j = 0; j < num_words; ++j) {
+          reached_row[j] |= new_row[j];
+        }
+        if (newly_reached != NULL) {
+          uint64_t* newly_reached_row = newly_reached->Row(y, z);
+          for (int j = 0; j < num_words; ++j) {
+            newly_reached_row[j] |= new_row[j];
+          }
+        }
+      }
+    });
+
+    // Seed the neighbouring rows with the new voxels, reached is only read.
+    std::vector<std::vector<Eigen::Vector2i> > next_steps(step_size);
+    ParallelFor(num_threads, step_size, [&](int begin, int end) {
+      std::vector<Eigen::Vector2i>& next_step = next_steps[begin];
+      for (int i = begin; i < end; ++i) {
+        const uint64_t* new_row =
+            &new_words[static_cast<size_t>(i) * num_words];
+        for (const Eigen::Vector2i& neighbor : neighbors) {
+          const int y = step[i].x() + neighbor.x();
+          const int z = step[i].y() + neighbor.y();
+          if (y < 0 || y >= size_y || z < 0 || z >= size_z) {
+            continue;
+          }
+          const uint64_t* occupied_row = occupied.Row(y, z);
+          const uint64_t* reached_row = reached->Row(y, z);
+          uint64_t* pending_row = pending.Row(y, z);
+          bool has_seeds = false;
+          for (int j = 0; j < num_words; ++j) {
+            const uint64_t seeds = new_row[j] & ~occupied_row[j] &
+                                   ~reached_row[j];
+            if (seeds != 0) {
+              __atomic_fetch_or(&pending_row[j], seeds, __ATOMIC_RELAXED);
+              has_seeds = true;
+            }
+          }
+          if (has_seeds &&
+              !__atomic_exchange_n(
+                  &queued[static_cast<size_t>(z) * size_y + y], 1,
+                  __ATOMIC_RELAXED)) {
+            next_step.push_back(Eigen::Vector2i(y, z));
+          }
+        }
+      }
+    });
+
+    step.clear();
+    for (const std::vector<Eigen::Vector2i>& next_step : next_steps) {
+      step.insert(step.end(), next_step.begin(), next_step.end());
+    }
+  }
+}
+
+}
@@ -0,0 +1,595 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rotors_gazebo_plugins/voxelizer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+#include <Eigen/Geometry>
+
+namespace gazebo {
+
+namespace {
+
+// Half length of the projection of an axis aligned box onto an axis.
+double ProjectedRadius(const Eigen::Vector3d& half_extents,
+                       const Eigen::Vector3d& axis) {
+  return half_extents.dot(axis.cwiseAbs());
+}
+
+// Squared distance between the segment point + t * direction,
+// t_min <= t <= t_max, and an axis aligned box. The distance is piecewise
+// quadratic in t, with the pieces ending where the segment crosses the
+// planes of the faces, so every piece is minimized in closed form.
+double SquaredDistanceSegmentToAabb(const Eigen::Vector3d& point,
+                                    const Eigen::Vector3d& direction,
+                                    double t_min, double t_max,
+                                    const Eigen::Vector3d& aabb_center,
+                                    const Eigen::Vector3d& aabb_half_extents) {
+  const Eigen::Vector3d offset = point - aabb_center;
+  double breakpoints[8];
+  int num_breakpoints = 0;
+  breakpoints[num_breakpoints++] = t_min;
+  for (int i = 0; i < 3; ++i) {
+    if (direction[i] == 0.0) {
+      continue;
+    }
+    for (int side = -1; side <= 1; side += 2) {
+      const double t =
+          (side * aabb_half_extents[i] - offset[i]) / direction[i];
+      if (t > t_min && t < t_max) {
+        breakpoints[num_breakpoints++] = t;
+      }
+    }
+  }
+  breakpoints[num_breakpoints++] = t_max;
+  std::sort(breakpoints, breakpoints + num_breakpoints);
+
+  double min_squared_distance = std::numeric_limits<double>::max();
+  for (int k = 0; k + 1 < num_breakpoints; ++k) {
+    // a * t^2 + b * t + c, summed over the faces the segment is outside of
+    // on this piece.
+    const double t_middle = 0.5 * (breakpoints[k] + breakpoints[k + 1]);
+    double a = 0.0;
+    double b = 0.0;
+    double c = 0.0;
+    for (int i = 0; i < 3; ++i) {
+      const double value = offset[i] + t_middle * direction[i];
+      double face_offset;
+      if (value > aabb_half_extents[i]) {
+        face_offset = offset[i] - aabb_half_extents[i];
+      } else if (value < -aabb_half_extents[i]) {
+        face_offset = offset[i] + aabb_half_extents[i];
+      } else {
+        continue;
+      }
+      a += direction[i] * direction[i];
+      b += 2.0 * face_offset * direction[i];
+      c += face_offset * face_offset;
+    }
+    double t = breakpoints[k];
+    if (a > 0.0) {
+      t = std::min(std::max(-b / (2.0 * a), breakpoints[k]),
+                   breakpoints[k + 1]);
+    }
+    min_squared_distance = std::min(min_squared_distance, (a * t + b) * t + c);
+  }
+  return min_squared_distance;
+}
+
+// Clips the cells that overlap [min, max] to the cells
+// clip_first <= (x, y, z) <= clip_last, returns false if none are left.
+bool ClippedCellRange(const Eigen::Vector3d& min, const Eigen::Vector3d& max,
+                      const Eigen::Vector3i& clip_first,
+                      const Eigen::Vector3i& clip_last,
+                      const VoxelGrid& grid, Eigen::Vector3i* first,
+                      Eigen::Vector3i* last) {
+  if (!grid.CellRange(min, max, first, last)) {
+    return false;
+  }
+  *first = first->cwiseMax(clip_first);
+  *last = last->cwiseMin(clip_last);
+  return (first->array() <= last->array()).all();
+}
+
+// Sets the voxels that overlap [min, max] within the cells
+// clip_first <= (x, y, z) <= clip_last and pass the overlap test of their
+// center.
+template <typename OverlapTest>
+void SetOverlappingVoxels(const Eigen::Vector3d& min,
+                          const Eigen::Vector3d& max,
+                          const Eigen::Vector3i& clip_first,
+                          const Eigen::Vector3i& clip_last,
+                          const OverlapTest& overlaps, VoxelGrid* grid) {
+  Eigen::Vector3i first;
+  Eigen::Vector3i last;
+  if (!ClippedCellRange(min, max, clip_first, clip_last, *grid, &first,
+                        &last)) {
+    return;
+  }
+  for (int z = first.z(); z <= last.z(); ++z) {
+    for (int y = first.y(); y <= last.y(); ++y) {
+      for (int x = first.x(); x <= last.x(); ++x) {
+        if (overlaps(grid->CellCenter(x, y, z))) {
+          grid->Set(x, y, z);
+        }
+      }
+    }
+  }
+}
+
+// Cubic block of voxels, clipped to the range of a primitive.
+struct VoxelBlock {
+  Eigen::Vector3i first;
+  Eigen::Vector3i last;
+  int size;
+};
+
+// Clips the block of the given size at first to [range_first, range_last],
+// returns false if nothing is left.
+bool ClipBlock(const Eigen::Vector3i& first, int size,
+               const Eigen::Vector3i& range_last, VoxelBlock* block) {
+  block->first = first;
+  block->last = (first + Eigen::Vector3i::Constant(size - 1))
+                    .cwiseMin(range_last);
+  block->size = size;
+  return (block->last.array() >= block->first.array()).all();
+}
+
+// Center and half side lengths of the voxels of a block.
+void GetBlockAabb(const VoxelBlock& block, const VoxelGrid& grid,
+                  Eigen::Vector3d* center, Eigen::Vector3d* half_extents) {
+  const Eigen::Vector3d first_center =
+      grid.CellCenter(block.first.x(), block.first.y(), block.first.z());
+  const Eigen::Vector3d last_center =
+      grid.CellCenter(block.last.x(), block.last.y(), block.last.z());
+  *center = (first_center + last_center) / 2;
+  *half_extents = (last_center - first_center) / 2 +
+                  Eigen::Vector3d::Constant(grid.leaf_size() / 2);
+}
+
+void FillBlock(const VoxelBlock& block, VoxelGrid* grid) {
+  for (int z = block.first.z(); z <= block.last.z(); ++z) {
+    for (int y = block.first.y(); y <= block.last.y(); ++y) {
+      grid->SetRun(block.first.x(), block.last.x() + 1, y, z);
+    }
+  }
+}
+
+// Calls function(child) for the non empty children of a block.
+template <typename Function>
+void ForEachChildBlock(const VoxelBlock& block,
+                       const Eigen::Vector3i& range_last,
+                       const Function& function) {
+  const int child_size = block.size / 2;
+  for (int i = 0; i < 8; ++i) {
+    const Eigen::Vector3i offset((i & 1) ? child_size : 0,
+                                 (i & 2) ? child_size : 0,
+                                 (i & 4) ? child_size : 0);
+    VoxelBlock child;
+    if (ClipBlock(block.first + offset, child_size, range_last, &child)) {
+      function(child);
+    }
+  }
+}
+
+void VoxelizeSolidBlock(const CollisionPrimitive& primitive,
+                        const VoxelBlock& block,
+                        const Eigen::Vector3i& range_last, VoxelGrid* grid) {
+  Eigen::Vector3d center;
+  Eigen::Vector3d half_extents;
+  GetBlockAabb(block, *grid, &center, &half_extents);
+  if (!PrimitiveOverlapsAabb(primitive, center, half_extents)) {
+    return;
+  }
+  if (block.size == 1) {
+    grid->Set(block.first.x(), block.first.y(), block.first.z());
+  } else if (AabbInsidePrimitive(primitive, center, half_extents)) {
+    FillBlock(block, grid);
+  } else {
+    ForEachChildBlock(block, range_last, [&](const VoxelBlock& child) {
+      VoxelizeSolidBlock(primitive, child, range_last, grid);
+    });
+  }
+}
+
+void VoxelizeMeshBlock(const std::vector<Eigen::Vector3d>& vertices,
+                       const std::vector<int>& triangles,
+                       const VoxelBlock& block,
+                       const Eigen::Vector3i& range_last, VoxelGrid* grid) {
+  Eigen::Vector3d center;
+  Eigen::Vector3d half_extents;
+  GetBlockAabb(block, *grid, &center, &half_extents);
+  std::vector<int> overlapping_triangles;
+  for (int triangle : triangles) {
+    if (TriangleOverlapsAabb(vertices[3 * triangle],
+                             vertices[3 * triangle + 1],
+                             vertices[3 * triangle + 2], center,
+                             half_extents)) {
+      overlapping_triangles.push_back(triangle);
+      if (block.size == 1) {
+        break;
+      }
+    }
+  }
+  if (overlapping_triangles.empty()) {
+    return;
+  }
+  if (block.size == 1) {
+    grid->Set(block.first.x(), block.first.y(), block.first.z());
+    return;
+  }
+  ForEachChildBlock(block, range_last, [&](const VoxelBlock& child) {
+    VoxelizeMeshBlock(vertices, overlapping_triangles, child, range_last,
+                      grid);
+  });
+}
+
+}
+
+void CollisionPrimitive::GetAabb(Eigen::Vector3d* min,
+                                 Eigen::Vector3d* max) const {
+  Eigen::Vector3d extents = Eigen::Vector3d::Zero();
+  switch (type) {
+    case kBox:
+      extents = rotation.cwiseAbs() * half_extents;
+      break;
+    case kSphere:
+      extents.setConstant(radius);
+      break;
+    case kCylinder: {
+      const Eigen::Vector3d axis = rotation.col(2);
+      for (int i = 0; i < 3; ++i) {
+        extents[i] = half_length * std::abs(axis[i]) +
+                     radius * std::sqrt(std::max(0.0, 1.0 - axis[i] * axis[i]));
+      }
+      break;
+    }
+    case kMesh:
+      min->setConstant(std::numeric_limits<double>::max());
+      max->setConstant(-std::numeric_limits<double>::max());
+      for (const Eigen::Vector3d& vertex : triangle_vertices) {
+        *min = min->cwiseMin(vertex);
+        *max = max->cwiseMax(vertex);
+      }
+      return;
+    case kPlane:
+      min->setConstant(-std::numeric_limits<double>::max());
+      max->setConstant(std::numeric_limits<double>::max());
+      return;
+  }
+  *min = position - extents;
+  *max = position + extents;
+}
+
+bool BoxOverlapsAabb(const Eigen::Vector3d& box_center,
+                     const Eigen::Matrix3d& box_rotation,
+                     const Eigen::Vector3d& box_half_extents,
+                     const Eigen::Vector3d& aabb_center,
+                     const Eigen::Vector3d& aabb_half_extents) {
+  // Separating axis test of two boxes [Ericson, Real-Time Collision
+  // Detection, 4.4.1], the axis aligned box being the reference frame.
+  const Eigen::Matrix3d& r = box_rotation;
+  const Eigen::Vector3d& a = aabb_half_extents;
+  const Eigen::Vector3d& b = box_half_extents;
+  const Eigen::Vector3d t = box_center - aabb_center;
+  // The epsilon keeps near parallel edges from giving a zero cross product
+  // that wrongly separates.
+  const Eigen::Matrix3d abs_r = (r.cwiseAbs().array() + 1e-9).matrix();
+
+  for (int i = 0; i < 3; ++i) {
+    if (std::abs(t[i]) > a[i] + abs_r.row(i).dot(b)) {
+      return false;
+    }
+  }
+  for (int j = 0; j < 3; ++j) {
+    if (std::abs(t.dot(r.col(j))) > a.dot(abs_r.col(j)) + b[j]) {
+      return false;
+    }
+  }
+  for (int i = 0; i < 3; ++i) {
+    const int i1 = (i + 1) % 3;
+    const int i2 = (i + 2) % 3;
+    for (int j = 0; j < 3; ++j) {
+      const int j1 = (j + 1) % 3;
+      const int j2 = (j + 2) % 3;
+      const double radius_a = a[i1] * abs_r(i2, j) + a[i2] * abs_r(i1, j);
+      const double radius_b = b[j1] * abs_r(i, j2) + b[j2] * abs_r(i, j1);
+      if (std::abs(t[i2] * r(i1, j) - t[i1] * r(i2, j)) >
+          radius_a + radius_b) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool SphereOverlapsAabb(const Eigen::Vector3d& sphere_center, double radius,
+                        const Eigen::Vector3d& aabb_center,
+                        const Eigen::Vector3d& aabb_half_extents) {
+  return ((sphere_center - aabb_center).cwiseAbs() - aabb_half_extents)
+             .cwiseMax(0.0)
+             .squaredNorm() <= radius * radius;
+}
+
+bool CylinderOverlapsAabb(const Eigen::Vector3d& cylinder_center,
+                          const Eigen::Vector3d& axis, double radius,
+                          double half_length,
+                          const Eigen::Vector3d& aabb_center,
+                          const Eigen::Vector3d& aabb_half_extents) {
+  // The box has to reach between the caps...
+  const double axial_offset = axis.dot(aabb_center - cylinder_center);
+  const double axial_radius = ProjectedRadius(aabb_half_extents, axis);
+  if (axial_offset - axial_radius > half_length ||
+      axial_offset + axial_radius < -half_length) {
+    return false;
+  }
+  // ...and come within the radius of the axis.
+  return SquaredDistanceSegmentToAabb(cylinder_center, axis, -half_length,
+                                      half_length, aabb_center,
+                                      aabb_half_extents) <= radius * radius;
+}
+
+bool TriangleOverlapsAabb(const Eigen::Vector3d& vertex0,
+                          const Eigen::Vector3d& vertex1,
+                          const Eigen::Vector3d& vertex2,
+                          const Eigen::Vector3d& aabb_center,
+                          const Eigen::Vector3d& aabb_half_extents) {
+  // Separating axis test of Akenine-Moeller, "Fast 3D Triangle-Box Overlap
+  // Testing", with the box at the origin.
+  const Eigen::Vector3d v0 = vertex0 - aabb_center;
+  const Eigen::Vector3d v1 = vertex1 - aabb_center;
+  const Eigen::Vector3d v2 = vertex2 - aabb_center;
+
+  // Axes of the box.
+  if ((v0.cwiseMin(v1).cwiseMin(v2) - aabb_half_extents).maxCoeff() > 0.0 ||
+      (v0.cwiseMax(v1).cwiseMax(v2) + aabb_half_extents).minCoeff() < 0.0) {
+    return false;
+  }
+
+  // Cross products of the axes of the box and the edges.
+  const Eigen::Vector3d edges[3] = {v1 - v0, v2 - v1, v0 - v2};
+  for (int i = 0; i < 3; ++i) {
+    for (const Eigen::Vector3d& edge : edges) {
+      const Eigen::Vector3d axis = Eigen::Vector3d::Unit(i).cross(edge);
+      const double p0 = v0.dot(axis);
+      const double p1 = v1.dot(axis);
+      const double p2 = v2.dot(axis);
+      const double radius = ProjectedRadius(aabb_half_extents, axis);
+      if (std::min(p0, std::min(p1, p2)) > radius ||
+          std::max(p0, std::max(p1, p2)) < -radius) {
+        return false;
+      }
+    }
+  }
+
+  // Normal of the triangle.
+  const Eigen::Vector3d normal = edges[0].cross(edges[1]);
+  return std::abs(normal.dot(v0)) <=
+         ProjectedRadius(aabb_half_extents, normal);
+}
+
+bool PlaneOverlapsAabb(const Eigen::Vector3d& point,
+                       const Eigen::Vector3d& normal,
+                       const Eigen::Vector3d& aabb_center,
+                       const Eigen::Vector3d& aabb_half_extents) {
+  return std::abs(normal.dot(aabb_center - point)) <=
+         ProjectedRadius(aabb_half_extents, normal);
+}
+
+bool PrimitiveOverlapsAabb(const CollisionPrimitive& primitive,
+                           const Eigen::Vector3d& aabb_center,
+                           const Eigen::Vector3d& aabb_half_extents) {
+  switch (primitive.type) {
+    case CollisionPrimitive::kBox:
+      return BoxOverlapsAabb(primitive.position, primitive.rotation,
+                             primitive.half_extents, aabb_center,
+                             aabb_half_extents);
+    case CollisionPrimitive::kSphere:
+      return SphereOverlapsAabb(primitive.position, primitive.radius,
+                                aabb_center, aabb_half_extents);
+    case CollisionPrimitive::kCylinder:
+      return CylinderOverlapsAabb(primitive.position, primitive.rotation.col(2),
+                                  primitive.radius, primitive.half_length,
+                                  aabb_center, aabb_half_extents);
+    case CollisionPrimitive::kMesh: {
+      const std::vector<Eigen::Vector3d>& vertices =
+          primitive.triangle_vertices;
+      for (size_t i = 0; i + 2 < vertices.size(); i += 3) {
+        if (TriangleOverlapsAabb(vertices[i], vertices[i + 1],
+                                 vertices[i + 2], aabb_center,
+                                 aabb_half_extents)) {
+          return true;
+        }
+      }
+      return false;
+    }
+    case CollisionPrimitive::kPlane:
+      return PlaneOverlapsAabb(primitive.position, primitive.normal,
+                               aabb_center, aabb_half_extents);
+  }
+  return false;
+}
+
+bool AabbInsidePrimitive(const CollisionPrimitive& primitive,
+                         const Eigen::Vector3d& aabb_center,
+                         const Eigen::Vector3d& aabb_half_extents) {
+  switch (primitive.type) {
+    case CollisionPrimitive::kBox: {
+      // Farthest extent of the aabb along the axes of the box.
+      const Eigen::Matrix3d rotation_transposed =
+          primitive.rotation.transpose();
+      const Eigen::Vector3d extents =
+          (rotation_transposed * (aabb_center - primitive.position))
+              .cwiseAbs() +
+          rotation_transposed.cwiseAbs() * aabb_half_extents;
+      return (extents.array() <= primitive.half_extents.array()).all();
+    }
+    case CollisionPrimitive::kSphere:
+      return ((aabb_center - primitive.position).cwiseAbs() +
+              aabb_half_extents)
+                 .squaredNorm() <= primitive.radius * primitive.radius;
+    case CollisionPrimitive::kCylinder: {
+      // The cylinder is convex, so it is enough to test the corners.
+      const Eigen::Vector3d axis = primitive.rotation.col(2);
+      for (int i = 0; i < 8; ++i) {
+        const Eigen::Vector3d corner =
+            aabb_center - primitive.position +
+            Eigen::Vector3d((i & 1) ? 1.0 : -1.0, (i & 2) ? 1.0 : -1.0,
+                            (i & 4) ? 1.0 : -1.0)
+                .cwiseProduct(aabb_half_extents);
+        const double axial_offset = axis.dot(corner);
+        if (std::abs(axial_offset) > primitive.half_length ||
+            (corner - axial_offset * axis).squaredNorm() >
+                primitive.radius * primitive.radius) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case CollisionPrimitive::kMesh:
+    case CollisionPrimitive::kPlane:
+      return false;
+  }
+  return false;
+}
+
+void VoxelizePrimitive(const CollisionPrimitive& primitive,
+                       const Eigen::Vector3i& first,
+                       const Eigen::Vector3i& last, VoxelGrid* grid) {
+  const Eigen::Vector3d voxel_half_extents =
+      Eigen::Vector3d::Constant(grid->leaf_size() / 2);
+
+  if (primitive.type == CollisionPrimitive::kMesh) {
+    // Every triangle only visits the voxels of its own bounding box.
+    const std::vector<Eigen::Vector3d>& vertices = primitive.triangle_vertices;
+    for (size_t i = 0; i + 2 < vertices.size(); i += 3) {
+      const Eigen::Vector3d& v0 = vertices[i];
+      const Eigen::Vector3d& v1 = vertices[i + 1];
+      const Eigen::Vector3d& v2 = vertices[i + 2];
+      SetOverlappingVoxels(
+          v0.cwiseMin(v1).cwiseMin(v2), v0.cwiseMax(v1).cwiseMax(v2), first,
+          last,
+          [&](const Eigen::Vector3d& center) {
+            return TriangleOverlapsAabb(v0, v1, v2, center,
+                                        voxel_half_extents);
+          },
+          grid);
+    }
+    return;
+  }
+
+  Eigen::Vector3d min;
+  Eigen::Vector3d max;
+  primitive.GetAabb(&min, &max);
+  SetOverlappingVoxels(
+      min, max, first, last,
+      [&](const Eigen::Vector3d& center) {
+        return PrimitiveOverlapsAabb(primitive, center, voxel_half_extents);
+      },
+      grid);
+}
+
+void VoxelizePrimitiveHierarchical(const CollisionPrimitive& primitive,
+                                   const Eigen::Vector3i& first,
+                                   const Eigen::Vector3i& last,
+                                   VoxelGrid* grid) {
+  Eigen::Vector3d min;
+  Eigen::Vector3d max;
+  primitive.GetAabb(&min, &max);
+  Eigen::Vector3i range_first;
+  Eigen::Vector3i range_last;
+  if (!ClippedCellRange(min, max, first, last, *grid, &range_first,
+                        &range_last)) {
+    return;
+  }
+
+  // Smallest power of two block that covers the range.
+  const int range_size = (range_last - range_first).maxCoeff() + 1;
+  int size = 1;
+  while (size < range_size) {
+    size *= 2;
+  }
+  VoxelBlock root;
+  ClipBlock(range_first, size, range_last, &root);
+
+  if (primitive.type == CollisionPrimitive::kMesh) {
+    std::vector<int> triangles(primitive.triangle_vertices.size() / 3);
+    for (size_t i = 0; i < triangles.size(); ++i) {
+      triangles[i] = i;
+    }
+    VoxelizeMeshBlock(primitive.triangle_vertices, triangles, root,
+                      range_last, grid);
+  } else {
+    VoxelizeSolidBlock(primitive, root, range_last, grid);
+  }
+}
+
+int VoxelizePrimitives(
+    const std::vector<CollisionPrimitive>& primitives,
+    const Eigen::Vector3i& first, const Eigen::Vector3i& last,
+    bool coarse_to_fine, int num_threads, VoxelGrid* grid,
+    const std::function<bool(const Eigen::Vector3i& chunk_first,
+                             const Eigen::Vector3i& chunk_last)>& chunk_done) {
+  const int num_layers = last.z() - first.z() + 1;
+  num_threads = std::max(1, std::min(num_threads, num_layers));
+
+  // Several chunks per thread even out shapes that are spread unevenly.
+  const int layers_per_chunk = std::max(1, num_layers / (4 * num_threads));
+  std::atomic<int> next_chunk(0);
+  std::atomic<bool> stopped(false);
+  auto voxelize_chunks = [&]() {
+    for (int z = first.z() + layers_per_chunk * next_chunk++;
+         z <= last.z() && !stopped;
+         z = first.z() + layers_per_chunk * next_chunk++) {
+      Eigen::Vector3i chunk_first = first;
+      Eigen::Vector3i chunk_last = last;
+      chunk_first.z() = z;
+      chunk_last.z() = std::min(z + layers_per_chunk - 1, last.z());
+      for (const CollisionPrimitive& primitive : primitives) {
+        if (coarse_to_fine) {
+          VoxelizePrimitiveHierarchical(primitive, chunk_first, chunk_last,
+                                        grid);
+        } else {
+          VoxelizePrimitive(primitive, chunk_first, chunk_last, grid);
+        }
+      }
+      if (!chunk_done(chunk_first, chunk_last)) {
+        stopped = true;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 1; i < num_threads; ++i) {
+    threads.push_back(std::thread(voxelize_chunks));
+  }
+  voxelize_chunks();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return num_threads;
+}
+
+}
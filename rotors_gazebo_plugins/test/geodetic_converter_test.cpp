@@ -0,0 +1,153 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks GeodeticConverter against published WGS84 reference coordinates.
+// Run with
+//   catkin run_tests rotors_gazebo_plugins
+
+// SYSTEM
+#include <cmath>
+
+// 3RD PARTY
+#include <gtest/gtest.h>
+
+// USER
+#include "rotors_gazebo_plugins/geodetic_converter.h"
+
+namespace gazebo {
+
+namespace {
+
+const double kDegToRad = M_PI / 180.0;
+
+// The reference coordinates are published with 1 cm resolution, so half of
+// that is rounding; the rest is left for the converter.
+const double kReferenceTolerance_m = 0.01;
+
+// Tolerance of the round trips within 10 km of the origin. 1e-9 rad is
+// 6.4 mm on the ellipsoid.
+const double kRoundTripTolerance_m = 1e-3;
+const double kRoundTripTolerance_rad = 1e-9;
+
+void ExpectVectorNear(const Eigen::Vector3d& expected,
+                      const Eigen::Vector3d& actual, double tolerance) {
+  EXPECT_NEAR(expected.x(), actual.x(), tolerance);
+  EXPECT_NEAR(expected.y(), actual.y(), tolerance);
+  EXPECT_NEAR(expected.z(), actual.z(), tolerance);
+}
+
+}
+
+TEST(GeodeticConverterTest, GeodeticToEcefAxes) {
+  // On the axes, the WGS84 definition gives the ECEF coordinates directly.
+  ExpectVectorNear(Eigen::Vector3d(kWgs84SemiMajorAxis_m, 0.0, 0.0),
+                   GeodeticConverter::GeodeticToEcef(0.0, 0.0, 0.0),
+                   kReferenceTolerance_m);
+  ExpectVectorNear(Eigen::Vector3d(0.0, kWgs84SemiMajorAxis_m + 100.0, 0.0),
+                   GeodeticConverter::GeodeticToEcef(0.0, 90.0 * kDegToRad,
+                                                     100.0),
+                   kReferenceTolerance_m);
+  ExpectVectorNear(Eigen::Vector3d(0.0, 0.0, 6356752.31),
+                   GeodeticConverter::GeodeticToEcef(90.0 * kDegToRad, 0.0,
+                                                     0.0),
+                   kReferenceTolerance_m);
+}
+
+// Example of the GeographicLib CartConvert documentation:
+//   echo 33.3 44.4 6000 | CartConvert
+//   3816209.60 3737108.55 3485109.57
+TEST(GeodeticConverterTest, GeodeticToEcefReference) {
+  ExpectVectorNear(Eigen::Vector3d(3816209.60, 3737108.55, 3485109.57),
+                   GeodeticConverter::GeodeticToEcef(
+                       33.3 * kDegToRad, 44.4 * kDegToRad, 6000.0),
+                   kReferenceTolerance_m);
+}
+
+TEST(GeodeticConverterTest, EcefToGeodeticReference) {
+  double latitude_rad, longitude_rad, altitude_m;
+  GeodeticConverter::EcefToGeodetic(
+      Eigen::Vector3d(3816209.60, 3737108.55, 3485109.57), &latitude_rad,
+      &longitude_rad, &altitude_m);
+  EXPECT_NEAR(33.3 * kDegToRad, latitude_rad, kRoundTripTolerance_rad);
+  EXPECT_NEAR(44.4 * kDegToRad, longitude_rad, kRoundTripTolerance_rad);
+  EXPECT_NEAR(6000.0, altitude_m, kReferenceTolerance_m);
+}
+
+// Example of the GeographicLib CartConvert documentation, local coordinates
+// with the origin at 33N 44E 20 m:
+//   echo 33.3 44.4 6000 | CartConvert -l 33 44 20
+//   37288.97 33374.29 5783.65
+TEST(GeodeticConverterTest, GeodeticToEnuReference) {
+  GeodeticConverter converter(33.0 * kDegToRad, 44.0 * kDegToRad, 20.0);
+  ExpectVectorNear(Eigen::Vector3d(37288.97, 33374.29, 5783.65),
+                   converter.GeodeticToEnu(33.3 * kDegToRad, 44.4 * kDegToRad,
+                                           6000.0),
+                   kReferenceTolerance_m);
+
+  double latitude_rad, longitude_rad, altitude_m;
+  converter.EnuToGeodetic(Eigen::Vector3d(37288.97, 33374.29, 5783.65),
+                          &latitude_rad, &longitude_rad, &altitude_m);
+  EXPECT_NEAR(33.3 * kDegToRad, latitude_rad, kRoundTripTolerance_rad);
+  EXPECT_NEAR(44.4 * kDegToRad, longitude_rad, kRoundTripTolerance_rad);
+  EXPECT_NEAR(6000.0, altitude_m, kReferenceTolerance_m);
+}
+
+// ENU -> geodetic -> ENU and ENU -> ECEF -> ENU on a grid of +-10 km around
+// origins from the equator to close to the pole.
+TEST(GeodeticConverterTest, EnuRoundTrip10km) {
+  const double origin_latitudes_deg[] = {0.0, 47.3769, -33.9, 89.9};
+  for (double origin_latitude_deg : origin_latitudes_deg) {
+    GeodeticConverter converter(origin_latitude_deg * kDegToRad,
+                                8.5417 * kDegToRad, 408.0);
+    for (double east = -10000.0; east <= 10000.0; east += 2500.0) {
+      for (double north = -10000.0; north <= 10000.0; north += 2500.0) {
+        for (double up = -100.0; up <= 1000.0; up += 550.0) {
+          const Eigen::Vector3d enu(east, north, up);
+          ExpectVectorNear(enu, converter.EcefToEnu(converter.EnuToEcef(enu)),
+                           kRoundTripTolerance_m);
+
+          double latitude_rad, longitude_rad, altitude_m;
+          converter.EnuToGeodetic(enu, &latitude_rad, &longitude_rad,
+                                  &altitude_m);
+          ExpectVectorNear(enu, converter.GeodeticToEnu(latitude_rad,
+                                                        longitude_rad,
+                                                        altitude_m),
+                           kRoundTripTolerance_m);
+        }
+      }
+    }
+  }
+}
+
+TEST(GeodeticConverterTest, OriginMapsToZero) {
+  GeodeticConverter converter(47.3769 * kDegToRad, 8.5417 * kDegToRad, 408.0);
+  ExpectVectorNear(Eigen::Vector3d::Zero(),
+                   converter.GeodeticToEnu(converter.GetOriginLatitude(),
+                                           converter.GetOriginLongitude(),
+                                           converter.GetOriginAltitude()),
+                   kRoundTripTolerance_m);
+}
+
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2015 Fadri Furrer, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Mina Kamel, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Janosch Nikolic, ASL, ETH Zurich, Switzerland
+ * Copyright 2015 Markus Achtelik, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks the sample times of SensorStreamScheduler, driven like
+// GazeboMavlinkInterface does at the physics rate.
+// Run with
+//   catkin run_tests rotors_gazebo_plugins
+
+// SYSTEM
+#include <cmath>
+#include <vector>
+
+// 3RD PARTY
+#include <gtest/gtest.h>
+
+// USER
+#include "rotors_gazebo_plugins/sensor_stream_scheduler.h"
+
+namespace gazebo {
+
+namespace {
+
+const double kPhysicsStep = 0.001;
+
+// A sample is taken at the first physics step at or after its due time, the
+// due times are not multiples of the step in floating point.
+const double kStepTolerance = 1.5 * kPhysicsStep;
+
+/// \brief    Steps sim time from begin to end (exclusive) and returns the
+///           times at which the stream was due.
+std::vector<double> RunScheduler(SensorStreamScheduler* scheduler,
+                                 double begin, double end) {
+  std::vector<double> due_times;
+  const int steps = static_cast<int>(std::round((end - begin) / kPhysicsStep));
+  for (int i = 0; i < steps; ++i) {
+    const double t = begin + i * kPhysicsStep;
+    if (scheduler->IsDue(t)) {
+      due_times.push_back(t);
+    }
+  }
+  return due_times;
+}
+
+}
+
+TEST(SensorStreamSchedulerTest, ZeroRateIsAlwaysDue) {
+  SensorStreamScheduler scheduler;
+  scheduler.Configure(0.0, 0.0, 0.0, 1);
+  EXPECT_EQ(1000u, RunScheduler(&scheduler, 0.0, 1.0).size());
+}
+
+TEST(SensorStreamSchedulerTest, RateAndPhase) {
+  SensorStreamScheduler scheduler;
+  scheduler.Configure(5.0, 0.05, 0.0, 1);
+  const std::vector<double> due_times = RunScheduler(&scheduler, 0.0, 100.0);
+  ASSERT_EQ(500u, due_times.size());
+  for (size_t i = 0; i < due_times.size(); ++i) {
+    EXPECT_NEAR(0.05 + i * 0.2, due_times[i], kStepTolerance);
+  }
+}
+
+TEST(SensorStreamSchedulerTest, JitterDoesNotAccumulate) {
+  SensorStreamScheduler scheduler;
+  scheduler.Configure(5.0, 0.1, 0.02, 1);
+  const std::vector<double> due_times = RunScheduler(&scheduler, 0.0, 100.0);
+  ASSERT_EQ(500u, due_times.size());
+  for (size_t i = 0; i < due_times.size(); ++i) {
+    EXPECT_NEAR(0.1 + i * 0.2, due_times[i], 0.02 + kStepTolerance);
+  }
+}
+
+TEST(SensorStreamSchedulerTest, ResyncsAfterPause) {
+  SensorStreamScheduler scheduler;
+  scheduler.Configure(5.0, 0.0, 0.0, 1);
+  RunScheduler(&scheduler, 0.0, 10.0);
+  // The source stalls for 3 s, there is no burst of the missed samples.
+  const std::vector<double> due_times = RunScheduler(&scheduler, 13.0, 14.0);
+  ASSERT_EQ(5u, due_times.size());
+  EXPECT_NEAR(13.0, due_times.front(), kStepTolerance);
+}
+
+TEST(SensorStreamSchedulerTest, ResyncsAfterTimeReset) {
+  SensorStreamScheduler scheduler;
+  scheduler.Configure(5.0, 0.0, 0.0, 1);
+  ASSERT_EQ(500u, RunScheduler(&scheduler, 0.0, 100.0).size());
+  // The world is reset, the stream continues at its rate right away.
+  const std::vector<double> due_times = RunScheduler(&scheduler, 0.0, 10.0);
+  ASSERT_EQ(50u, due_times.size());
+  for (size_t i = 0; i < due_times.size(); ++i) {
+    EXPECT_NEAR(i * 0.2, due_times[i], kStepTolerance);
+  }
+}
+
+TEST(SensorStreamSchedulerTest, ResyncsAfterTimeResetWithJitter) {
+  SensorStreamScheduler scheduler;
+  scheduler.Configure(5.0, 0.1, 0.02, 1);
+  RunScheduler(&scheduler, 0.0, 100.0);
+  const std::vector<double> due_times = RunScheduler(&scheduler, 0.0, 10.0);
+  EXPECT_GE(due_times.size(), 49u);
+  EXPECT_LE(due_times.size(), 50u);
+  ASSERT_FALSE(due_times.empty());
+  EXPECT_NEAR(0.1, due_times.front(), 0.02 + kStepTolerance);
+}
+
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}